@@ -29,6 +29,36 @@
 #define ENABLE_REPORT_STATE_DATA 0  /** 是否开启上报状态数据功能，需要Agent支持 */
 #define ENABLE_SET_DISPATCHER_THREAD_NAME 1 /** 是否允许设置send线程名 */
 
+/**
+  * 发送合并控制宏，Sender一次最多从队列取出DISPATCHER_GATHER_MESSAGES个消息，
+  * 连续的Buffer消息合并成一次writev，每次合并的字节数不超过DISPATCHER_GATHER_BYTES
+  */
+#define DISPATCHER_GATHER_MESSAGES 64
+#define DISPATCHER_GATHER_BYTES    65536
+
+/**
+  * SenderGroup一致性哈希时，每个成员在哈希环上的虚拟节点个数，
+  * 值越大键值分布越均匀，但成员增减时重建哈希环的开销越大
+  */
+#define DISPATCHER_GROUP_VIRTUAL_NODES 160
+
+/**
+  * 消息池控制宏，每个创建消息的线程有一个按大小分级的消息池，
+  * 每级最多缓存DISPATCHER_MESSAGE_POOL_BUCKETS个消息，为0表示不使用消息池，总是从堆上分配
+  */
+#define DISPATCHER_MESSAGE_POOL_BUCKETS 128
+
+/**
+  * RPC通道允许的最大应答消息体字节数，超过时认为对端出错，断开连接
+  */
+#define DISPATCHER_RPC_MAX_REPLY_BYTES (64*1024*1024)
+
+/**
+  * 延迟直方图的桶数，第i个桶统计[2^(i-1), 2^i)微秒的延迟，
+  * 最后一个桶统计所有更大的延迟
+  */
+#define DISPATCHER_LATENCY_BUCKETS 32
+
 /***
   * dispatcher模块的名字空间名称
   */
@@ -18,6 +18,11 @@
  */
 #ifndef MOOON_DISPATCHER_H
 #define MOOON_DISPATCHER_H
+#include <vector>
+#include <sys/cpu_placement.h>
+#include <observer/observable.h>
+#include <dispatcher/rpc.h>
+#include <dispatcher/stats.h>
 #include <dispatcher/message.h>
 #include <dispatcher/reply_handler.h>
 
@@ -27,6 +32,8 @@
   * @Dispatcher: 消息分发器，提供将消息发往目标IP和端口的能力
   * @Sender: 执行将消息发往目标IP和端口
   * @SendThread: 消息发送池线程，调度Sender将消息发往目标IP和端口
+  * @SenderGroup: 发送者组，按策略在多个Sender中选择一个发送消息，并可故障转移
+  * @RpcChannel: RPC通道，在一个Sender上按序列号匹配请求和应答，允许多个请求同时在途
   * @ReplyHandler: 消息应答处理器，处理对端的应答，和Sender一一对应，
   *                即一个ReplyHandler只被一个Sender唯一持有
   */
@@ -73,6 +80,17 @@ public:
     /** 设置重连接次数 */
     virtual void set_reconnect_times(int32_t reconnect_times) = 0;
 
+    /***
+      * 设置队列的字节水位，默认均为0表示只受queue_size限制
+      * 队列中的字节数达到high_bytes时，回调IReplyHandler::queue_high_watermark，
+      * 之后push_message直接返回false，直到降到low_bytes以下，回调IReplyHandler::queue_low_watermark
+      * @low_bytes: 如果大于high_bytes，则被调整为high_bytes
+      */
+    virtual void set_queue_watermarks(uint64_t high_bytes, uint64_t low_bytes) = 0;
+
+    /** 得到已推送但未发送完的字节数 */
+    virtual uint64_t get_queue_bytes() const = 0;
+
     /***
       * 推送消息
       * @message: 需要推送的消息
@@ -82,6 +100,12 @@ public:
       */
     virtual bool push_message(file_message_t* message, uint32_t milliseconds=0) = 0;
     virtual bool push_message(buffer_message_t* message, uint32_t milliseconds=0) = 0;
+
+    /***
+      * 推送共享消息，推送成功时对消息的引用计数增一，调用者仍持有自己的引用
+      * 这样同一个消息可推送给多个Sender，而不用复制多份
+      */
+    virtual bool push_message(shared_message_t* message, uint32_t milliseconds=0) = 0;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -142,6 +166,115 @@ public:
     virtual ISender* get_sender(const net::ip_node_t& ip_node) = 0;    
 };
 
+//////////////////////////////////////////////////////////////////////////
+// ISenderGroup
+
+/***
+  * SenderGroup选择成员的策略
+  */
+typedef enum
+{
+    select_round_robin,     /** 在健康的成员中轮询 */
+    select_least_bytes,     /** 选择已推送但未发出字节数最少的健康成员 */
+    select_consistent_hash  /** 按消息的键值一致性哈希，成员增减时只影响少量键值 */
+}select_policy_t;
+
+/***
+  * 发送者组接口，将多个对端组成一组，按策略选择成员发送消息
+  * 成员均为Unmanaged类型的Sender，成员连接失败或连接断开时被自动剔除，
+  * 重新连接成功后自动恢复
+  */
+class ISenderGroup
+{
+public:
+    virtual ~ISenderGroup() {}
+
+    /** 转换成可读的字符串信息 */
+    virtual std::string str() const = 0;
+
+    /** 得到选择成员的策略 */
+    virtual select_policy_t get_select_policy() const = 0;
+
+    /***
+      * 增加一个成员
+      * @sender_info 用来创建Sender的信息结构，其中的reply_handler由组接管，
+      *              成员被删除时一同被删除
+      * @return 如果ip_node对应的Sender已经存在，则返回false
+      */
+    virtual bool add_sender(const SenderInfo& sender_info) = 0;
+
+    /***
+      * 删除一个成员，并关闭对应的Sender
+      * @return 如果ip_node不是组的成员，则返回false
+      */
+    virtual bool remove_sender(const net::ip_node_t& ip_node) = 0;
+
+    /** 得到成员个数 */
+    virtual uint16_t get_sender_number() const = 0;
+
+    /** 得到健康的成员个数 */
+    virtual uint16_t get_healthy_number() const = 0;
+
+    /***
+      * 推送消息
+      * @message: 需要推送的消息
+      * @milliseconds: 首选成员的等待推送超时毫秒数，超时后依次尝试其它健康的成员，
+      *  尝试其它成员时不等待
+      * @key: 一致性哈希的键值，仅select_consistent_hash策略时有效
+      * @return: 如果消息存入某个成员的队列，则返回true，否则返回false，
+      *  返回false时消息仍由调用者负责
+      */
+    virtual bool push_message(file_message_t* message, uint32_t milliseconds=0, uint32_t key=0) = 0;
+    virtual bool push_message(buffer_message_t* message, uint32_t milliseconds=0, uint32_t key=0) = 0;
+
+    /***
+      * 推送共享消息，推送成功时对消息的引用计数增一，调用者仍持有自己的引用
+      */
+    virtual bool push_message(shared_message_t* message, uint32_t milliseconds=0, uint32_t key=0) = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// ISenderPool
+
+/***
+  * 连接池，到同一对端建立多个连接，并分布到不同的发送线程，
+  * 突破单个连接和单个发送线程的吞吐上限，
+  * 连接池的Sender不在UnmanagedSenderTable中，不影响对同一对端调用open_sender
+  */
+class ISenderPool
+{
+public:
+    virtual ~ISenderPool() {}
+
+    /** 转换成可读的字符串信息 */
+    virtual std::string str() const = 0;
+
+    /** 得到对端的IP节点 */
+    virtual const net::ip_node_t& get_ip_node() const = 0;
+
+    /** 得到连接个数 */
+    virtual uint16_t get_sender_number() const = 0;
+
+    /***
+      * 推送消息，选择队列中字节数最少的连接，不保证消息之间的顺序
+      * @milliseconds: 所选连接的等待推送超时毫秒数，超时后依次尝试其它连接，
+      *  尝试其它连接时不等待
+      * @return: 如果消息存入某个连接的队列，则返回true，否则返回false，
+      *  返回false时消息仍由调用者负责
+      */
+    virtual bool push_message(file_message_t* message, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(buffer_message_t* message, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(shared_message_t* message, uint32_t milliseconds=0) = 0;
+
+    /***
+      * 按键值推送消息，同一键值的消息总由同一连接发送，从而保持顺序，
+      * 该连接不可用时推送失败，而不会转到其它连接
+      */
+    virtual bool push_message(uint32_t key, file_message_t* message, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(uint32_t key, buffer_message_t* message, uint32_t milliseconds=0) = 0;
+    virtual bool push_message(uint32_t key, shared_message_t* message, uint32_t milliseconds=0) = 0;
+};
+
 //////////////////////////////////////////////////////////////////////////
 // IDispatcher
 /***
@@ -156,11 +289,82 @@ public:
     virtual IManagedSenderTable* get_managed_sender_table() = 0;
     virtual IUnmanagedSenderTable* get_unmanaged_sender_table() = 0;
 
+    /** 创建一个发送者组，不再使用时须调用destroy_sender_group销毁 */
+    virtual ISenderGroup* create_sender_group(select_policy_t select_policy) = 0;
+
+    /** 销毁发送者组，并关闭组内所有的Sender */
+    virtual void destroy_sender_group(ISenderGroup* sender_group) = 0;
+
+    /***
+      * 创建到sender_info.ip_node的连接池，不再使用时须调用destroy_sender_pool销毁
+      * @sender_info: 每个连接的信息，其中的key和reply_handler被忽略
+      * @sender_number: 连接个数，为0时取发送线程个数，各连接依次绑定到不同的发送线程
+      * @reply_handler_factory: 为每个连接创建应答处理器，为NULL时应答被丢弃
+      * @return: 如果sender_info无效，则返回NULL
+      */
+    virtual ISenderPool* create_sender_pool(const SenderInfo& sender_info, uint16_t sender_number, IReplyHandlerFactory* reply_handler_factory=NULL) = 0;
+
+    /** 销毁连接池，并关闭池中所有的连接 */
+    virtual void destroy_sender_pool(ISenderPool* sender_pool) = 0;
+
+    /***
+      * 创建到ip_node的RPC通道，通道独占一个Unmanaged类型的Sender，
+      * 请求期限依赖时间轮，所以创建分发器时须指定timer_tick_milliseconds
+      * @queue_size: 发送队列大小
+      * @max_inflight: 最多同时在途的请求个数，会被调整为2的幂
+      * @return: 如果未使用时间轮或ip_node对应的Sender已经存在，则返回NULL
+      */
+    virtual IRpcChannel* create_rpc_channel(const net::ip_node_t& ip_node, uint32_t queue_size, uint32_t max_inflight) = 0;
+
+    /** 销毁RPC通道，在途的请求以rpc_closed完成 */
+    virtual void destroy_rpc_channel(IRpcChannel* rpc_channel) = 0;
+
     /** 得到发送的线程个数 */
     virtual uint16_t get_thread_number() const = 0;
 
-    /** 设置重连接间隔秒数 */
+    /***
+      * 设置重连接间隔秒数，作为退避的基数，
+      * 连续失败n次后的间隔为基数的2^n倍，不超过最大间隔，并在后一半内随机，
+      * 以免大量Sender同时重连接
+      */
     virtual void set_reconnect_seconds(uint32_t seconds) = 0;
+
+    /** 设置重连接的最大间隔秒数，默认为60，小于重连接间隔秒数时按重连接间隔秒数 */
+    virtual void set_reconnect_max_seconds(uint32_t seconds) = 0;
+
+    /***
+      * 设置熔断的连续连接失败次数，默认为0表示不熔断
+      * 熔断期间push_message直接返回false，直到重连接成功
+      */
+    virtual void set_circuit_breaker_failures(uint32_t failures) = 0;
+
+    /***
+      * 设置所有Sender队列中的字节总数上限，默认为0表示不限制
+      * 达到上限后push_message直接返回false，用于限制发送队列占用的总内存
+      */
+    virtual void set_max_queue_bytes(uint64_t bytes) = 0;
+
+    /** 得到所有Sender队列中的字节总数 */
+    virtual uint64_t get_queue_bytes() const = 0;
+
+    /***
+      * 得到所有Sender的统计快照，计数器均为无锁读取，
+      * 各项之间不保证是同一时刻的值
+      * @stats_array: 存放快照，原有的内容被清除
+      */
+    virtual void get_sender_stats(std::vector<SenderStats>& stats_array) = 0;
+
+    /***
+      * 得到统计的可观察者，注册到observer后按上报频率上报所有Sender的统计，
+      * 由分发器持有，须在销毁分发器前注销
+      */
+    virtual observer::IObservable* get_observable() = 0;
+
+    /** 设置异步连接超时毫秒数，为0表示不限制，仅在使用时间轮时有效 */
+    virtual void set_connect_timeout_milliseconds(uint32_t milliseconds) = 0;
+
+    /** 设置消息发送超时毫秒数，一个消息未能一次发完时须在此时长内发完，为0表示不限制，仅在使用时间轮时有效 */
+    virtual void set_write_timeout_milliseconds(uint32_t milliseconds) = 0;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -180,9 +384,17 @@ extern void destroy(IDispatcher* dispatcher);
   * 创建分发器
   * @thread_count 工作线程个数
   * @timeout_seconds 连接超时很秒数
+  * @timer_tick_milliseconds 如果不为0，则使用以它为刻度的时间轮管理超时，
+  *                          这样除连接空闲超时外，还支持连接超时和发送超时，且精度为毫秒
+  * @placement_policy 工作线程的CPU放置策略，默认不绑定CPU
+  * @placement_cpus 仅placement_policy为sys::placement_explicit时有效，格式如：0-3,8,10-11
+  * @use_doorbell 为true时使用门铃模式，每个发送线程一个eventfd门铃，每个Sender一个无锁队列，
+  *               否则每个Sender的队列带一个管道，Sender很多时会耗尽文件句柄
   * @return 如果失败则返回NULL，否则返回非NULL
   */
-extern IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds=60);
+extern IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds=60, uint32_t timer_tick_milliseconds=0
+                         , sys::placement_policy_t placement_policy=sys::placement_none, const char* placement_cpus=NULL
+                         , bool use_doorbell=false);
 
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_H
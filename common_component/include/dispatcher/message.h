@@ -38,11 +38,34 @@ typedef struct
     char data[0];     /** 需要发送的消息 */
 }buffer_message_t;
 
+/***
+  * 可共享的Buffer类型消息结构，带引用计数，
+  * 同一个消息可推送给多个Sender，数据只有一份，
+  * 每次推送成功对引用计数增一，发送完成后减一
+  */
+typedef struct
+{
+    char data[0];     /** 需要发送的消息 */
+}shared_message_t;
+
+/***
+  * 创建和销毁消息，创建的内存来自创建线程的消息池，
+  * 消息推送成功后，由Sender负责销毁，否则仍由调用者负责销毁
+  */
 extern file_message_t* create_file_message(size_t file_size);
 extern buffer_message_t* create_buffer_message(size_t data_length);
 
 extern void destroy_file_message(file_message_t* file_messsage);
 extern void destroy_buffer_message(buffer_message_t* buffer_messsage);
 
+/***
+  * 创建可共享的消息，引用计数为1，由调用者持有，
+  * 推送完后调用者须调用destroy_shared_message释放自己持有的引用
+  */
+extern shared_message_t* create_shared_message(size_t data_length);
+
+/** 对引用计数减一，为0时释放消息 */
+extern void destroy_shared_message(shared_message_t* shared_message);
+
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_MESSAGE_H
@@ -96,6 +96,30 @@ public:
       */
     virtual util::handle_result_t handle_reply(size_t data_size) { return util::handle_error; }
 
+    /***
+      * 通过Sender设置的应答定时器到期，在发送线程中调用，
+      * 用于实现每个请求的应答期限
+      */
+    virtual void reply_timer_expired() {}
+
+    /***
+      * 其它线程登记了新的应答期限，由CSender::post_reply_deadline触发，
+      * 在发送线程中调用，用于启动或提前应答定时器，与连接是否已建立无关
+      */
+    virtual void reply_deadline_changed() {}
+
+    /***
+      * 队列中的字节数达到高水位，在推送消息的线程中调用，
+      * 之后推送会失败，生产者应当在上游限流
+      */
+    virtual void queue_high_watermark() {}
+
+    /***
+      * 队列中的字节数降到低水位，可恢复推送，通常在发送线程中调用，
+      * 和queue_high_watermark在同一把锁内串行调用，两者总是交替出现
+      */
+    virtual void queue_low_watermark() {}
+
     /***
       * 得到状态值
       */
@@ -107,5 +131,21 @@ public:
     virtual void set_state(int state) {}
 };
 
+/***
+  * 应答消息处理器工厂，用于一次创建多个Sender的场景，如连接池
+  */
+class CALLBACK_INTERFACE IReplyHandlerFactory
+{
+public:
+    // 虚析构用于应付编译器
+    virtual ~IReplyHandlerFactory() {}
+
+    /***
+      * 为第index个Sender创建应答消息处理器，被创建的由Sender负责删除
+      * @return 如果为NULL，则所有收到的应答数据丢弃
+      */
+    virtual IReplyHandler* create_reply_handler(uint16_t index) = 0;
+};
+
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_REPLY_HANDLER_H
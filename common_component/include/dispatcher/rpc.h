@@ -0,0 +1,92 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_RPC_H
+#define MOOON_DISPATCHER_RPC_H
+#include <net/inttypes.h>
+#include <dispatcher/config.h>
+DISPATCHER_NAMESPACE_BEGIN
+
+/***
+  * RPC帧格式：net::TCommonMessageHeader + nuint32_t序列号 + 消息体
+  * 头中的size为序列号和消息体的总字节数，command为命令字，
+  * 对端须在应答中原样带回请求的序列号，应答的帧格式与请求相同，
+  * 这样同一连接上可同时有多个请求在途，应答可以乱序返回
+  */
+
+/***
+  * RPC请求失败的原因
+  */
+typedef enum
+{
+    rpc_timeout, /** 在期限内未收到应答 */
+    rpc_closed   /** 已发出请求的连接断开或通道被销毁，应答不会再到达；尚未发出的请求在重连后照常发出 */
+}rpc_error_t;
+
+/***
+  * RPC请求的完成回调，由调用者实现和持有，
+  * call成功返回后，on_reply和on_failure两者恰好有一个被调用一次，
+  * 调用在发送线程中进行，回调返回后通道不再使用它，因此可在回调中删除自己
+  */
+class CALLBACK_INTERFACE IRpcCompletion
+{
+public:
+    // 虚析构用于应付编译器
+    virtual ~IRpcCompletion() {}
+
+    /***
+      * 收到应答
+      * @command: 应答的命令字
+      * @body: 应答的消息体，不包括序列号，仅在本函数内有效
+      * @body_size: 应答的消息体字节数
+      */
+    virtual void on_reply(uint32_t command, const char* body, size_t body_size) = 0;
+
+    /** 请求失败 */
+    virtual void on_failure(rpc_error_t error) = 0;
+};
+
+/***
+  * RPC通道，对应一个Sender，为每个请求分配序列号，按序列号将应答交给对应请求的完成回调
+  */
+class IRpcChannel
+{
+public:
+    virtual ~IRpcChannel() {}
+
+    /** 转换成可读的字符串信息 */
+    virtual std::string str() const = 0;
+
+    /** 得到在途的请求个数 */
+    virtual uint32_t get_inflight_number() const = 0;
+
+    /***
+      * 异步调用，不等待
+      * @command: 请求的命令字
+      * @body: 请求的消息体，会被复制，允许为NULL
+      * @body_size: 请求的消息体字节数
+      * @completion: 完成回调
+      * @timeout_milliseconds: 从调用开始计算的应答期限，为0表示不限制
+      * @return: 如果在途请求已满或发送队列已满，则返回false，此时completion不会被调用
+      */
+    virtual bool call(uint32_t command, const char* body, size_t body_size
+                    , IRpcCompletion* completion, uint32_t timeout_milliseconds) = 0;
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_RPC_H
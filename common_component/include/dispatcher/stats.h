@@ -0,0 +1,64 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_STATS_H
+#define MOOON_DISPATCHER_STATS_H
+#include <net/ip_node.h>
+#include <dispatcher/config.h>
+DISPATCHER_NAMESPACE_BEGIN
+
+/***
+  * 延迟直方图，单位为微秒
+  * 第0个桶统计0微秒，第i个桶统计[2^(i-1), 2^i)微秒的次数
+  */
+typedef struct
+{
+    uint64_t count;              /** 总次数 */
+    uint64_t total_microseconds; /** 总延迟，除以count得平均延迟 */
+    uint64_t max_microseconds;   /** 最大延迟 */
+    uint64_t buckets[DISPATCHER_LATENCY_BUCKETS];
+}latency_histogram_t;
+
+/***
+  * 估算延迟的分位数
+  * @percentile: 取值范围为(0, 100]，如99表示P99
+  * @return: 分位数所在桶的上界，没有数据时返回0
+  */
+extern uint64_t get_latency_percentile(const latency_histogram_t& histogram, double percentile);
+
+/***
+  * Sender的统计快照，计数均为从Sender创建起的累计值
+  */
+struct SenderStats
+{
+    uint16_t key;                /** Sender的键值，Unmanaged类型的Sender无意义 */
+    net::ip_node_t ip_node;      /** 对端的IP节点 */
+    bool connected;              /** 是否已连接 */
+    uint32_t queue_messages;     /** 已推送但未发送完的消息数 */
+    uint64_t queue_bytes;        /** 已推送但未发送完的字节数 */
+    uint64_t messages_out;       /** 发送完成的消息数 */
+    uint64_t bytes_out;          /** 发送的字节数 */
+    uint64_t bytes_in;           /** 收到的应答字节数 */
+    uint32_t reconnect_number;   /** 连接断开或失败后重连接的次数 */
+    latency_histogram_t first_byte_latency; /** 从推送入队到第一个字节发出 */
+    latency_histogram_t complete_latency;   /** 从推送入队到全部发出 */
+    latency_histogram_t connect_latency;    /** 发起连接到连接成功 */
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_STATS_H
@@ -0,0 +1,41 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: JianYi, eyjian@qq.com
+ */
+#ifndef MOOON_SERVER_BUFFER_POOL_H
+#define MOOON_SERVER_BUFFER_POOL_H
+#include <server/config.h>
+SERVER_NAMESPACE_BEGIN
+
+/***
+  * 从当前server线程的缓冲池中借一块Buffer
+  * 缓冲池按大小分级，超出最大级别，或对应级别已借完时，从堆上分配，
+  * 不在server线程中调用时，也总是从堆上分配
+  * @size: 需要的字节数
+  * @return: 返回至少size字节大小的Buffer，必须由return_buffer归还
+  */
+extern char* borrow_buffer(size_t size);
+
+/***
+  * 归还由borrow_buffer借出的Buffer，可以在任意线程中调用，
+  * 在非借出线程中归还时，由借出线程在下次借时回收
+  * @buffer: 由borrow_buffer借出的Buffer，允许为NULL
+  */
+extern void return_buffer(char* buffer);
+
+SERVER_NAMESPACE_END
+#endif // MOOON_SERVER_BUFFER_POOL_H
@@ -19,6 +19,7 @@
 #ifndef MOOON_SERVER_CONFIG_H
 #define MOOON_SERVER_CONFIG_H
 #include <sys/log.h>
+#include <sys/cpu_placement.h>
 #include <net/ip_address.h>
 
 /***
@@ -36,6 +37,15 @@
 //////////////////////////////////////////////////////////////////////////
 SERVER_NAMESPACE_BEGIN
 
+/***
+  * 监听模式
+  */
+typedef enum
+{
+    listen_shared    = 0, /** 所有工作线程共享同一组监听套接字 */
+    listen_reuseport = 1  /** 每个工作线程拥有自己的SO_REUSEPORT监听套接字，由内核均衡分配连接 */
+}listen_mode_t;
+
 /***
   * 配置回调接口
   */
@@ -57,14 +67,89 @@ public:
     /** 连接超时秒数 */
     virtual uint32_t get_connection_timeout_seconds() const { return 10; }
 
+    /***
+      * 是否使用时间轮管理连接超时，
+      * 为false时所有连接只有一个统一的空闲超时，即get_connection_timeout_seconds，
+      * 为true时还支持下面的请求读取超时和响应发送超时，且精度为毫秒
+      */
+    virtual bool use_timing_wheel() const { return false; }
+
+    /** 得到时间轮的刻度毫秒数，即超时的精度 */
+    virtual uint32_t get_timer_tick_milliseconds() const { return 10; }
+
+    /** 请求读取超时毫秒数，收到请求的第一部分数据后，须在此时长内收完整个请求，为0表示不限制 */
+    virtual uint32_t get_read_timeout_milliseconds() const { return 0; }
+
+    /** 响应发送超时毫秒数，响应未能一次发完时，须在此时长内发完，为0表示不限制 */
+    virtual uint32_t get_write_timeout_milliseconds() const { return 0; }
+
+    /***
+      * 是否使用边缘触发（EPOLLET）模式，
+      * 为true时连接只在加入epoll时注册一次EPOLLIN|EPOLLOUT，读写都一直进行到EAGAIN，
+      * 收发切换时不再调用epoll_ctl，适合小消息的请求应答场景
+      */
+    virtual bool use_edge_triggered() const { return false; }
+
     /** 得到epool等待超时毫秒数 */
     virtual uint32_t get_epoll_timeout_milliseconds() const { return 2000; }
 
     /** 得到监听参数 */    
     virtual const net::ip_port_pair_array_t& get_listen_parameter() const = 0;
 
+    /***
+      * 得到每次监听事件最多接受的连接数，
+      * 监听线程会一直accept直到无新连接或达到这个值，值越大越能应对连接风暴，
+      * 但也越会推迟已有连接的事件处理
+      */
+    virtual uint32_t get_accept_batch_size() const { return 64; }
+
+    /***
+      * 得到每个线程的缓冲池每级的Buffer个数，为0表示不使用缓冲池，
+      * 缓冲池分256、1K、4K和16K四级，供IMessageObserver::use_buffer_pool为true时使用
+      */
+    virtual uint32_t get_buffer_pool_size() const { return 128; }
+
+    /***
+      * 得到使用IMessageObserver时，每个连接最多积压的响应数，
+      * 为1时一问一答，大于1时允许对端不等响应就连续发送多个请求，
+      * 响应积压到这个值时暂停接收，直到它们被合并发送完
+      */
+    virtual uint16_t get_pipeline_depth() const { return 1; }
+
+    /***
+      * 得到server线程的CPU放置策略，绑定CPU后，各线程的连接池和epoll事件数组
+      * 在线程中分配，从而落在线程所在的NUMA节点上
+      */
+    virtual sys::placement_policy_t get_placement_policy() const { return sys::placement_none; }
+
+    /** 得到placement_explicit策略时的CPU列表，格式如：0-3,8,10-11 */
+    virtual std::string get_placement_cpus() const { return ""; }
+
     /** 得到每个线程的接管队列的大小 */
     virtual uint32_t get_takeover_queue_size() const { return 100; }
+
+    /***
+      * 是否在线程间做连接的负载均衡，
+      * 为true时各线程周期性统计活跃连接数、每秒收发字节数和事件循环的忙碌时间，
+      * 在响应发送完毕且不再有待发响应时，将连接从负载高的线程迁到负载低的线程，
+      * 连接迁移要求连接是动态创建的，所以仅在get_connection_pool_size为0时有效
+      */
+    virtual bool use_load_balance() const { return false; }
+
+    /** 得到负载统计和均衡的周期毫秒数 */
+    virtual uint32_t get_balance_interval_milliseconds() const { return 1000; }
+
+    /** 线程负载高出各线程平均负载的百分比达到这个值时，才迁出连接 */
+    virtual uint32_t get_balance_threshold_percent() const { return 50; }
+
+    /** 得到每个线程每个周期最多迁出的连接数 */
+    virtual uint32_t get_balance_migration_number() const { return 8; }
+
+    /***
+      * 得到监听模式，
+      * 如果为listen_reuseport，但内核不支持SO_REUSEPORT，则自动退回listen_shared模式
+      */
+    virtual listen_mode_t get_listen_mode() const { return listen_shared; }
 };
 
 SERVER_NAMESPACE_END
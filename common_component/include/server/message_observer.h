@@ -18,6 +18,7 @@
  */
 #ifndef MOOON_SERVER_MESSAGE_OBSERVER_H
 #define MOOON_SERVER_MESSAGE_OBSERVER_H
+#include <server/buffer_pool.h>
 #include <server/packet_handler.h>
 #include <net/inttypes.h>
 SERVER_NAMESPACE_BEGIN
@@ -34,6 +35,14 @@ class CALLBACK_INTERFACE IMessageObserver
 public:
     virtual ~IMessageObserver() {}
 
+    /***
+      * 是否使用线程的缓冲池来存放请求和响应
+      * 为true时，request_body从缓冲池借出，并在on_message返回后由框架归还，使用者不能释放它，
+      * *response_buffer必须由borrow_buffer借出，并由框架调用return_buffer归还；
+      * 为false时，沿用on_message中说明的new char[]和delete []约定
+      */
+    virtual bool use_buffer_pool() const { return false; }
+
     /***
       * 收到一个完整消息时被回调
       * @request_header 输入参数，收到的消息头
@@ -66,6 +66,31 @@ struct RequestContext
     }
 };
 
+/***
+  * 响应数据段，可以是一段Buffer或一个文件的一段
+  * 多个数据段组成一个响应链，由框架用writev和sendfile依次发送，不需要合并到一个Buffer
+  */
+struct ResponseSegment
+{
+    bool is_fd;        /** 是文件段，还是Buffer段 */
+    size_t size;       /** 需要发送的字节数 */
+    off_t file_offset; /** 文件段从文件的哪个偏移位置开始发送，Buffer段时忽略 */
+
+    union
+    {
+        int fd;             /** 文件句柄 */
+        const char* buffer; /** 需要发送的数据 */
+    };
+
+    /***
+      * 释放回调，允许为NULL
+      * 响应链发送完毕或连接关闭时，对每个数据段调用一次，
+      * 可用来归还池化的Buffer、减少引用计数或关闭文件，从而做到发送时不用复制
+      */
+    void (*release)(ResponseSegment* segment);
+    void* release_param; /** 供释放回调使用的参数 */
+};
+
 /***
   * 响应上下文
   */
@@ -73,8 +98,8 @@ struct ResponseContext
 {
     bool is_response_fd;       /** 是响应一个文件句柄，还是一个Buffer */
 
-    size_t response_size;      /** 本次需要响应的总字节数 */
-    size_t response_offset;    /** 从哪个偏移位置开始发送 */
+    size_t response_size;      /** 本次需要响应的总字节数，使用响应链时为所有数据段大小之和 */
+    size_t response_offset;    /** 从哪个偏移位置开始发送，使用响应链时为整个链上的偏移 */
 
     union
     {
@@ -82,6 +107,9 @@ struct ResponseContext
         char* response_buffer; /** 需要发送的数据 */
     };
 
+    ResponseSegment* segments; /** 响应链，不为NULL时忽略is_response_fd、response_fd和response_buffer */
+    uint16_t segment_count;    /** 响应链中数据段的个数 */
+
     ResponseContext()
     {
         reset();
@@ -93,6 +121,41 @@ struct ResponseContext
         response_size   = 0;
         response_offset = 0;
         response_buffer = NULL;
+        segments        = NULL;
+        segment_count   = 0;
+    }
+
+    /***
+      * 设置响应链，response_size为所有数据段大小之和
+      * @segments_: 数据段数组，在发送完之前须保持有效
+      * @segment_count_: 数据段个数
+      */
+    void set_segments(ResponseSegment* segments_, uint16_t segment_count_)
+    {
+        segments        = segments_;
+        segment_count   = segment_count_;
+        response_offset = 0;
+        response_size   = 0;
+        for (uint16_t i=0; i<segment_count; ++i)
+            response_size += segments[i].size;
+    }
+
+    /***
+      * 对响应链中的每个数据段调用释放回调，并清空响应链
+      */
+    void release_segments()
+    {
+        ResponseSegment* segments_ = segments;
+        uint16_t segment_count_ = segment_count;
+
+        // 先清空，以防回调中再次设置
+        segments = NULL;
+        segment_count = 0;
+        for (uint16_t i=0; i<segment_count_; ++i)
+        {
+            if (segments_[i].release != NULL)
+                (*segments_[i].release)(&segments_[i]);
+        }
     }
 
     std::string to_string() const
@@ -103,7 +166,8 @@ struct ResponseContext
            << response_size << "|"
            << response_offset << "|"
            << response_fd << "|"
-           << &response_buffer;
+           << &response_buffer << "|"
+           << segment_count;
 
         return ss.str();
     }
@@ -225,6 +289,14 @@ public:
         return &_response_context;
     }
 
+    /***
+      * 释放响应链，在响应发送完毕或连接关闭时由框架调用
+      */
+    void release_response_segments()
+    {
+        _response_context.release_segments();
+    }
+
 protected:
     RequestContext _request_context;   /** 用来接收请求的上下文，子类应当修改它 */
     ResponseContext _response_context; /** 用来发送响应的上下文，子类应当修改它 */
@@ -19,12 +19,19 @@
 #ifndef MOOON_AGENT_QUEUE_H
 #define MOOON_AGENT_QUEUE_H
 #include <net/epollable_queue.h>
+#include <net/mpmc_epollable_queue.h>
 #include <util/array_queue.h>
 #include <agent/message.h>
 AGENT_NAMESPACE_BEGIN
 
+#if ENABLE_MPMC_QUEUE==1
+typedef net::CMpmcEpollableQueue<net::TCommonMessageHeader*> CReportQueueBase;
+#else
+typedef net::CEpollableQueue<util::CArrayQueue<net::TCommonMessageHeader*> > CReportQueueBase;
+#endif // ENABLE_MPMC_QUEUE
+
 class CAgentThread;
-class CReportQueue: public net::CEpollableQueue<util::CArrayQueue<net::TCommonMessageHeader*> >
+class CReportQueue: public CReportQueueBase
 {
 public:
     CReportQueue(uint32_t queue_max, CAgentThread* agent_thread);
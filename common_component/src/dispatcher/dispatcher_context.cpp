@@ -28,13 +28,23 @@ CDispatcherContext::~CDispatcherContext()
     // 要晚于线程被删除，因为在线程被停止前，可能仍在被使用
     delete _managed_sender_table;
     delete _unmanaged_sender_table;
+    delete _pooled_sender_table;
 }
 
-CDispatcherContext::CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds)
+CDispatcherContext::CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds, uint32_t timer_tick_milliseconds)
     :_timeout_seconds(timeout_seconds)
+    ,_timer_tick_milliseconds(timer_tick_milliseconds)
     ,_thread_pool(NULL)
+    ,_use_doorbell(false)
+    ,_stats_observable(this)
 {    
 	set_reconnect_seconds(2); // 默认重连接间隔秒数
+    set_reconnect_max_seconds(60);
+    set_circuit_breaker_failures(0);
+    set_connect_timeout_milliseconds(0);
+    set_write_timeout_milliseconds(0);
+    set_max_queue_bytes(0);
+    atomic8_set(&_queue_bytes, 0);
 
     _thread_count = thread_count;
     if (_thread_count < 1)
@@ -42,10 +52,18 @@ CDispatcherContext::CDispatcherContext(uint16_t thread_count, uint32_t timeout_s
 
     _managed_sender_table = new CManagedSenderTable(this);
     _unmanaged_sender_table = new CUnmanagedSenderTable(this);
+    _pooled_sender_table = new CPooledSenderTable(this);
 }
 
-bool CDispatcherContext::create()
+bool CDispatcherContext::create(sys::placement_policy_t placement_policy, const char* placement_cpus, bool use_doorbell)
 {           
+    _use_doorbell = use_doorbell;
+    if (!_cpu_placement.create(placement_policy, placement_cpus))
+    {
+        DISPATCHER_LOG_ERROR("Invalid placement cpus: %s.\n", (NULL == placement_cpus)? "NULL": placement_cpus);
+        return false;
+    }
+
     return create_thread_pool();    
 }
 
@@ -59,6 +77,15 @@ void CDispatcherContext::add_sender(CSender* sender)
     send_thread->add_sender(sender);
 }
 
+void CDispatcherContext::add_sender(CSender* sender, uint16_t thread_index)
+{
+    CSendThread* send_thread = _thread_pool->get_thread(thread_index % _thread_pool->get_thread_count());
+    sender->inc_refcount();
+
+    sender->attach_thread(send_thread);
+    send_thread->add_sender(sender);
+}
+
 IManagedSenderTable* CDispatcherContext::get_managed_sender_table()
 {
     return _managed_sender_table;
@@ -69,6 +96,62 @@ IUnmanagedSenderTable* CDispatcherContext::get_unmanaged_sender_table()
     return _unmanaged_sender_table;
 }
 
+ISenderGroup* CDispatcherContext::create_sender_group(select_policy_t select_policy)
+{
+    return new CSenderGroup(_unmanaged_sender_table, select_policy);
+}
+
+void CDispatcherContext::destroy_sender_group(ISenderGroup* sender_group)
+{
+    delete sender_group;
+}
+
+ISenderPool* CDispatcherContext::create_sender_pool(const SenderInfo& sender_info, uint16_t sender_number, IReplyHandlerFactory* reply_handler_factory)
+{
+    if (0 == sender_number)
+        sender_number = _thread_pool->get_thread_count();
+
+    // 起始线程轮转，以免多个连接池的第一个连接都落在同一个线程上
+    uint16_t first_thread_index = _thread_pool->get_next_thread()->get_index();
+    CSenderPool* sender_pool = new CSenderPool(_pooled_sender_table, sender_info.ip_node);
+    if (!sender_pool->open(sender_info, sender_number, first_thread_index, reply_handler_factory))
+    {
+        delete sender_pool;
+        sender_pool = NULL;
+    }
+
+    return sender_pool;
+}
+
+void CDispatcherContext::destroy_sender_pool(ISenderPool* sender_pool)
+{
+    delete sender_pool;
+}
+
+IRpcChannel* CDispatcherContext::create_rpc_channel(const net::ip_node_t& ip_node, uint32_t queue_size, uint32_t max_inflight)
+{
+    // 请求期限由时间轮上的应答定时器实现
+    if (0 == _timer_tick_milliseconds)
+    {
+        DISPATCHER_LOG_ERROR("RPC channel requires timer_tick_milliseconds.\n");
+        return NULL;
+    }
+
+    CRpcChannel* rpc_channel = new CRpcChannel(_unmanaged_sender_table, max_inflight);
+    if (!rpc_channel->open(ip_node, queue_size))
+    {
+        delete rpc_channel;
+        rpc_channel = NULL;
+    }
+
+    return rpc_channel;
+}
+
+void CDispatcherContext::destroy_rpc_channel(IRpcChannel* rpc_channel)
+{
+    delete rpc_channel;
+}
+
 uint16_t CDispatcherContext::get_thread_number() const
 {
     return _thread_pool->get_thread_count();
@@ -79,6 +162,64 @@ void CDispatcherContext::set_reconnect_seconds(uint32_t seconds)
 	atomic_set(&_reconnect_seconds, seconds);
 }
 
+void CDispatcherContext::set_reconnect_max_seconds(uint32_t seconds)
+{
+    atomic_set(&_reconnect_max_seconds, seconds);
+}
+
+void CDispatcherContext::set_circuit_breaker_failures(uint32_t failures)
+{
+    atomic_set(&_circuit_breaker_failures, failures);
+}
+
+void CDispatcherContext::set_max_queue_bytes(uint64_t bytes)
+{
+    atomic8_set(&_max_queue_bytes, static_cast<long>(bytes));
+}
+
+uint64_t CDispatcherContext::get_queue_bytes() const
+{
+    return static_cast<uint64_t>(atomic8_read(&_queue_bytes));
+}
+
+void CDispatcherContext::get_sender_stats(std::vector<SenderStats>& stats_array)
+{
+    stats_array.clear();
+    _managed_sender_table->get_sender_stats(stats_array);
+    _unmanaged_sender_table->get_sender_stats(stats_array);
+    _pooled_sender_table->get_sender_stats(stats_array);
+}
+
+observer::IObservable* CDispatcherContext::get_observable()
+{
+    return &_stats_observable;
+}
+
+bool CDispatcherContext::reserve_queue_bytes(uint64_t bytes)
+{
+    // 先检查后增加，并发推送时可能略超上限，但超出的不会多于每个推送线程一个消息
+    uint64_t max_queue_bytes = static_cast<uint64_t>(atomic8_read(&_max_queue_bytes));
+    if ((max_queue_bytes > 0) && (get_queue_bytes() >= max_queue_bytes)) return false;
+
+    atomic8_add(static_cast<long>(bytes), &_queue_bytes);
+    return true;
+}
+
+void CDispatcherContext::release_queue_bytes(uint64_t bytes)
+{
+    atomic8_sub(static_cast<long>(bytes), &_queue_bytes);
+}
+
+void CDispatcherContext::set_connect_timeout_milliseconds(uint32_t milliseconds)
+{
+    atomic_set(&_connect_timeout_milliseconds, milliseconds);
+}
+
+void CDispatcherContext::set_write_timeout_milliseconds(uint32_t milliseconds)
+{
+    atomic_set(&_write_timeout_milliseconds, milliseconds);
+}
+
 bool CDispatcherContext::create_thread_pool()
 {        
     try
@@ -133,10 +274,11 @@ void destroy(IDispatcher* dispatcher)
     delete dispatcher;
 }
 
-IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds)
+IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds, uint32_t timer_tick_milliseconds
+                  , sys::placement_policy_t placement_policy, const char* placement_cpus, bool use_doorbell)
 {    
-    CDispatcherContext* dispatcher = new CDispatcherContext(thread_count, timeout_seconds);    
-    if (!dispatcher->create())
+    CDispatcherContext* dispatcher = new CDispatcherContext(thread_count, timeout_seconds, timer_tick_milliseconds);    
+    if (!dispatcher->create(placement_policy, placement_cpus, use_doorbell))
     {
         delete dispatcher;
         dispatcher = NULL;
@@ -24,8 +24,13 @@
 #include <sys/lock.h>
 #include <sys/read_write_lock.h>
 #include <sys/thread_pool.h>
+#include <sys/cpu_placement.h>
 
 #include "send_thread.h"
+#include "sender_stats.h"
+#include "rpc_channel.h"
+#include "sender_pool.h"
+#include "sender_group.h"
 #include "dispatcher_log.h"
 #include "managed_sender_table.h"
 #include "default_reply_handler.h"
@@ -36,10 +41,12 @@ class CDispatcherContext: public IDispatcher
 {
 public:
     ~CDispatcherContext();
-    CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds);
+    CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds, uint32_t timer_tick_milliseconds);
     
-    bool create();         
+    bool create(sys::placement_policy_t placement_policy, const char* placement_cpus, bool use_doorbell);
     void add_sender(CSender* sender); 
+    /** 将Sender绑定到指定的发送线程，thread_index超出时取模 */
+    void add_sender(CSender* sender, uint16_t thread_index);
 
     uint32_t get_timeout_seconds() const
     {
@@ -51,11 +58,66 @@ public:
     	return static_cast<uint32_t>(atomic_read(&_reconnect_seconds));
     }
 
+    uint32_t get_reconnect_max_seconds() const
+    {
+        return static_cast<uint32_t>(atomic_read(&_reconnect_max_seconds));
+    }
+
+    uint32_t get_circuit_breaker_failures() const
+    {
+        return static_cast<uint32_t>(atomic_read(&_circuit_breaker_failures));
+    }
+
+    const sys::CCpuPlacement& get_cpu_placement() const
+    {
+        return _cpu_placement;
+    }
+
+    bool use_doorbell() const
+    {
+        return _use_doorbell;
+    }
+
+    uint32_t get_timer_tick_milliseconds() const
+    {
+        return _timer_tick_milliseconds;
+    }
+
+    uint32_t get_connect_timeout_milliseconds() const
+    {
+        return static_cast<uint32_t>(atomic_read(&_connect_timeout_milliseconds));
+    }
+
+    uint32_t get_write_timeout_milliseconds() const
+    {
+        return static_cast<uint32_t>(atomic_read(&_write_timeout_milliseconds));
+    }
+
+    /** 消息入队前占用字节预算，超过上限时返回false */
+    bool reserve_queue_bytes(uint64_t bytes);
+
+    /** 消息被释放后归还字节预算 */
+    void release_queue_bytes(uint64_t bytes);
+
 private: // IDispatcher
     virtual IManagedSenderTable* get_managed_sender_table();
     virtual IUnmanagedSenderTable* get_unmanaged_sender_table();
+    virtual ISenderGroup* create_sender_group(select_policy_t select_policy);
+    virtual void destroy_sender_group(ISenderGroup* sender_group);
+    virtual ISenderPool* create_sender_pool(const SenderInfo& sender_info, uint16_t sender_number, IReplyHandlerFactory* reply_handler_factory);
+    virtual void destroy_sender_pool(ISenderPool* sender_pool);
+    virtual IRpcChannel* create_rpc_channel(const net::ip_node_t& ip_node, uint32_t queue_size, uint32_t max_inflight);
+    virtual void destroy_rpc_channel(IRpcChannel* rpc_channel);
     virtual uint16_t get_thread_number() const;
     virtual void set_reconnect_seconds(uint32_t seconds);
+    virtual void set_reconnect_max_seconds(uint32_t seconds);
+    virtual void set_circuit_breaker_failures(uint32_t failures);
+    virtual void set_max_queue_bytes(uint64_t bytes);
+    virtual uint64_t get_queue_bytes() const;
+    virtual void get_sender_stats(std::vector<SenderStats>& stats_array);
+    virtual observer::IObservable* get_observable();
+    virtual void set_connect_timeout_milliseconds(uint32_t milliseconds);
+    virtual void set_write_timeout_milliseconds(uint32_t milliseconds);
 
 private:        
     bool create_thread_pool();  
@@ -67,9 +129,20 @@ private:
     uint16_t _thread_count;
     uint32_t _timeout_seconds;
     atomic_t _reconnect_seconds;
+    atomic_t _reconnect_max_seconds;
+    atomic_t _circuit_breaker_failures; // 为0表示不熔断
+    uint32_t _timer_tick_milliseconds; // 为0表示不使用时间轮
+    atomic_t _connect_timeout_milliseconds;
+    atomic_t _write_timeout_milliseconds;
+    atomic8_t _max_queue_bytes; // 为0表示不限制
+    atomic8_t _queue_bytes;     // 所有Sender队列中的字节总数
     CSendThreadPool* _thread_pool;
+    bool _use_doorbell; // 是否为门铃模式
+    sys::CCpuPlacement _cpu_placement; // 各线程绑定的CPU
     CManagedSenderTable* _managed_sender_table;
     CUnmanagedSenderTable* _unmanaged_sender_table;      
+    CPooledSenderTable* _pooled_sender_table;
+    CStatsObservable _stats_observable;
 };
 
 DISPATCHER_NAMESPACE_END
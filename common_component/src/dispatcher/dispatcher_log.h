@@ -39,16 +39,19 @@ typedef enum
 {
     DISPATCH_FILE,   /** 需要发送的是一个文件 */
     DISPATCH_BUFFER, /** 需要发送的是一个Buffer */
+    DISPATCH_SHARED, /** 需要发送的是一个共享的Buffer，data中存储的是指向shared_message_t的指针 */
     DISPATCH_STOP    /** 停止Sender消息 */
 }dispatch_type_t;
 
 /***
   * 分发消息头
   */
-typedef struct
+typedef struct message_t
 {
-    dispatch_type_t type; /** 分发消息类型 */
-    size_t length;        /** 文件大小或content的字节数 */
+    dispatch_type_t type;   /** 分发消息类型 */
+    size_t length;          /** 文件大小或content的字节数 */
+    struct message_t* next; /** 门铃模式下，在无锁队列中的下一个消息 */
+    uint64_t push_microseconds; /** 推送入队的时刻，用于统计延迟 */
     char data[0];
 }message_t;
 
@@ -56,5 +59,23 @@ extern message_t* create_message();
 extern message_t* create_stop_message();
 extern void destroy_message(message_t* message);
 
+/** 创建一个引用共享消息的消息头，并对共享消息的引用计数增一 */
+extern message_t* create_shared_reference(shared_message_t* shared_message);
+
+/** 判断是否为Buffer类消息，包括共享的Buffer */
+inline bool is_buffer_message(const message_t* message)
+{
+    return (DISPATCH_BUFFER == message->type) || (DISPATCH_SHARED == message->type);
+}
+
+/** 得到Buffer类消息的数据 */
+inline char* get_buffer_data(message_t* message)
+{
+    if (DISPATCH_SHARED == message->type)
+        return (*reinterpret_cast<shared_message_t**>(message->data))->data;
+
+    return reinterpret_cast<buffer_message_t*>(message->data)->data;
+}
+
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_LOG_H
@@ -137,6 +137,22 @@ ISender* CManagedSenderTable::get_sender(uint16_t key)
     return sender;
 }
 
+void CManagedSenderTable::get_sender_stats(std::vector<SenderStats>& stats_array)
+{
+    for (uint16_t key=0; key<_table_size; ++key)
+    {
+        // 先无锁判断，空的键值不加锁
+        if (NULL == _sender_table[key]) continue;
+
+        sys::LockHelper<sys::CLock> lock(_lock_array[key]);
+        if (_sender_table[key] != NULL)
+        {
+            stats_array.push_back(SenderStats());
+            _sender_table[key]->get_stats(stats_array.back());
+        }
+    }
+}
+
 void CManagedSenderTable::clear_sender()
 {
     // 下面这个循环最大可能为65535次，但只有更新发送表时才发生，所以对性能影响可以忽略    
@@ -30,6 +30,7 @@ class CManagedSenderTable: public IManagedSenderTable, public CSenderTable
 public:
     ~CManagedSenderTable();
     CManagedSenderTable(CDispatcherContext* context);               
+    virtual void get_sender_stats(std::vector<SenderStats>& stats_array);
 
 private: // CSenderTable
     virtual void close_sender(CSender* sender);
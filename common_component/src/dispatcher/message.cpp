@@ -16,13 +16,31 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <sys/atomic.h>
 #include "dispatcher/message.h"
 #include "dispatcher_log.h"
+#include "message_pool.h"
 DISPATCHER_NAMESPACE_BEGIN
 
+/***
+  * 共享消息头，位于shared_message_t之前
+  */
+typedef struct
+{
+    atomic_t refcount; /** 引用计数，创建者和每个推送成功的Sender各持有一个 */
+    size_t length;     /** 数据的字节数 */
+    char data[0];
+}shared_header_t;
+
+static shared_header_t* get_shared_header(shared_message_t* shared_message)
+{
+    char* header_buffer = reinterpret_cast<char*>(shared_message) - sizeof(shared_header_t);
+    return reinterpret_cast<shared_header_t*>(header_buffer);
+}
+
 message_t* create_message()
 {
-    char* message_buffer = new char[sizeof(message_t)];
+    char* message_buffer = CMessagePool::allocate(sizeof(message_t));
     return reinterpret_cast<message_t*>(message_buffer);
 }
 
@@ -36,9 +54,23 @@ message_t* create_stop_message()
     return message;
 }
 
+message_t* create_shared_reference(shared_message_t* shared_message)
+{
+    char* message_buffer = CMessagePool::allocate(sizeof(message_t)+sizeof(shared_message_t*));
+    message_t* message = reinterpret_cast<message_t*>(message_buffer);
+    shared_header_t* shared_header = get_shared_header(shared_message);
+
+    atomic_inc(&shared_header->refcount);
+    message->type = DISPATCH_SHARED;
+    message->length = shared_header->length;
+    *reinterpret_cast<shared_message_t**>(message->data) = shared_message;
+
+    return message;
+}
+
 file_message_t* create_file_message(size_t file_size)
 {
-    char* message_buffer = new char[sizeof(message_t)+sizeof(file_message_t)];
+    char* message_buffer = CMessagePool::allocate(sizeof(message_t)+sizeof(file_message_t));
     message_t* message = reinterpret_cast<message_t*>(message_buffer);
 
     message->type = DISPATCH_FILE;
@@ -49,7 +81,7 @@ file_message_t* create_file_message(size_t file_size)
 
 buffer_message_t* create_buffer_message(size_t data_length)
 {
-    char* message_buffer = new char[sizeof(message_t)+data_length];
+    char* message_buffer = CMessagePool::allocate(sizeof(message_t)+data_length);
     message_t* message = reinterpret_cast<message_t*>(message_buffer);
 
     message->type = DISPATCH_BUFFER;
@@ -58,22 +90,42 @@ buffer_message_t* create_buffer_message(size_t data_length)
     return reinterpret_cast<buffer_message_t*>(message->data);
 }
 
+shared_message_t* create_shared_message(size_t data_length)
+{
+    char* header_buffer = CMessagePool::allocate(sizeof(shared_header_t)+data_length);
+    shared_header_t* shared_header = reinterpret_cast<shared_header_t*>(header_buffer);
+
+    atomic_set(&shared_header->refcount, 1);
+    shared_header->length = data_length;
+
+    return reinterpret_cast<shared_message_t*>(shared_header->data);
+}
+
 void destroy_message(message_t* message)
 {
-    char* message_buffer = reinterpret_cast<char*>(message);
-    delete []message_buffer;
+    if (DISPATCH_SHARED == message->type)
+        destroy_shared_message(*reinterpret_cast<shared_message_t**>(message->data));
+
+    CMessagePool::free(reinterpret_cast<char*>(message));
 }
 
 void destroy_file_message(file_message_t* file_messsage)
 {
     char* message_buffer = reinterpret_cast<char*>(file_messsage)-sizeof(message_t);
-    delete []reinterpret_cast<char*>(message_buffer);
+    CMessagePool::free(message_buffer);
 }
 
 void destroy_buffer_message(buffer_message_t* buffer_messsage)
 {
     char* message_buffer = reinterpret_cast<char*>(buffer_messsage)-sizeof(message_t);
-    delete []reinterpret_cast<char*>(message_buffer);
+    CMessagePool::free(message_buffer);
+}
+
+void destroy_shared_message(shared_message_t* shared_message)
+{
+    shared_header_t* shared_header = get_shared_header(shared_message);
+    if (atomic_dec_and_test(&shared_header->refcount))
+        CMessagePool::free(reinterpret_cast<char*>(shared_header));
 }
 
 DISPATCHER_NAMESPACE_END
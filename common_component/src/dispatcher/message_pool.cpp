@@ -0,0 +1,188 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "message_pool.h"
+#include "dispatcher_log.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+#define BUCKET_MAGIC 0x4D534750 /* MSGP */
+#define HEAP_SIZE_CLASS 0xFFFFFFFF
+
+// 各级内存的大小，不包含头，最小一级容纳文件消息和共享消息
+const uint32_t CMessagePool::_class_size[SIZE_CLASS_NUMBER] = { 64, 256, 1024, 4096, 16384 };
+
+// 当前线程的消息池
+static __thread CMessagePool* tls_message_pool = NULL;
+// 用来在线程退出时释放消息池
+static pthread_key_t message_pool_key;
+static pthread_once_t message_pool_once = PTHREAD_ONCE_INIT;
+
+CMessagePool::CMessagePool()
+    :_remote_head(NULL)
+{
+    atomic_set(&_refcount, 1); // 创建线程持有
+}
+
+CMessagePool::~CMessagePool()
+{
+    for (int i=0; i<SIZE_CLASS_NUMBER; ++i)
+        _mem_pool[i].destroy();
+}
+
+char* CMessagePool::allocate(size_t size)
+{
+    if (0 == DISPATCHER_MESSAGE_POOL_BUCKETS)
+        return heap_allocate(size);
+
+    CMessagePool* message_pool = get_thread_message_pool();
+    return (NULL == message_pool)? heap_allocate(size): message_pool->borrow(size);
+}
+
+void CMessagePool::free(char* buffer)
+{
+    BucketHeader* header = reinterpret_cast<BucketHeader*>(buffer - BUCKET_HEADER_SIZE);
+    if (header->magic != BUCKET_MAGIC)
+    {
+        DISPATCHER_LOG_ERROR("Invalid message buffer %p freed.\n", buffer);
+        return;
+    }
+    if (NULL == header->pool)
+    {
+        delete [](char*)header;
+        return;
+    }
+
+    CMessagePool* pool = header->pool;
+    if (pool == tls_message_pool)
+    {
+        pool->reclaim(reinterpret_cast<char*>(header));
+    }
+    else
+    {
+        // 压入创建线程的无锁栈
+        BucketHeader* old_head;
+        do
+        {
+            old_head = pool->_remote_head;
+            *reinterpret_cast<BucketHeader**>(buffer) = old_head;
+        } while (!__sync_bool_compare_and_swap(&pool->_remote_head, old_head, header));
+    }
+
+    pool->dec_refcount();
+}
+
+char* CMessagePool::borrow(size_t size)
+{
+    for (uint32_t i=0; i<SIZE_CLASS_NUMBER; ++i)
+    {
+        if (size > _class_size[i]) continue;
+
+        if (_remote_head != NULL)
+            reclaim_remote();
+        if (0 == _mem_pool[i].get_pool_size())
+        {
+            // 不从CRawMemPool的堆上分配，池借完时由borrow自己从堆上分配并打上标记
+            _mem_pool[i].create(_class_size[i]+BUCKET_HEADER_SIZE, DISPATCHER_MESSAGE_POOL_BUCKETS, false, 0);
+        }
+
+        char* bucket = static_cast<char*>(_mem_pool[i].allocate());
+        if (NULL == bucket)
+            return heap_allocate(size);
+
+        BucketHeader* header = reinterpret_cast<BucketHeader*>(bucket);
+        header->pool = this;
+        header->size_class = i;
+        header->magic = BUCKET_MAGIC;
+
+        atomic_inc(&_refcount);
+        return bucket + BUCKET_HEADER_SIZE;
+    }
+
+    return heap_allocate(size);
+}
+
+void CMessagePool::reclaim(char* bucket)
+{
+    BucketHeader* header = reinterpret_cast<BucketHeader*>(bucket);
+
+    header->magic = 0; // 防止重复归还
+    _mem_pool[header->size_class].reclaim(bucket);
+}
+
+void CMessagePool::reclaim_remote()
+{
+    // 一次取走整个栈
+    BucketHeader* header = __sync_lock_test_and_set(&_remote_head, (BucketHeader*)NULL);
+    while (header != NULL)
+    {
+        char* buffer = reinterpret_cast<char*>(header) + BUCKET_HEADER_SIZE;
+        BucketHeader* next = *reinterpret_cast<BucketHeader**>(buffer);
+
+        reclaim(reinterpret_cast<char*>(header));
+        header = next;
+    }
+}
+
+void CMessagePool::dec_refcount()
+{
+    // 创建线程已退出，且所有借出的消息都已归还
+    if (atomic_dec_and_test(&_refcount))
+        delete this;
+}
+
+CMessagePool* CMessagePool::get_thread_message_pool()
+{
+    if (NULL == tls_message_pool)
+    {
+        (void)pthread_once(&message_pool_once, create_thread_key);
+
+        tls_message_pool = new CMessagePool;
+        if (pthread_setspecific(message_pool_key, tls_message_pool) != 0)
+        {
+            // 无法在线程退出时释放，则不使用消息池
+            delete tls_message_pool;
+            tls_message_pool = NULL;
+        }
+    }
+
+    return tls_message_pool;
+}
+
+char* CMessagePool::heap_allocate(size_t size)
+{
+    char* bucket = new char[size + BUCKET_HEADER_SIZE];
+    BucketHeader* header = reinterpret_cast<BucketHeader*>(bucket);
+
+    header->pool = NULL;
+    header->size_class = HEAP_SIZE_CLASS;
+    header->magic = BUCKET_MAGIC;
+    return bucket + BUCKET_HEADER_SIZE;
+}
+
+void CMessagePool::create_thread_key()
+{
+    (void)pthread_key_create(&message_pool_key, on_thread_exit);
+}
+
+void CMessagePool::on_thread_exit(void* message_pool)
+{
+    tls_message_pool = NULL;
+    static_cast<CMessagePool*>(message_pool)->dec_refcount();
+}
+
+DISPATCHER_NAMESPACE_END
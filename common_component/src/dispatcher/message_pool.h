@@ -0,0 +1,79 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_MESSAGE_POOL_H
+#define MOOON_DISPATCHER_MESSAGE_POOL_H
+#include <pthread.h>
+#include <sys/atomic.h>
+#include <sys/mem_pool.h>
+#include "dispatcher/config.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+/***
+  * 按大小分级的消息池，每个创建消息的线程一个，在第一次创建消息时创建
+  * 每级是一个CRawMemPool，借出和本线程归还都不加锁，
+  * 发送线程归还的消息放入一个无锁栈中，由本线程在下次借时回收
+  * 创建线程退出后，池在最后一个借出的消息归还时才被删除
+  */
+class CMessagePool
+{
+public:
+    /***
+      * 分配一块内存，总是成功
+      * 每块内存前有一个头，记录所属的池和级别
+      */
+    static char* allocate(size_t size);
+    static void free(char* buffer);
+
+private:
+    CMessagePool();
+    ~CMessagePool();
+
+    char* borrow(size_t size);
+    void reclaim(char* bucket);
+    void reclaim_remote();
+    void dec_refcount();
+
+    /** 得到当前线程的消息池，如果没有则创建 */
+    static CMessagePool* get_thread_message_pool();
+    static char* heap_allocate(size_t size);
+    static void create_thread_key();
+    static void on_thread_exit(void* message_pool);
+
+private:
+    struct BucketHeader
+    {
+        CMessagePool* pool;  // 所属的池，为NULL表示从堆上分配
+        uint32_t size_class; // 所属的级别
+        uint32_t magic;      // 用来检查是否为allocate分配的内存
+    };
+
+    enum
+    {
+        SIZE_CLASS_NUMBER = 5,
+        BUCKET_HEADER_SIZE = 16 // 保持数据部分16字节对齐
+    };
+
+    static const uint32_t _class_size[SIZE_CLASS_NUMBER];
+    sys::CRawMemPool _mem_pool[SIZE_CLASS_NUMBER];
+    atomic_t _refcount; // 创建线程持有一个，每个借出的消息持有一个
+    BucketHeader* volatile _remote_head; // 其它线程归还的消息，以数据部分的首个指针链接
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_MESSAGE_POOL_H
@@ -0,0 +1,424 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <sstream>
+#include <sys/clock.h>
+#include "rpc_channel.h"
+#include "dispatcher_log.h"
+#include "sender.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+//////////////////////////////////////////////////////////////////////////
+// CRpcInflightTable
+
+CRpcInflightTable::~CRpcInflightTable()
+{
+    delete []_slots;
+}
+
+CRpcInflightTable::CRpcInflightTable(uint32_t capacity)
+    :_next_sequence(0)
+    ,_inflight_number(0)
+    ,_new_deadline(NO_DEADLINE)
+{
+    uint32_t slot_number = 1;
+    while (slot_number < capacity)
+        slot_number <<= 1;
+
+    _mask = slot_number - 1;
+    _slots = new Slot[slot_number];
+    for (uint32_t i=0; i<slot_number; ++i)
+        _slots[i].completion = NULL;
+}
+
+uint32_t CRpcInflightTable::get_inflight_number() const
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    return _inflight_number;
+}
+
+bool CRpcInflightTable::add(IRpcCompletion* completion, uint64_t deadline, uint32_t& sequence)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    if (_inflight_number > _mask)
+        return false;
+
+    // 跳过仍被未完成请求占用的序列号，一个迟迟没有应答的请求不会挡住之后的请求
+    while (_slots[_next_sequence & _mask].completion != NULL)
+        ++_next_sequence;
+
+    Slot& slot = _slots[_next_sequence & _mask];
+    slot.completion = completion;
+    slot.sequence = _next_sequence;
+    slot.deadline = deadline;
+    slot.sent = false;
+    if (deadline < _new_deadline)
+        _new_deadline = deadline;
+
+    sequence = _next_sequence++;
+    ++_inflight_number;
+    return true;
+}
+
+IRpcCompletion* CRpcInflightTable::remove(uint32_t sequence)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    Slot& slot = _slots[sequence & _mask];
+    if ((NULL == slot.completion) || (slot.sequence != sequence))
+        return NULL;
+
+    IRpcCompletion* completion = slot.completion;
+    slot.completion = NULL;
+    --_inflight_number;
+    return completion;
+}
+
+uint64_t CRpcInflightTable::pop_expired(uint64_t current_milliseconds, std::vector<IRpcCompletion*>& expired)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    uint64_t next_deadline = NO_DEADLINE;
+    uint32_t remaining_number = _inflight_number; // 找齐所有在途请求后即可停止扫描
+
+    for (uint32_t i=0; (i<=_mask) && (remaining_number>0); ++i)
+    {
+        Slot& slot = _slots[i];
+        if (NULL == slot.completion)
+            continue;
+
+        --remaining_number;
+        if (slot.deadline <= current_milliseconds)
+        {
+            expired.push_back(slot.completion);
+            slot.completion = NULL;
+            --_inflight_number;
+        }
+        else if (slot.deadline < next_deadline)
+        {
+            next_deadline = slot.deadline;
+        }
+    }
+
+    return next_deadline;
+}
+
+void CRpcInflightTable::mark_sent(uint32_t sequence)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    Slot& slot = _slots[sequence & _mask];
+    if ((slot.completion != NULL) && (slot.sequence == sequence))
+        slot.sent = true;
+}
+
+void CRpcInflightTable::pop_sent(std::vector<IRpcCompletion*>& completions)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    uint32_t remaining_number = _inflight_number;
+
+    for (uint32_t i=0; (i<=_mask) && (remaining_number>0); ++i)
+    {
+        Slot& slot = _slots[i];
+        if (NULL == slot.completion)
+            continue;
+
+        --remaining_number;
+        if (slot.sent)
+        {
+            completions.push_back(slot.completion);
+            slot.completion = NULL;
+            --_inflight_number;
+        }
+    }
+}
+
+void CRpcInflightTable::pop_all(std::vector<IRpcCompletion*>& completions)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+
+    for (uint32_t i=0; (i<=_mask) && (_inflight_number>0); ++i)
+    {
+        if (_slots[i].completion != NULL)
+        {
+            completions.push_back(_slots[i].completion);
+            _slots[i].completion = NULL;
+            --_inflight_number;
+        }
+    }
+}
+
+uint64_t CRpcInflightTable::take_new_deadline()
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+    uint64_t new_deadline = _new_deadline;
+
+    _new_deadline = NO_DEADLINE;
+    return new_deadline;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CRpcReplyHandler
+
+CRpcReplyHandler::~CRpcReplyHandler()
+{
+    // Sender被销毁，在途的请求不会再有应答
+    fail_all();
+    _inflight_table->dec_refcount();
+}
+
+CRpcReplyHandler::CRpcReplyHandler(CRpcInflightTable* inflight_table)
+    :_sender(NULL)
+    ,_inflight_table(inflight_table)
+    ,_armed_deadline(CRpcInflightTable::NO_DEADLINE)
+    ,_recv_machine(this)
+{
+    _inflight_table->inc_refcount();
+}
+
+bool CRpcReplyHandler::on_header(const net::TCommonMessageHeader& header)
+{
+    uint32_t size = header.size;
+    if ((size < sizeof(nuint32_t)) || (size > DISPATCHER_RPC_MAX_REPLY_BYTES))
+    {
+        DISPATCHER_LOG_ERROR("%s received invalid reply size %u.\n", _sender->str().c_str(), size);
+        return false;
+    }
+
+    _reply_body.resize(size);
+    return true;
+}
+
+bool CRpcReplyHandler::on_message(const net::TCommonMessageHeader& header, size_t finished_size, const char* buffer, size_t buffer_size)
+{
+    memcpy(&_reply_body[finished_size], buffer, buffer_size);
+    if (finished_size+buffer_size < _reply_body.size())
+        return true;
+
+    // 一个应答收完整了
+    uint32_t sequence = reinterpret_cast<const nuint32_t*>(&_reply_body[0])->to_int();
+    IRpcCompletion* completion = _inflight_table->remove(sequence);
+    if (NULL == completion)
+    {
+        // 已超时或连接断开过的请求，其应答迟到了
+        DISPATCHER_LOG_DEBUG("%s received reply of unknown sequence %u.\n", _sender->str().c_str(), sequence);
+        return true;
+    }
+
+    completion->on_reply(header.command, &_reply_body[0]+sizeof(nuint32_t), _reply_body.size()-sizeof(nuint32_t));
+    return true;
+}
+
+void CRpcReplyHandler::attach(ISender* sender)
+{
+    _sender = sender;
+}
+
+char* CRpcReplyHandler::get_buffer()
+{
+    return _buffer;
+}
+
+size_t CRpcReplyHandler::get_buffer_length() const
+{
+    return sizeof(_buffer);
+}
+
+void CRpcReplyHandler::before_send()
+{
+    // 记下开始发送的请求，连接断开时只有它们需要失败
+    message_t* message = static_cast<CSender*>(_sender)->get_sending_message();
+    size_t header_size = sizeof(net::TCommonMessageHeader) + sizeof(nuint32_t);
+    if ((message != NULL) && is_buffer_message(message) && (message->length >= header_size))
+    {
+        const char* sequence_field = get_buffer_data(message) + sizeof(net::TCommonMessageHeader);
+        _inflight_table->mark_sent(reinterpret_cast<const nuint32_t*>(sequence_field)->to_int());
+    }
+}
+
+void CRpcReplyHandler::sender_closed()
+{
+    // 已发出请求的应答不会在新连接上到达，让它们失败；
+    // 仍在队列中的请求重连后照常发出，保持在途，否则调用者重试会使对端执行两次
+    _recv_machine.reset();
+    fail_sent();
+    restart_reply_timer();
+}
+
+void CRpcReplyHandler::sender_connect_failure()
+{
+    // 队列中的请求会在连上后发出，由各自的期限或Sender销毁来结束
+    fail_sent();
+    restart_reply_timer();
+}
+
+util::handle_result_t CRpcReplyHandler::handle_reply(size_t data_size)
+{
+    util::handle_result_t retval = _recv_machine.work(_buffer, data_size);
+    return (util::handle_error == retval)? util::handle_error: util::handle_continue;
+}
+
+void CRpcReplyHandler::reply_timer_expired()
+{
+    restart_reply_timer();
+}
+
+void CRpcReplyHandler::reply_deadline_changed()
+{
+    // 只在新请求的期限更早时才重新计时
+    uint64_t new_deadline = _inflight_table->take_new_deadline();
+    if (new_deadline < _armed_deadline)
+        arm_reply_timer(new_deadline, sys::CClock::get_monotonic_milliseconds());
+}
+
+void CRpcReplyHandler::restart_reply_timer()
+{
+    // 不论定时器是否还在计时，都按表中最早的期限重新计时，到期的请求以超时失败
+    std::vector<IRpcCompletion*> expired;
+    uint64_t current_milliseconds = sys::CClock::get_monotonic_milliseconds();
+
+    _armed_deadline = CRpcInflightTable::NO_DEADLINE;
+    (void)_inflight_table->take_new_deadline(); // 下面的扫描已包含新登记的请求
+    uint64_t next_deadline = _inflight_table->pop_expired(current_milliseconds, expired);
+    if (next_deadline != CRpcInflightTable::NO_DEADLINE)
+        arm_reply_timer(next_deadline, current_milliseconds);
+
+    for (std::vector<IRpcCompletion*>::iterator iter=expired.begin(); iter!=expired.end(); ++iter)
+        (*iter)->on_failure(rpc_timeout);
+}
+
+void CRpcReplyHandler::arm_reply_timer(uint64_t deadline, uint64_t current_milliseconds)
+{
+    uint64_t milliseconds = (deadline > current_milliseconds)? deadline-current_milliseconds: 1;
+    if (milliseconds > 0xFFFFFFFF)
+        milliseconds = 0xFFFFFFFF;
+
+    _armed_deadline = deadline;
+    static_cast<CSender*>(_sender)->set_reply_timer(static_cast<uint32_t>(milliseconds));
+}
+
+void CRpcReplyHandler::fail_sent()
+{
+    std::vector<IRpcCompletion*> completions;
+    _inflight_table->pop_sent(completions);
+
+    for (std::vector<IRpcCompletion*>::iterator iter=completions.begin(); iter!=completions.end(); ++iter)
+        (*iter)->on_failure(rpc_closed);
+}
+
+void CRpcReplyHandler::fail_all()
+{
+    std::vector<IRpcCompletion*> completions;
+    _inflight_table->pop_all(completions);
+
+    for (std::vector<IRpcCompletion*>::iterator iter=completions.begin(); iter!=completions.end(); ++iter)
+        (*iter)->on_failure(rpc_closed);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CRpcChannel
+
+CRpcChannel::~CRpcChannel()
+{
+    if (_sender != NULL)
+        _sender_table->close_sender(_sender);
+
+    _inflight_table->dec_refcount();
+}
+
+CRpcChannel::CRpcChannel(IUnmanagedSenderTable* sender_table, uint32_t max_inflight)
+    :_sender_table(sender_table)
+    ,_sender(NULL)
+{
+    _inflight_table = new CRpcInflightTable(max_inflight);
+    _inflight_table->inc_refcount();
+}
+
+bool CRpcChannel::open(const net::ip_node_t& ip_node, uint32_t queue_size)
+{
+    CRpcReplyHandler* reply_handler = new CRpcReplyHandler(_inflight_table);
+    SenderInfo sender_info;
+
+    sender_info.key = 0;
+    sender_info.ip_node = ip_node;
+    sender_info.queue_size = queue_size;
+    sender_info.resend_times = 0;     // 请求的应答与连接绑定，断开后不重发
+    sender_info.reconnect_times = -1; // 始终自动重连接
+    sender_info.reply_handler = reply_handler;
+
+    _sender = _sender_table->open_sender(sender_info);
+    if (NULL == _sender)
+    {
+        delete reply_handler;
+        return false;
+    }
+
+    return true;
+}
+
+std::string CRpcChannel::str() const
+{
+    std::stringstream str;
+    str << "rpc_channel://" << _sender->str() << "-" << _inflight_table->get_inflight_number();
+    return str.str();
+}
+
+uint32_t CRpcChannel::get_inflight_number() const
+{
+    return _inflight_table->get_inflight_number();
+}
+
+bool CRpcChannel::call(uint32_t command, const char* body, size_t body_size
+                     , IRpcCompletion* completion, uint32_t timeout_milliseconds)
+{
+    uint32_t sequence;
+    uint64_t deadline = (0 == timeout_milliseconds)
+                      ? CRpcInflightTable::NO_DEADLINE
+                      : sys::CClock::get_monotonic_milliseconds() + timeout_milliseconds;
+    if (!_inflight_table->add(completion, deadline, sequence))
+    {
+        DISPATCHER_LOG_WARN("%s has too many requests in flight.\n", _sender->str().c_str());
+        return false;
+    }
+
+    // 帧：通用消息头 + 序列号 + 消息体
+    size_t header_size = sizeof(net::TCommonMessageHeader) + sizeof(nuint32_t);
+    buffer_message_t* message = create_buffer_message(header_size + body_size);
+    net::TCommonMessageHeader* header = reinterpret_cast<net::TCommonMessageHeader*>(message->data);
+    nuint32_t* sequence_field = reinterpret_cast<nuint32_t*>(message->data + sizeof(net::TCommonMessageHeader));
+
+    header->size = static_cast<uint32_t>(sizeof(nuint32_t) + body_size);
+    header->command = command;
+    *sequence_field = sequence;
+    if (body_size > 0)
+        memcpy(message->data + header_size, body, body_size);
+
+    if (_sender->push_message(message, 0))
+    {
+        // 由发送线程启动应答定时器，对端不可用时队列中的请求也会到期
+        if (deadline != CRpcInflightTable::NO_DEADLINE)
+            static_cast<CSender*>(_sender)->post_reply_deadline();
+        return true;
+    }
+
+    destroy_buffer_message(message);
+    if (_inflight_table->remove(sequence) != NULL)
+        return false;
+
+    // 在登记和撤销之间，请求已因连接断开或到期被完成，completion已被调用
+    return true;
+}
+
+DISPATCHER_NAMESPACE_END
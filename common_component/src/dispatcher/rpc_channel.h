@@ -0,0 +1,154 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_RPC_CHANNEL_H
+#define MOOON_DISPATCHER_RPC_CHANNEL_H
+#include <vector>
+#include <sys/lock.h>
+#include <sys/ref_countable.h>
+#include <net/recv_machine.h>
+#include "dispatcher/dispatcher.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+/***
+  * 在途请求表，以序列号对容量取模为下标的平坦数组，
+  * 由CRpcChannel和CRpcReplyHandler共同持有，因为Sender可能晚于通道被销毁
+  */
+class CRpcInflightTable: public sys::CRefCountable
+{
+public:
+    static const uint64_t NO_DEADLINE = 0xFFFFFFFFFFFFFFFFULL; // 没有期限
+
+    ~CRpcInflightTable();
+    CRpcInflightTable(uint32_t capacity);
+
+    uint32_t get_inflight_number() const;
+
+    /***
+      * 登记请求
+      * @sequence: 输出参数，分配给请求的序列号，会跳过仍被占用的位置，所以可能不连续
+      * @return: 如果所有位置都被占用，则返回false
+      */
+    bool add(IRpcCompletion* completion, uint64_t deadline, uint32_t& sequence);
+
+    /***
+      * 取出请求
+      * @return: 如果请求已完成或已被取出，则返回NULL
+      */
+    IRpcCompletion* remove(uint32_t sequence);
+
+    /***
+      * 取出所有已到期的请求
+      * @return: 剩余请求中最早的期限，如果没有则返回NO_DEADLINE
+      */
+    uint64_t pop_expired(uint64_t current_milliseconds, std::vector<IRpcCompletion*>& expired);
+
+    /** 标记请求已开始发送，之后连接断开时它不会再被发出 */
+    void mark_sent(uint32_t sequence);
+
+    /** 取出所有已开始发送的请求，仍在队列中的请求保留 */
+    void pop_sent(std::vector<IRpcCompletion*>& completions);
+
+    /** 取出所有的请求 */
+    void pop_all(std::vector<IRpcCompletion*>& completions);
+
+    /** 取出上次取出后新登记请求中最早的期限，如果没有则返回NO_DEADLINE */
+    uint64_t take_new_deadline();
+
+private:
+    struct Slot
+    {
+        IRpcCompletion* completion; // 为NULL表示空闲
+        uint32_t sequence;
+        uint64_t deadline;
+        bool sent; // 是否已开始发送
+    };
+
+    mutable sys::CLock _lock;
+    uint32_t _mask;
+    uint32_t _next_sequence;
+    uint32_t _inflight_number;
+    uint64_t _new_deadline;
+    Slot* _slots;
+};
+
+/***
+  * RPC通道的应答处理器，解析应答帧，按序列号交给对应请求的完成回调，
+  * 并用Sender的应答定时器实现每个请求的期限，
+  * 请求登记时即开始计时，所以对端不可用时队列中的请求也会到期
+  * 除构造和析构外，都在发送线程中调用
+  */
+class CRpcReplyHandler: public IReplyHandler
+{
+public:
+    ~CRpcReplyHandler();
+    CRpcReplyHandler(CRpcInflightTable* inflight_table);
+
+    /** 由CRecvMachine回调 */
+    bool on_header(const net::TCommonMessageHeader& header);
+    bool on_message(const net::TCommonMessageHeader& header, size_t finished_size, const char* buffer, size_t buffer_size);
+
+private:
+    virtual void attach(ISender* sender);
+    virtual char* get_buffer();
+    virtual size_t get_buffer_length() const;
+    virtual void before_send();
+    virtual void sender_closed();
+    virtual void sender_connect_failure();
+    virtual util::handle_result_t handle_reply(size_t data_size);
+    virtual void reply_timer_expired();
+    virtual void reply_deadline_changed();
+
+private:
+    void restart_reply_timer();
+    void arm_reply_timer(uint64_t deadline, uint64_t current_milliseconds);
+    void fail_sent();
+    void fail_all();
+
+private:
+    ISender* _sender;
+    CRpcInflightTable* _inflight_table;
+    uint64_t _armed_deadline; // 应答定时器到期的时刻，未计时时为NO_DEADLINE
+    std::vector<char> _reply_body; // 序列号和应答消息体
+    net::CRecvMachine<net::TCommonMessageHeader, CRpcReplyHandler> _recv_machine;
+    char _buffer[4096];
+};
+
+class CRpcChannel: public IRpcChannel
+{
+public:
+    ~CRpcChannel();
+    CRpcChannel(IUnmanagedSenderTable* sender_table, uint32_t max_inflight);
+
+    /** 打开到ip_node的Sender，失败返回false */
+    bool open(const net::ip_node_t& ip_node, uint32_t queue_size);
+
+private: // IRpcChannel
+    virtual std::string str() const;
+    virtual uint32_t get_inflight_number() const;
+    virtual bool call(uint32_t command, const char* body, size_t body_size
+                    , IRpcCompletion* completion, uint32_t timeout_milliseconds);
+
+private:
+    IUnmanagedSenderTable* _sender_table;
+    ISender* _sender;
+    CRpcInflightTable* _inflight_table;
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_RPC_CHANNEL_H
@@ -16,13 +16,15 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <sys/eventfd.h>
+#include <sys/clock.h>
 #include "sender.h"
 #include "send_queue.h"
 #include "send_thread.h"
 DISPATCHER_NAMESPACE_BEGIN
 
 CSendQueue::CSendQueue(uint32_t queue_max, CSender* sender)
-    :net::CEpollableQueue<util::CArrayQueue<message_t*> >(queue_max)
+    :CSendQueueBase(queue_max)
     ,_sender(sender)
 {
 }
@@ -37,4 +39,192 @@ net::epoll_event_t CSendQueue::handle_epoll_event(void* input_ptr, uint32_t even
     return net::epoll_remove;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// CLockFreeSendQueue
+
+CLockFreeSendQueue::CLockFreeSendQueue(uint32_t queue_max)
+    :_queue_max(queue_max)
+    ,_stack(NULL)
+    ,_first(NULL)
+{
+    atomic_set(&_size, 0);
+}
+
+bool CLockFreeSendQueue::push_back(message_t* message, uint32_t milliseconds, bool* was_empty)
+{
+    // 先占位，队列满时等待pop_front唤醒，直到超时
+    uint64_t deadline = 0;
+    while (!reserve())
+    {
+        if (0 == milliseconds) return false;
+
+        uint64_t now = sys::CClock::get_monotonic_milliseconds();
+        if (0 == deadline) deadline = now + milliseconds;
+        if (now >= deadline) return false;
+
+        // 登记后再检查一次，之后的pop_front一定能唤醒本线程
+        int sequence = _not_full_event.prepare_wait();
+        if (reserve())
+        {
+            _not_full_event.cancel_wait();
+            break;
+        }
+
+        (void)_not_full_event.wait(sequence, static_cast<uint32_t>(deadline - now));
+    }
+
+    message_t* head;
+    do
+    {
+        head = _stack;
+        message->next = head;
+    } while (!__sync_bool_compare_and_swap(&_stack, head, message));
+
+    // 必须以栈由空变为非空来判断，而不能用_size：
+    // 消费者只在栈为空时才会等门铃，之后压入的第一个消息一定看到空栈
+    *was_empty = (NULL == head);
+    return true;
+}
+
+bool CLockFreeSendQueue::pop_front(message_t*& message)
+{
+    if (NULL == _first)
+    {
+        if (NULL == _stack) return false;
+
+        // 一次取走整个栈，并反转成先进先出的顺序
+        message_t* head = __sync_lock_test_and_set(&_stack, (message_t*)NULL);
+        while (head != NULL)
+        {
+            message_t* next = head->next;
+            head->next = _first;
+            _first = head;
+            head = next;
+        }
+    }
+
+    message = _first;
+    _first = _first->next;
+    atomic_dec(&_size);
+
+    // 如果有等待空位的生产者，则唤醒
+    _not_full_event.signal();
+    return true;
+}
+
+bool CLockFreeSendQueue::reserve()
+{
+    if (atomic_add_return(1, &_size) <= (int)_queue_max) return true;
+
+    atomic_dec(&_size);
+    return false;
+}
+
+void CLockFreeSendQueue::pop_front(message_t** message_array, uint32_t& array_size)
+{
+    uint32_t i = 0;
+    for (; i<array_size; ++i)
+    {
+        if (!pop_front(message_array[i])) break;
+    }
+
+    array_size = i;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CSendDoorbell
+
+CSendDoorbell::CSendDoorbell()
+    :_ready_stack(NULL)
+{
+}
+
+CSendDoorbell::~CSendDoorbell()
+{
+    close();
+}
+
+void CSendDoorbell::create()
+{
+    int fd = eventfd(0, EFD_NONBLOCK);
+    if (-1 == fd)
+        throw sys::CSyscallException(errno, __FILE__, __LINE__, "eventfd");
+
+    set_fd(fd);
+}
+
+void CSendDoorbell::close()
+{
+    if (get_fd() != -1)
+    {
+        net::close_fd(get_fd());
+        set_fd(-1);
+    }
+
+    // 释放还未处理的Sender
+    CSender* sender = __sync_lock_test_and_set(&_ready_stack, (CSender*)NULL);
+    while (sender != NULL)
+    {
+        CSender* next = sender->get_doorbell_next();
+        sender->dec_refcount();
+        sender = next;
+    }
+}
+
+void CSendDoorbell::ring(CSender* sender)
+{
+    // 在就绪栈中时不再重复放入
+    if (!sender->enter_doorbell()) return;
+
+    CSender* head;
+    sender->inc_refcount();
+    do
+    {
+        head = _ready_stack;
+        sender->set_doorbell_next(head);
+    } while (!__sync_bool_compare_and_swap(&_ready_stack, head, sender));
+
+    // 就绪栈由空变为非空时才需要唤醒线程
+    if (NULL == head)
+    {
+        uint64_t value = 1;
+        while (-1 == write(get_fd(), &value, sizeof(value)))
+        {
+            if (EINTR == errno) continue;
+            if (EAGAIN == errno) break; // 计数器已满，线程必然会被唤醒
+            throw sys::CSyscallException(errno, __FILE__, __LINE__, "write");
+        }
+    }
+}
+
+net::epoll_event_t CSendDoorbell::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    uint64_t value;
+    while (-1 == read(get_fd(), &value, sizeof(value)))
+    {
+        if (EINTR == errno) continue;
+        if (EAGAIN == errno) break;
+        throw sys::CSyscallException(errno, __FILE__, __LINE__, "read");
+    }
+
+    // 通知各就绪的Sender去发送消息，处理顺序对结果无影响，所以不用反转
+    CSendThread* thread = static_cast<CSendThread*>(input_ptr);
+    CSender* sender = __sync_lock_test_and_set(&_ready_stack, (CSender*)NULL);
+    while (sender != NULL)
+    {
+        CSender* next = sender->get_doorbell_next();
+        sender->leave_doorbell();
+        if (sender->is_waiting_doorbell())
+        {
+            sender->set_waiting_doorbell(false);
+            thread->get_epoller().set_events(sender, EPOLLIN|EPOLLOUT);
+        }
+
+        sender->dec_refcount();
+        sender = next;
+    }
+
+    return net::epoll_none;
+}
+
 DISPATCHER_NAMESPACE_END
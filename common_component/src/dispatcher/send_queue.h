@@ -18,14 +18,23 @@
  */
 #ifndef MOOON_DISPATCHER_SEND_QUEUE_H
 #define MOOON_DISPATCHER_SEND_QUEUE_H
+#include <sys/atomic.h>
+#include <sys/futex_event.h>
 #include <util/array_queue.h>
 #include <net/epollable_queue.h>
+#include <net/mpmc_epollable_queue.h>
 #include "dispatcher_log.h"
 #include "dispatcher/dispatcher.h"
 DISPATCHER_NAMESPACE_BEGIN
 
+#if ENABLE_MPMC_QUEUE==1
+typedef net::CMpmcEpollableQueue<message_t*> CSendQueueBase;
+#else
+typedef net::CEpollableQueue<util::CArrayQueue<message_t*> > CSendQueueBase;
+#endif // ENABLE_MPMC_QUEUE
+
 class CSender;
-class CSendQueue: public net::CEpollableQueue<util::CArrayQueue<message_t*> >
+class CSendQueue: public CSendQueueBase
 {
 public:
     CSendQueue(uint32_t queue_max, CSender* sender);
@@ -37,5 +46,72 @@ private:
     CSender* _sender;
 };
 
+/***
+  * 门铃模式下Sender的消息队列，为无锁的多生产者单消费者队列
+  * 生产者压入一个无锁栈，消费者一次取走整个栈并反转成先进先出的私有链表，
+  * 因为只有一个消费者且总是整体取走，所以没有ABA问题
+  */
+class CLockFreeSendQueue
+{
+public:
+    CLockFreeSendQueue(uint32_t queue_max);
+
+    /***
+      * 压入消息，可多个线程同时调用
+      * @milliseconds: 队列满时等待的毫秒数，为0表示不等待
+      * @was_empty: 输出参数，压入前栈是否为空，为true时需要敲门铃
+      * @return: 队列满且等待超时返回false，否则返回true
+      */
+    bool push_back(message_t* message, uint32_t milliseconds, bool* was_empty);
+
+    /** 弹出队首消息，只能由Sender所在的线程调用 */
+    bool pop_front(message_t*& message);
+    
+    /** 从队首依次弹出多个消息，array_size为输入和输出参数 */
+    void pop_front(message_t** message_array, uint32_t& array_size);
+
+private:
+    /** 占一个位置，队列满时返回false */
+    bool reserve();
+
+private:
+    uint32_t _queue_max;
+    atomic_t _size;             // 队列中的消息数，包括栈中的和私有链表中的
+    message_t* volatile _stack; // 生产者压入的栈，后进的在前
+    message_t* _first;          // 消费者私有的先进先出链表
+    sys::CFutexEvent _not_full_event; // 等待队列非满
+};
+
+/***
+  * 门铃，门铃模式下每个发送线程一个，代替每个Sender一个管道
+  * Sender的队列由空变为非空时，将Sender放入门铃的就绪栈，
+  * 就绪栈由空变为非空时才写一次eventfd，线程被唤醒后一次处理所有就绪的Sender
+  */
+class CSendDoorbell: public net::CEpollable
+{
+public:
+    CSendDoorbell();
+    ~CSendDoorbell();
+
+    /***
+      * 创建门铃
+      * @exception 如果出错则抛出CSyscallException异常
+      */
+    void create();
+    virtual void close();
+
+    /***
+      * 为Sender敲门铃，可多个线程同时调用，就绪栈持有Sender的一个引用计数
+      * @exception 如果出错则抛出CSyscallException异常
+      */
+    void ring(CSender* sender);
+
+private:
+    virtual net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr);
+
+private:
+    CSender* volatile _ready_stack; // 就绪的Sender，后进的在前
+};
+
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_SEND_QUEUE_H
@@ -19,17 +19,30 @@
 #include <sstream>
 #include <net/util.h>
 #include <sys/util.h>
+#include <sys/clock.h>
 #include "send_thread.h"
 #include "dispatcher_context.h"
 #include "unmanaged_sender_table.h"
 DISPATCHER_NAMESPACE_BEGIN
 
+/** 秒数转为毫秒数，用64位计算，超过32位时取最大值，以免大的超时秒数回绕成很小的值 */
+static uint32_t seconds_to_milliseconds(uint32_t seconds)
+{
+    uint64_t milliseconds = static_cast<uint64_t>(seconds) * 1000;
+    return (milliseconds > 0xFFFFFFFF)? 0xFFFFFFFF: static_cast<uint32_t>(milliseconds);
+}
+
 CSendThread::CSendThread()
     :_current_time(0)    
-    ,_last_connect_time(0)
+    ,_current_milliseconds(0)
+    ,_checked_shutdown_number(0)
     ,_context(NULL)
+    ,_use_timing_wheel(false)
+    ,_use_doorbell(false)
 {
+    atomic_set(&_shutdown_number, 0);
     init_epoll_event_proc();
+    _random_seed = static_cast<unsigned int>(reinterpret_cast<uintptr_t>(this) ^ sys::CClock::get_monotonic_milliseconds());
 }
 
 time_t CSendThread::get_current_time() const
@@ -47,18 +60,31 @@ void CSendThread::add_sender(CSender* sender)
 
 void CSendThread::run()
 {
-    // 更新当前时间
-    _current_time = time(NULL);
+    uint32_t epoll_timeout_milliseconds = 2000;
+
+    // 更新当前时间，使用单调时钟，系统时间被调整也不会导致连接批量超时
+    _current_time = sys::CClock::get_monotonic_seconds();
+    _current_milliseconds = sys::CClock::get_monotonic_milliseconds();
     
     // 调用check_reconnect_queue和check_unconnected_queue的顺序不要颠倒
     check_reconnect_queue();
     check_unconnected_queue();
-    if (_timeout_manager.get_timeout_seconds() > 0)
+    check_reply_deadline_queue();
+    epoll_timeout_milliseconds = get_reconnect_wait_milliseconds(epoll_timeout_milliseconds);
+    if (_use_timing_wheel)
+    {
+        _timing_wheel.check_timeout(_current_milliseconds);
+        epoll_timeout_milliseconds = _timing_wheel.get_wait_milliseconds(_current_milliseconds, epoll_timeout_milliseconds);
+    }
+    else if (_timeout_manager.get_timeout_seconds() > 0)
     {
         _timeout_manager.check_timeout(_current_time);
     }
 
-    int events_count = _epoller.timed_wait(2000);
+    int events_count = _epoller.timed_wait(epoll_timeout_milliseconds);
+
+    // 事件处理中启动的定时器和重连接退避以此为起点
+    _current_milliseconds = sys::CClock::get_monotonic_milliseconds();
     if (0 == events_count)
     {
         // 超时处理        
@@ -144,6 +170,10 @@ bool CSendThread::before_run()
     sys::CUtil::set_process_name(thread_name.str().c_str());
 #endif // ENABLE_SET_DISPATCHER_THREAD_NAME
 
+    // 绑定CPU后，由本线程重新分配epoll事件数组，使它落在本线程所在的NUMA节点上
+    if (_context->get_cpu_placement().is_enabled())
+        _epoller.relocate_events();
+
     return true;
 }
 
@@ -152,15 +182,42 @@ void CSendThread::after_run()
     clear_unconnected_queue();
     clear_reconnect_queue();    
     clear_timeout_queue();
+    clear_reply_deadline_queue();
+    if (_use_doorbell)
+    {
+        _epoller.del_events(&_doorbell);
+        _doorbell.close();
+    }
 
     DISPATCHER_LOG_INFO("Sending thread %u has exited.\n", get_thread_id());
 }
 
 bool CSendThread::before_start()
 {
+    // 绑定CPU，线程一启动就运行在指定的CPU上
+    cpu_set_t cpu_set;
+    if (_context->get_cpu_placement().get_cpu_set(get_index(), &cpu_set))
+    {
+        set_cpu_set(cpu_set);
+        DISPATCHER_LOG_INFO("Sending thread[%u] will run on cpu %d.\n", get_index(), _context->get_cpu_placement().get_cpu(get_index()));
+    }
+
     _timeout_manager.set_timeout_seconds(_context->get_timeout_seconds());
     _timeout_manager.set_timeout_handler(this);    
+    _use_timing_wheel = _context->get_timer_tick_milliseconds() > 0;
+    if (_use_timing_wheel)
+    {
+        _timing_wheel.set_tick_milliseconds(_context->get_timer_tick_milliseconds());
+        _timing_wheel.set_timer_handler(this);
+        _current_milliseconds = sys::CClock::get_monotonic_milliseconds();
+    }
     _epoller.create(10000);
+    _use_doorbell = _context->use_doorbell();
+    if (_use_doorbell)
+    {
+        _doorbell.create();
+        _epoller.set_events(&_doorbell, EPOLLIN);
+    }
     
     return true;
 }
@@ -188,8 +245,106 @@ void CSendThread::on_timeout_event(CSender* timeoutable)
     }
 }
 
+void CSendThread::on_timer_expired(CSender* sender, uint8_t kind)
+{
+    // 应答定时器只通知应答处理器，不影响连接
+    if (timer_reply == kind)
+    {
+        sender->get_sender_info().reply_handler->reply_timer_expired();
+    }
+    // 未设置空闲超时时，空闲定时器只用来记录Sender，以便退出时清理
+    else if ((timer_idle == kind) && (0 == _context->get_timeout_seconds()))
+    {
+        update_sender_timer(sender);
+    }
+    else if (sender->on_timeout())
+    {
+        sender_reconnect(sender);
+    }
+    else
+    {
+        set_sender_deadline(sender, kind, true);
+    }
+}
+
+void CSendThread::update_sender_timer(CSender* sender)
+{
+    if (!_use_timing_wheel)
+    {
+        _timeout_manager.update(sender, _current_time);
+    }
+    else
+    {
+        // 超时秒数为0时，按时间轮的最长定时处理
+        uint32_t timeout_seconds = _context->get_timeout_seconds();
+        uint32_t timeout_milliseconds = (0 == timeout_seconds)? 0xFFFFFFFF: seconds_to_milliseconds(timeout_seconds);
+        _timing_wheel.arm(sender->get_timer_node(timer_idle), timeout_milliseconds, _current_milliseconds);
+    }
+}
+
+void CSendThread::remove_sender_timer(CSender* sender, bool keep_reply_timer)
+{
+    if (!_use_timing_wheel)
+    {
+        _timeout_manager.remove(sender);
+    }
+    else
+    {
+        for (uint8_t kind=0; kind<timer_kind_number; ++kind)
+        {
+            if (keep_reply_timer && (timer_reply == kind)) continue;
+            _timing_wheel.cancel(sender->get_timer_node(kind));
+        }
+    }
+}
+
+void CSendThread::set_sender_deadline(CSender* sender, uint8_t kind, bool armed)
+{
+    if (!_use_timing_wheel) return;
+
+    util::CTimerNode<CSender>* timer_node = sender->get_timer_node(kind);
+    if (!armed)
+    {
+        _timing_wheel.cancel(timer_node);
+    }
+    else if (!timer_node->is_armed())
+    {
+        uint32_t timeout_milliseconds = get_timer_milliseconds(kind);
+        if (timeout_milliseconds > 0)
+            _timing_wheel.arm(timer_node, timeout_milliseconds, _current_milliseconds);
+    }
+}
+
+void CSendThread::set_sender_timer(CSender* sender, uint8_t kind, uint32_t milliseconds)
+{
+    if (!_use_timing_wheel) return;
+
+    util::CTimerNode<CSender>* timer_node = sender->get_timer_node(kind);
+    if (0 == milliseconds)
+        _timing_wheel.cancel(timer_node);
+    else
+        _timing_wheel.arm(timer_node, milliseconds, _current_milliseconds);
+}
+
+uint32_t CSendThread::get_timer_milliseconds(uint8_t kind) const
+{
+    if (timer_connect == kind) return _context->get_connect_timeout_milliseconds();
+    if (timer_write == kind) return _context->get_write_timeout_milliseconds();
+    return seconds_to_milliseconds(_context->get_timeout_seconds());
+}
+
 void CSendThread::clear_timeout_queue()
 {
+    while (_use_timing_wheel)
+    {
+        util::CTimerNode<CSender>* timer_node = _timing_wheel.pop_timer();
+        if (NULL == timer_node)
+        {
+            break;
+        }
+
+        remove_sender(timer_node->get_owner());
+    }
     for (;;)
     {
         CSender* sender = _timeout_manager.pop_front();
@@ -206,8 +361,8 @@ void CSendThread::clear_reconnect_queue()
 {
     while (!_reconnect_queue.empty())
     {
-        CSender* sender = _reconnect_queue.front();
-        _reconnect_queue.pop_front();
+        CSender* sender = _reconnect_queue.top().sender;
+        _reconnect_queue.pop();
 
         remove_sender(sender);
     }
@@ -224,17 +379,38 @@ void CSendThread::clear_unconnected_queue()
     }
 }
 
+void CSendThread::expire_shutdown_senders()
+{
+    // 已关闭的Sender改为立即到期，以便下面马上移除，不用等到退避结束
+    std::vector<ReconnectItem> items;
+    items.reserve(_reconnect_queue.size());
+    for (; !_reconnect_queue.empty(); _reconnect_queue.pop())
+    {
+        ReconnectItem item = _reconnect_queue.top();
+        if (item.sender->to_shutdown())
+            item.reconnect_milliseconds = 0;
+        items.push_back(item);
+    }
+
+    _reconnect_queue = CReconnectHeap(std::greater<ReconnectItem>(), items);
+}
+
 void CSendThread::check_reconnect_queue()
 {
-    // 限制重连接的频率
-    if (_current_time - _last_connect_time < _context->get_reconnect_seconds()) return;
-    _last_connect_time = _current_time;
-    
-    CSenderQueue::size_type reconnect_number =  _reconnect_queue.size();
-    for (CSenderQueue::size_type i=0; i<reconnect_number; ++i)
+    int shutdown_number = atomic_read(&_shutdown_number);
+    if (shutdown_number != _checked_shutdown_number)
+    {
+        _checked_shutdown_number = shutdown_number;
+        expire_shutdown_senders();
+    }
+
+    // 只处理已到期的，每个Sender有自己的退避间隔，不会同时重连接
+    while (!_reconnect_queue.empty())
     {
-        CSender* sender = _reconnect_queue.front();
-        _reconnect_queue.pop_front();               
+        if (_reconnect_queue.top().reconnect_milliseconds > _current_milliseconds) break;
+
+        CSender* sender = _reconnect_queue.top().sender;
+        _reconnect_queue.pop();
 
         // 如果最大重连接次数值为-1，说明总是重连接
         int max_reconnect_times = sender->get_sender_info().reconnect_times;
@@ -250,6 +426,50 @@ void CSendThread::check_reconnect_queue()
     }
 }
 
+void CSendThread::post_reply_deadline(CSender* sender)
+{
+    sender->inc_refcount();
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_reply_deadline_lock);
+        _reply_deadline_queue.push_back(sender);
+    }
+
+    _epoller.wakeup();
+}
+
+void CSendThread::clear_reply_deadline_queue()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_reply_deadline_lock);
+    while (!_reply_deadline_queue.empty())
+    {
+        _reply_deadline_queue.front()->dec_refcount();
+        _reply_deadline_queue.pop_front();
+    }
+}
+
+void CSendThread::check_reply_deadline_queue()
+{
+    if (_reply_deadline_queue.empty()) return;
+
+    CSenderQueue senders;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_reply_deadline_lock);
+        senders.swap(_reply_deadline_queue);
+    }
+
+    for (CSenderQueue::iterator iter=senders.begin(); iter!=senders.end(); ++iter)
+    {
+        CSender* sender = *iter;
+        if (!sender->is_removed())
+        {
+            sender->clear_reply_deadline_posted();
+            sender->get_sender_info().reply_handler->reply_deadline_changed();
+        }
+
+        sender->dec_refcount();
+    }
+}
+
 void CSendThread::check_unconnected_queue()
 {
     // 两个if可以降低do_connect对性能的影响
@@ -269,8 +489,10 @@ void CSendThread::check_unconnected_queue()
 
 void CSendThread::remove_sender(CSender* sender)
 {    
+    sender->set_removed();
     _epoller.del_events(sender);                
-    _timeout_manager.remove(sender);
+    sender->set_waiting_doorbell(false);
+    remove_sender_timer(sender);
 
     CSenderTable* sender_table = sender->get_sender_table();
     sender_table->close_sender(sender);
@@ -281,6 +503,7 @@ void CSendThread::sender_connect(CSender* sender)
     try
     {
         // 必须采用异步连接，这个是性能的保证
+        sender->set_connect_start();
         if (sender->async_connect())
         {
         	DISPATCHER_LOG_DEBUG("%s instantly connect successfully.\n", sender->to_string().c_str());
@@ -288,10 +511,11 @@ void CSendThread::sender_connect(CSender* sender)
         else
         {
         	DISPATCHER_LOG_DEBUG("%s to asynchronously connect.\n", sender->to_string().c_str());
+            set_sender_deadline(sender, timer_connect, true);
         }
 
         _epoller.set_events(sender, EPOLLIN|EPOLLOUT);
-        _timeout_manager.push(sender, _current_time);
+        update_sender_timer(sender);
     }
     catch (sys::CSyscallException& ex)
     {
@@ -305,8 +529,51 @@ void CSendThread::sender_reconnect(CSender* sender)
 {
     sender->close();
     _epoller.del_events(sender);
-    _timeout_manager.remove(sender);
-    _reconnect_queue.push_back(sender);
+    remove_sender_timer(sender, true);
+    sender->inc_reconnect_number();
+
+    // 连续连接失败达到阈值则熔断，直到重连接成功
+    uint32_t circuit_breaker_failures = _context->get_circuit_breaker_failures();
+    if ((circuit_breaker_failures > 0)
+     && (sender->get_reconnect_times() >= circuit_breaker_failures)
+     && !sender->is_circuit_open())
+    {
+        sender->set_circuit_open(true);
+        DISPATCHER_LOG_WARN("%s circuit opened after %u failures.\n", sender->to_string().c_str(), sender->get_reconnect_times());
+    }
+
+    _reconnect_queue.push(ReconnectItem(_current_milliseconds+get_backoff_milliseconds(sender), sender));
+}
+
+uint64_t CSendThread::get_backoff_milliseconds(CSender* sender)
+{
+    // 基数乘以2的连续失败次数次方，不超过最大间隔
+    uint64_t max_milliseconds = static_cast<uint64_t>(_context->get_reconnect_max_seconds()) * 1000;
+    uint64_t backoff_milliseconds = static_cast<uint64_t>(_context->get_reconnect_seconds()) * 1000;
+    if (max_milliseconds < backoff_milliseconds)
+        max_milliseconds = backoff_milliseconds; // 最大间隔不小于基数
+    uint32_t failures = sender->get_reconnect_times();
+    for (uint32_t i=0; (i<failures) && (backoff_milliseconds<max_milliseconds); ++i)
+        backoff_milliseconds <<= 1;
+    if (backoff_milliseconds > max_milliseconds)
+        backoff_milliseconds = max_milliseconds;
+
+    // 在后一半内随机，既保证了退避，又将同时断开的Sender错开
+    uint64_t half_milliseconds = backoff_milliseconds / 2;
+    return half_milliseconds + static_cast<uint64_t>(rand_r(&_random_seed)) % (backoff_milliseconds - half_milliseconds + 1);
+}
+
+uint32_t CSendThread::get_reconnect_wait_milliseconds(uint32_t epoll_timeout_milliseconds) const
+{
+    if (_reconnect_queue.empty()) return epoll_timeout_milliseconds;
+
+    // 在最早的重连接到期时醒来
+    uint64_t reconnect_milliseconds = _reconnect_queue.top().reconnect_milliseconds;
+    if (reconnect_milliseconds <= _current_milliseconds) return 0;
+    if (reconnect_milliseconds - _current_milliseconds < epoll_timeout_milliseconds)
+        return static_cast<uint32_t>(reconnect_milliseconds - _current_milliseconds);
+
+    return epoll_timeout_milliseconds;
 }
 
 DISPATCHER_NAMESPACE_END
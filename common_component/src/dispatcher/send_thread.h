@@ -19,18 +19,43 @@
 #ifndef MOOON_DISPATCHER_SEND_THREAD_H
 #define MOOON_DISPATCHER_SEND_THREAD_H
 #include <list>
+#include <queue>
+#include <vector>
 #include <net/epoller.h>
 #include <sys/pool_thread.h>
+#include <util/timing_wheel.h>
 #include <util/timeout_manager.h>
+#include "send_queue.h"
 #include "dispatcher_log.h"
 #include "dispatcher/dispatcher.h"
 DISPATCHER_NAMESPACE_BEGIN
 
 class CSender;
 class CDispatcherContext;
-class CSendThread: public sys::CPoolThread, public util::ITimeoutHandler<CSender>
+class CSendThread: public sys::CPoolThread
+                 , public util::ITimeoutHandler<CSender>
+                 , public util::ITimerHandler<CSender>
 {
     typedef std::list<CSender*> CSenderQueue;
+
+    /** 等待重连接的Sender，按下一次重连接的时刻排序 */
+    struct ReconnectItem
+    {
+        uint64_t reconnect_milliseconds; // 下一次重连接的时刻
+        CSender* sender;
+
+        ReconnectItem(uint64_t milliseconds, CSender* sender_)
+            :reconnect_milliseconds(milliseconds)
+            ,sender(sender_)
+        {
+        }
+
+        bool operator >(const ReconnectItem& other) const
+        {
+            return reconnect_milliseconds > other.reconnect_milliseconds;
+        }
+    };
+    typedef std::priority_queue<ReconnectItem, std::vector<ReconnectItem>, std::greater<ReconnectItem> > CReconnectHeap;
     
 public:
     CSendThread();
@@ -39,7 +64,34 @@ public:
     virtual void set_parameter(void* parameter);
 
     net::CEpoller& get_epoller() const { return _epoller; }
-    util::CTimeoutManager<CSender>* get_timeout_manager() { return &_timeout_manager; }                
+    CDispatcherContext* get_context() const { return _context; }
+
+    /** 是否为门铃模式 */
+    bool use_doorbell() const { return _use_doorbell; }
+    /** 为队列由空变为非空的Sender敲门铃，可在任意线程中调用 */
+    void ring_doorbell(CSender* sender) { _doorbell.ring(sender); }
+    /** 让发送线程调用Sender应答处理器的reply_deadline_changed，可在任意线程中调用 */
+    void post_reply_deadline(CSender* sender);
+    /** 有Sender被关闭，在等待重连接的须立即移除，可在任意线程中调用 */
+    void notify_shutdown() { atomic_inc(&_shutdown_number); _epoller.wakeup(); }
+
+    /** 更新Sender的空闲超时 */
+    void update_sender_timer(CSender* sender);
+    /***
+      * 停止Sender的所有超时
+      * @keep_reply_timer: 是否保留应答定时器，重连接时保留，在途请求的期限不因断开而丢失
+      */
+    void remove_sender_timer(CSender* sender, bool keep_reply_timer=false);
+    /***
+      * 启动或停止Sender的连接和发送定时器，仅在使用时间轮时有效
+      * 启动时如果定时器已在计时，则保持原计时不变
+      */
+    void set_sender_deadline(CSender* sender, uint8_t kind, bool armed);
+    /***
+      * 以指定的毫秒数启动Sender的定时器，已在计时则重新计时，为0表示停止
+      * 仅在使用时间轮时有效
+      */
+    void set_sender_timer(CSender* sender, uint8_t kind, uint32_t milliseconds);
         
 private:
     virtual void run();  
@@ -48,22 +100,30 @@ private:
     virtual bool before_start();   
     virtual void before_stop();
     virtual void on_timeout_event(CSender* timeoutable);
+    virtual void on_timer_expired(CSender* sender, uint8_t kind);
     
 private:    
     void clear_timeout_queue();
+    uint32_t get_timer_milliseconds(uint8_t kind) const;
+    uint32_t get_reconnect_wait_milliseconds(uint32_t epoll_timeout_milliseconds) const;
+    uint64_t get_backoff_milliseconds(CSender* sender);
     void clear_reconnect_queue();
     void clear_unconnected_queue();
+    void clear_reply_deadline_queue();
+    void expire_shutdown_senders();
 
 private:
     void check_reconnect_queue(); // 处理_reconnect_queue
     void check_unconnected_queue(); // 处理_unconnected_queue
+    void check_reply_deadline_queue(); // 处理_reply_deadline_queue
     void remove_sender(CSender* sender);
     void sender_connect(CSender* sender);
     void sender_reconnect(CSender* sender);
     
 private:
-    time_t _current_time;
-    time_t _last_connect_time;   // 上一次连接时间    
+    time_t _current_time; // 单调递增的秒数，由sys::CClock得到
+    uint64_t _current_milliseconds; // 单调递增的毫秒时间
+    unsigned int _random_seed; // 重连接退避的随机抖动
     
 private:
     typedef void (CSendThread::*epoll_event_proc_t)(net::CEpollable* epollable);
@@ -82,10 +142,18 @@ private:
 private:     
     mutable net::CEpoller _epoller;
     sys::CLock _unconnected_lock;
-    CSenderQueue _reconnect_queue; // 重连接队列
+    CReconnectHeap _reconnect_queue; // 重连接队列，最早到期的在堆顶
+    atomic_t _shutdown_number; // 被关闭的Sender数，变化时检查重连接队列
+    int _checked_shutdown_number;
     CSenderQueue _unconnected_queue; // 待连接队列    
+    sys::CLock _reply_deadline_lock;
+    CSenderQueue _reply_deadline_queue; // 登记了新应答期限的Sender，各持有一个引用计数
     CDispatcherContext* _context;
     util::CTimeoutManager<CSender> _timeout_manager;
+    bool _use_timing_wheel;
+    util::CTimingWheel<CSender> _timing_wheel;
+    bool _use_doorbell;
+    CSendDoorbell _doorbell; // 门铃模式下，本线程所有Sender共用
 };
 
 DISPATCHER_NAMESPACE_END
@@ -20,19 +20,43 @@
 #include "sender.h"
 #include "send_thread.h"
 #include "sender_table.h"
+#include "dispatcher_context.h"
 #include "default_reply_handler.h"
 DISPATCHER_NAMESPACE_BEGIN
     
 CSender::CSender()
-    :_send_queue(0, this)
+    :_send_queue(NULL)
+    ,_lockfree_queue(NULL)
     ,_send_thread(NULL)
     ,_sender_table(NULL)
     ,_in_table(false)
     ,_to_shutdown(false)
+    ,_circuit_open(false)
+    ,_removed(false)
+    ,_high_watermark(0)
+    ,_low_watermark(0)
+    ,_messages_out(0)
+    ,_bytes_out(0)
+    ,_bytes_in(0)
+    ,_reconnect_number(0)
+    ,_connect_start_microseconds(0)
     ,_cur_resend_times(0)
     ,_current_offset(0)
     ,_current_message(NULL)
+    ,_is_corked(false)
+    ,_gather_head(0)
+    ,_gather_number(0)
+    ,_doorbell_next(NULL)
+    ,_waiting_doorbell(false)
 {
+    atomic_set(&_in_doorbell, 0);
+    atomic8_set(&_queue_bytes, 0);
+    atomic_set(&_throttled, 0);
+    atomic_set(&_queue_messages, 0);
+    atomic_set(&_reply_deadline_posted, 0);
+    for (uint8_t kind=0; kind<timer_kind_number; ++kind)
+        _timer_node[kind].set_owner(this, kind);
+
     /***
       * 默认构造函数，不做实际用，仅为满足CListQueue的空闲头结点需求
       */    
@@ -43,17 +67,42 @@ CSender::~CSender()
 {    
     clear_message();    
     delete _sender_info.reply_handler; // 注意此处的性能
+    delete _send_queue;
+    delete _lockfree_queue;
 }
 
 CSender::CSender(const SenderInfo& sender_info)
-    :_send_queue(sender_info.queue_size, this)
+    :_send_queue(NULL)
+    ,_lockfree_queue(NULL)
     ,_send_thread(NULL)
     ,_sender_table(NULL)
     ,_to_shutdown(false)
+    ,_circuit_open(false)
+    ,_removed(false)
+    ,_high_watermark(0)
+    ,_low_watermark(0)
+    ,_messages_out(0)
+    ,_bytes_out(0)
+    ,_bytes_in(0)
+    ,_reconnect_number(0)
+    ,_connect_start_microseconds(0)
     ,_cur_resend_times(0)
     ,_current_offset(0)
     ,_current_message(NULL)
-{   
+    ,_is_corked(false)
+    ,_gather_head(0)
+    ,_gather_number(0)
+    ,_doorbell_next(NULL)
+    ,_waiting_doorbell(false)
+{
+    atomic_set(&_in_doorbell, 0);   
+    atomic8_set(&_queue_bytes, 0);
+    atomic_set(&_throttled, 0);
+    atomic_set(&_queue_messages, 0);
+    atomic_set(&_reply_deadline_posted, 0);
+    for (uint8_t kind=0; kind<timer_kind_number; ++kind)
+        _timer_node[kind].set_owner(this, kind);
+
     set_peer(sender_info.ip_node);
     memcpy(&_sender_info, &sender_info, sizeof(SenderInfo));    
 
@@ -79,16 +128,31 @@ void CSender::set_reconnect_times(int32_t reconnect_times)
 	_sender_info.reconnect_times = reconnect_times;
 }
 
+void CSender::set_queue_watermarks(uint64_t high_bytes, uint64_t low_bytes)
+{
+    _low_watermark = (low_bytes > high_bytes)? high_bytes: low_bytes;
+    _high_watermark = high_bytes;
+}
+
 void CSender::shutdown()
 {
     _to_shutdown = true;
     _sender_info.reconnect_times = 0;
     close_write();
+
+    // 在重连接队列中等待退避的Sender，由发送线程立即移除
+    if (_send_thread != NULL) _send_thread->notify_shutdown();
 }
 
 void CSender::attach_thread(CSendThread* send_thread)
 { 
     _send_thread = send_thread; 
+
+    // 门铃模式下不需要每个Sender一个管道
+    if (send_thread->use_doorbell())
+        _lockfree_queue = new CLockFreeSendQueue(_sender_info.queue_size);
+    else
+        _send_queue = new CSendQueue(_sender_info.queue_size, this);
 }
 
 void CSender::attach_sender_table(CSenderTable* sender_table)
@@ -98,11 +162,25 @@ void CSender::attach_sender_table(CSenderTable* sender_table)
 
 void CSender::before_close()
 {    
+    _is_corked = false;
+    _waiting_doorbell = false;
     _sender_info.reply_handler->sender_closed();
 }
 
 void CSender::after_connect()
 {
+    if (_connect_start_microseconds > 0)
+    {
+        _connect_latency.record(sys::CClock::get_monotonic_microseconds() - _connect_start_microseconds);
+        _connect_start_microseconds = 0;
+    }
+
+    if (_circuit_open)
+    {
+        _circuit_open = false;
+        DISPATCHER_LOG_INFO("%s circuit closed.\n", to_string().c_str());
+    }
+
     _sender_info.reply_handler->sender_connected();
 }
 
@@ -113,14 +191,79 @@ void CSender::on_connect_failure()
 
 void CSender::clear_message()
 {
-    // 删除列队中的所有消息
+    // 删除已取出待发和列队中的所有消息
+    for (; _gather_number>0; --_gather_number)
+    {
+        release_message(_gather_messages[_gather_head++]);
+    }
+
     message_t* message;
-    while (_send_queue.pop_front(message))
+    while (pop_message(message))
     {              
-        destroy_message(message);
+        release_message(message);
     }
 }
 
+void CSender::release_message(message_t* message)
+{
+    release_queue_bytes(message);
+    destroy_message(message);
+}
+
+bool CSender::reserve_queue_bytes(message_t* message)
+{
+    // 达到高水位后，降到低水位前一直拒绝，避免在水位附近反复切换
+    if (atomic_read(&_throttled) != 0) return false;
+    if ((_send_thread != NULL) && !_send_thread->get_context()->reserve_queue_bytes(message->length)) return false;
+
+    atomic8_add(static_cast<long>(message->length), &_queue_bytes);
+    atomic_inc(&_queue_messages);
+    uint64_t high_watermark = _high_watermark;
+    if ((high_watermark > 0) && (get_queue_bytes() >= high_watermark))
+    {
+        // 置位和回调在锁内一起完成，保证应用总是先收到高水位再收到低水位
+        sys::LockHelper<sys::CRecLock> lock(_watermark_lock);
+        if ((0 == atomic_read(&_throttled)) && (get_queue_bytes() >= high_watermark))
+        {
+            atomic_set(&_throttled, 1);
+            _sender_info.reply_handler->queue_high_watermark();
+
+            // 发送线程可能在置位前已将队列发空，此时由推送线程自己解除
+            if (get_queue_bytes() <= _low_watermark)
+            {
+                atomic_set(&_throttled, 0);
+                _sender_info.reply_handler->queue_low_watermark();
+            }
+        }
+    }
+
+    return true;
+}
+
+void CSender::release_queue_bytes(message_t* message)
+{
+    if (_send_thread != NULL) _send_thread->get_context()->release_queue_bytes(message->length);
+    atomic8_sub(static_cast<long>(message->length), &_queue_bytes);
+    atomic_dec(&_queue_messages);
+
+    if ((atomic_read(&_throttled) != 0) && (get_queue_bytes() <= _low_watermark))
+    {
+        sys::LockHelper<sys::CRecLock> lock(_watermark_lock);
+        if ((atomic_read(&_throttled) != 0) && (get_queue_bytes() <= _low_watermark))
+        {
+            atomic_set(&_throttled, 0);
+            _sender_info.reply_handler->queue_low_watermark();
+        }
+    }
+}
+
+bool CSender::pop_message(message_t*& message)
+{
+    if (_lockfree_queue != NULL) return _lockfree_queue->pop_front(message);
+    if (_send_queue != NULL) return _send_queue->pop_front(message);
+    return false;
+}
+
 void CSender::inc_resend_times()
 {
     ++_cur_resend_times;
@@ -157,6 +300,7 @@ util::handle_result_t CSender::do_handle_reply()
         DISPATCHER_LOG_WARN("%s closed by peer.\n", to_string().c_str());
         return util::handle_error; // 连接被关闭
     }
+    if (data_size > 0) _bytes_in += (uint64_t)data_size;
 
     // 处理应答，如果处理失败则关闭连接    
     util::handle_result_t retval = _sender_info.reply_handler->handle_reply((size_t)data_size);
@@ -178,18 +322,30 @@ util::handle_result_t CSender::do_handle_reply()
 
 bool CSender::get_current_message()
 {
-    if (_current_message != NULL) return _current_message;
-    bool retval = _send_queue.pop_front(_current_message);
-    if (retval)
-        _sender_info.reply_handler->before_send();
+    if (_current_message != NULL) return true;
+    if (0 == _gather_number)
+    {
+        // 一次取出一批，以便连续的Buffer消息合并发送
+        _gather_head = 0;
+        _gather_number = DISPATCHER_GATHER_MESSAGES;
+        if (_lockfree_queue != NULL)
+            _lockfree_queue->pop_front(_gather_messages, _gather_number);
+        else
+            _send_queue->pop_front(_gather_messages, _gather_number);
+        if (0 == _gather_number) return false;
+    }
 
-    return retval;
+    _current_message = _gather_messages[_gather_head++];
+    --_gather_number;
+    _sender_info.reply_handler->before_send();
+
+    return true;
 }
 
 void CSender::free_current_message()
 {
     reset_resend_times();
-    destroy_message(_current_message);
+    release_message(_current_message);
     
     _current_message = NULL;            
     _current_offset = 0;
@@ -208,7 +364,7 @@ void CSender::reset_current_message(bool finish)
             if (need_resend())
             {
                 inc_resend_times();
-                if (DISPATCH_BUFFER == _current_message->type)
+                if (is_buffer_message(_current_message))
                 {         
                     // 如果是dispatch_file不重头发，总是从断点处开始重发
                     _current_offset = 0; // 重头发送
@@ -222,6 +378,83 @@ void CSender::reset_current_message(bool finish)
     }
 }
 
+void CSender::uncork()
+{
+    if (_is_corked)
+    {
+        _is_corked = false;
+        net::set_tcp_option(get_fd(), false, TCP_CORK);
+    }
+}
+
+ssize_t CSender::send_buffer_messages()
+{
+    struct iovec iov[DISPATCHER_GATHER_MESSAGES+1];
+    size_t bytes = _current_message->length - _current_offset;
+    int iovcnt = 1;
+
+    iov[0].iov_base = get_buffer_data(_current_message) + _current_offset;
+    iov[0].iov_len = bytes;
+
+    // 合并排在后面的连续Buffer消息，遇到文件消息为止
+    for (uint32_t i=_gather_head; i<_gather_head+_gather_number; ++i)
+    {
+        if (bytes >= DISPATCHER_GATHER_BYTES) break;
+        if (!is_buffer_message(_gather_messages[i])) break;
+
+        iov[iovcnt].iov_base = get_buffer_data(_gather_messages[i]);
+        iov[iovcnt].iov_len = _gather_messages[i]->length;
+        bytes += _gather_messages[i]->length;
+        ++iovcnt;
+    }
+
+    if (1 == iovcnt)
+        return send((char*)iov[0].iov_base, iov[0].iov_len);
+    
+    return writev(iov, iovcnt);
+}
+
+net::epoll_event_t CSender::on_message_sent(size_t bytes)
+{
+    // 合并发送的消息以同一时刻计算延迟
+    uint64_t now_microseconds = sys::CClock::get_monotonic_microseconds();
+    _bytes_out += bytes;
+
+    // 发送出去的字节可能跨越多个消息，逐个消息回调进度，发完的消息被释放
+    for (;;)
+    {
+        size_t current = _current_message->length - _current_offset;
+        if (current > bytes) current = bytes;
+
+        // 重发的不再计入首字节延迟
+        if ((0 == _current_offset) && (0 == _cur_resend_times) && (current > 0))
+            _first_byte_latency.record(now_microseconds - _current_message->push_microseconds);
+
+        bytes -= current;
+        _current_offset += current;
+        _sender_info.reply_handler->send_progress(_current_message->length, _current_offset, current);
+
+        // 未全部发送，需要等待下一轮回
+        if (_current_offset < _current_message->length)
+        {
+            _send_thread->set_sender_deadline(this, timer_write, true);
+            return net::epoll_read_write;
+        }
+
+        _send_thread->set_sender_deadline(this, timer_write, false);
+        _complete_latency.record(now_microseconds - _current_message->push_microseconds);
+        ++_messages_out;
+        _sender_info.reply_handler->send_completed();
+        reset_current_message(true);
+
+        // 剩下的字节属于合并发送的下一个消息
+        if (0 == bytes) break;
+        get_current_message();
+    }
+
+    return net::epoll_none;
+}
+
 net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, void* output_ptr)
 {    
     net::CEpoller& epoller = _send_thread->get_epoller();
@@ -231,28 +464,35 @@ net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, vo
     {
         if (!get_current_message())
         {
-            // 队列里没有了
-            epoller.set_events(&_send_queue, EPOLLIN);
+            // 队列里没有了，门铃模式下等门铃，否则等管道可读
+            uncork();
+            if (_lockfree_queue != NULL)
+                _waiting_doorbell = true;
+            else
+                epoller.set_events(_send_queue, EPOLLIN);
             return net::epoll_read;
         }
         
         ssize_t retval;
         if (DISPATCH_FILE == _current_message->type)
         {
-            // 发送文件
+            // 发送文件，连续的文件消息只设置一次TCP_CORK
             file_message_t* file_message = (file_message_t*)(_current_message->data);
             off_t offset = file_message->offset + (off_t)_current_offset; // 从哪里开始发送
             size_t size = _current_message->length - (size_t)offset; // 剩余的大小
             
-            net::set_tcp_option(get_fd(), true, TCP_CORK);
+            if (!_is_corked)
+            {
+                _is_corked = true;
+                net::set_tcp_option(get_fd(), true, TCP_CORK);
+            }
+            
             retval = send_file(file_message->fd, &offset, size);
-            net::set_tcp_option(get_fd(), false, TCP_CORK);
         }
-        else if (DISPATCH_BUFFER == _current_message->type)
+        else if (is_buffer_message(_current_message))
         {
-            // 发送Buffer
-            buffer_message_t* buffer_message = (buffer_message_t*)(_current_message->data);
-            retval = send(buffer_message->data+_current_offset, _current_message->length-_current_offset);
+            // 发送Buffer，连续的多个合并成一次writev
+            retval = send_buffer_messages();
         }   
         else
         {
@@ -263,21 +503,17 @@ net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, vo
         
         if (-1 == retval)
         {
+            uncork();
+            _send_thread->set_sender_deadline(this, timer_write, true);
             return net::epoll_read_write; // wouldblock                    
         }
 
-        _current_offset += (size_t)retval;
-        _sender_info.reply_handler->send_progress(_current_message->length, _current_offset, (size_t)retval);
-
-        // 未全部发送，需要等待下一轮回
-        if (_current_offset < _current_message->length) 
+        // 未全部发送，需要等待下一轮回，否则继续下一个消息
+        if (net::epoll_read_write == on_message_sent((size_t)retval))
         {
-                return net::epoll_read_write;
+            uncork();
+            return net::epoll_read_write;
         }
-        
-        // 发送完毕，继续下一个消息
-        _sender_info.reply_handler->send_completed();
-        reset_current_message(true);            
     }  
     
     return net::epoll_close;
@@ -285,10 +521,6 @@ net::epoll_event_t CSender::do_send_message(void* input_ptr, uint32_t events, vo
 
 net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events, void* output_ptr)
 {    
-    util::CTimeoutManager<CSender>* timeout_manager;
-    timeout_manager = get_send_thread()->get_timeout_manager();
-    timeout_manager->remove(this);
-    
     try
     {
         do
@@ -332,7 +564,7 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
                     return net::epoll_destroy;
                 }
                 
-                timeout_manager->push(this, get_send_thread()->get_current_time());
+                get_send_thread()->update_sender_timer(this);
                 return net::epoll_none;                
             }
             else if (EPOLLOUT & events)
@@ -341,6 +573,7 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
                 if (is_connect_establishing())
                 {
                 	set_connected_state();
+                	get_send_thread()->set_sender_deadline(this, timer_connect, false);
                 	DISPATCHER_LOG_DEBUG("%s to asynchronously connect sucessfully.\n", to_string().c_str());
                 }
 
@@ -350,7 +583,7 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
                     break;
                 }
                 
-                timeout_manager->push(this, get_send_thread()->get_current_time());
+                get_send_thread()->update_sender_timer(this);
                 return send_retval;
             }    
             else // Unknown events
@@ -370,23 +603,93 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
     return net::epoll_close;
 }
 
-template <typename ConcreteMessage>
-bool CSender::do_push_message(ConcreteMessage* concrete_message, uint32_t milliseconds)
+void CSender::get_stats(SenderStats& stats) const
+{
+    stats.key = _sender_info.key;
+    stats.ip_node = _sender_info.ip_node;
+    stats.connected = is_connect_established();
+    stats.queue_messages = static_cast<uint32_t>(atomic_read(&_queue_messages));
+    stats.queue_bytes = get_queue_bytes();
+    stats.messages_out = _messages_out;
+    stats.bytes_out = _bytes_out;
+    stats.bytes_in = _bytes_in;
+    stats.reconnect_number = _reconnect_number;
+    _first_byte_latency.get_snapshot(stats.first_byte_latency);
+    _complete_latency.get_snapshot(stats.complete_latency);
+    _connect_latency.get_snapshot(stats.connect_latency);
+}
+
+void CSender::set_reply_timer(uint32_t milliseconds)
+{
+    // 已移出发送线程的Sender不能再进入时间轮，否则它被删除后定时器会悬空
+    if (_removed) return;
+    _send_thread->set_sender_timer(this, timer_reply, milliseconds);
+}
+
+void CSender::post_reply_deadline()
+{
+    if ((_send_thread != NULL) && __sync_bool_compare_and_swap(&_reply_deadline_posted, 0, 1))
+        _send_thread->post_reply_deadline(this);
+}
+
+bool CSender::do_push_message(message_t* message, uint32_t milliseconds)
 {
-    char* message_buffer = reinterpret_cast<char*>(concrete_message) - sizeof(message_t);
-    message_t* message = reinterpret_cast<message_t*>(message_buffer);
+    // 熔断期间快速失败，不让调用者在对端不可用时等待队列
+    if (_circuit_open) return false;
+    if (!reserve_queue_bytes(message)) return false;
+    message->push_microseconds = sys::CClock::get_monotonic_microseconds();
+
+    if (NULL == _lockfree_queue)
+    {
+        if (_send_queue->push_back(message, milliseconds)) return true;
+
+        release_queue_bytes(message);
+        return false;
+    }
 
-    return _send_queue.push_back(message, milliseconds);
+    // 队列由空变为非空时才敲门铃
+    bool was_empty = false;
+    if (!_lockfree_queue->push_back(message, milliseconds, &was_empty))
+    {
+        release_queue_bytes(message);
+        return false;
+    }
+    if (was_empty)
+    {
+        try
+        {
+            _send_thread->ring_doorbell(this);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            // 消息已在队列中，由Sender负责释放，不能再让调用者当作失败处理
+            DISPATCHER_LOG_ERROR("%s ring doorbell error for %s.\n", to_string().c_str(), ex.to_string().c_str());
+        }
+    }
+    
+    return true;
 }
 
 bool CSender::push_message(file_message_t* message, uint32_t milliseconds)
 {
-    return do_push_message(message, milliseconds);
+    char* message_buffer = reinterpret_cast<char*>(message) - sizeof(message_t);
+    return do_push_message(reinterpret_cast<message_t*>(message_buffer), milliseconds);
 }
 
 bool CSender::push_message(buffer_message_t* message, uint32_t milliseconds)
 {
-    return do_push_message(message, milliseconds);
+    char* message_buffer = reinterpret_cast<char*>(message) - sizeof(message_t);
+    return do_push_message(reinterpret_cast<message_t*>(message_buffer), milliseconds);
+}
+
+bool CSender::push_message(shared_message_t* message, uint32_t milliseconds)
+{
+    // 消息头在队列中链接，所以每个Sender须有自己的消息头，只共享数据
+    message_t* reference = create_shared_reference(message);
+    if (do_push_message(reference, milliseconds)) return true;
+
+    destroy_message(reference);
+    return false;
 }
 
 DISPATCHER_NAMESPACE_END
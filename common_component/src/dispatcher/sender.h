@@ -19,12 +19,28 @@
 #ifndef MOOON_DISPATCHER_SENDER_H
 #define MOOON_DISPATCHER_SENDER_H
 #include <sys/uio.h>
+#include <sys/lock.h>
+#include <sys/clock.h>
 #include <net/tcp_client.h>
 #include <util/listable.h>
 #include <util/timeoutable.h>
+#include <util/timing_wheel.h>
 #include "send_queue.h"
+#include "sender_stats.h"
 DISPATCHER_NAMESPACE_BEGIN
 
+/***
+  * Sender的定时器类型，仅在使用时间轮时有效
+  */
+enum
+{
+    timer_idle        = 0, /** 空闲超时 */
+    timer_connect     = 1, /** 异步连接超时 */
+    timer_write       = 2, /** 消息发送超时 */
+    timer_reply       = 3, /** 应答期限，由应答处理器通过set_reply_timer设置 */
+    timer_kind_number = 4
+};
+
 class CSendThread;
 class CSenderTable;
 class CSender: public ISender, public net::CTcpClient, public util::CTimeoutable, public util::CListable<CSender>
@@ -46,6 +62,14 @@ public:
     virtual std::string to_string() const;
     virtual const SenderInfo& get_sender_info() const { return _sender_info; }
     virtual void set_reconnect_times(int32_t reconnect_times);
+    virtual void set_queue_watermarks(uint64_t high_bytes, uint64_t low_bytes);
+    virtual uint64_t get_queue_bytes() const { return static_cast<uint64_t>(atomic8_read(&_queue_bytes)); }
+
+    /** 得到统计快照，可在任意线程中调用 */
+    void get_stats(SenderStats& stats) const;
+    /** 以下只在发送线程中调用 */
+    void inc_reconnect_number() { ++_reconnect_number; }
+    void set_connect_start() { _connect_start_microseconds = sys::CClock::get_monotonic_microseconds(); }
 
     void shutdown();
     bool to_shutdown() const { return _to_shutdown; }
@@ -54,8 +78,45 @@ public:
     void set_in_table(bool in_table) { _in_table = in_table; }
 
     CSenderTable* get_sender_table() { return _sender_table; }
+
+    /** 是否熔断，熔断期间push_message直接返回false */
+    bool is_circuit_open() const { return _circuit_open; }
+    void set_circuit_open(bool circuit_open) { _circuit_open = circuit_open; }
+    util::CTimerNode<CSender>* get_timer_node(uint8_t kind) { return &_timer_node[kind]; }
     void attach_thread(CSendThread* send_thread);
     void attach_sender_table(CSenderTable* sender_table);
+
+    /***
+      * 设置应答定时器，到期时调用IReplyHandler::reply_timer_expired，
+      * 只能在发送线程中调用，仅在使用时间轮时有效
+      * @milliseconds: 为0表示停止定时器
+      */
+    void set_reply_timer(uint32_t milliseconds);
+
+    /***
+      * 请求发送线程调用IReplyHandler::reply_deadline_changed，可在任意线程中调用，
+      * 发送线程处理之前的重复请求被合并
+      */
+    void post_reply_deadline();
+    /** 发送线程处理请求前调用，之后的post_reply_deadline会再次请求 */
+    void clear_reply_deadline_posted() { atomic_set(&_reply_deadline_posted, 0); }
+
+    /** 是否已被发送线程移除，只在发送线程中读写 */
+    bool is_removed() const { return _removed; }
+    void set_removed() { _removed = true; }
+
+    /** 得到正在发送的消息，没有时返回NULL，只能在发送线程中调用 */
+    message_t* get_sending_message() const { return _current_message; }
+
+public: // 门铃模式，只由CSendDoorbell和CSendThread调用
+    CSender* get_doorbell_next() const { return _doorbell_next; }
+    void set_doorbell_next(CSender* sender) { _doorbell_next = sender; }
+    /** 进入门铃的就绪栈，已在就绪栈中时返回false */
+    bool enter_doorbell() { return __sync_bool_compare_and_swap(&_in_doorbell, 0, 1); }
+    void leave_doorbell() { atomic_set(&_in_doorbell, 0); }
+    /** 是否因队列为空而只关注了EPOLLIN，在等门铃 */
+    bool is_waiting_doorbell() const { return _waiting_doorbell; }
+    void set_waiting_doorbell(bool waiting) { _waiting_doorbell = waiting; }
     
 private:
     virtual void before_close();
@@ -66,19 +127,26 @@ private: // ISender
     virtual std::string str() const { return to_string(); }     
     virtual bool push_message(file_message_t* message, uint32_t milliseconds);
     virtual bool push_message(buffer_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(shared_message_t* message, uint32_t milliseconds);
     
 private:
-    void clear_message();    
+    void clear_message();
+    void release_message(message_t* message);
+    bool reserve_queue_bytes(message_t* message);
+    void release_queue_bytes(message_t* message);
+    bool pop_message(message_t*& message);    
     void inc_resend_times();    
     bool need_resend() const;    
     void reset_resend_times();
     bool get_current_message();    
     void free_current_message();
+    void uncork();
+    ssize_t send_buffer_messages();
+    net::epoll_event_t on_message_sent(size_t bytes);
     void reset_current_message(bool finish);
     util::handle_result_t do_handle_reply();    
     net::epoll_event_t do_send_message(void* input_ptr, uint32_t events, void* output_ptr);
-    template <typename ConcreteMessage>
-    bool do_push_message(ConcreteMessage* concrete_message, uint32_t milliseconds);
+    bool do_push_message(message_t* message, uint32_t milliseconds);
     
 protected:    
     CSendThread* get_send_thread() { return _send_thread; }
@@ -86,16 +154,46 @@ protected:
        
 private:      
     SenderInfo _sender_info;    
-    CSendQueue _send_queue;        
+    CSendQueue* _send_queue;                // 管道模式下的消息队列
+    CLockFreeSendQueue* _lockfree_queue;    // 门铃模式下的消息队列
     CSendThread* _send_thread;
     CSenderTable* _sender_table;
     
 private:
     volatile bool _in_table; // 是否在SendTable中受控
     volatile bool _to_shutdown;
+    volatile bool _circuit_open; // 由发送线程设置，推送线程读取
+    bool _removed; // 已被发送线程移除，不能再启动定时器
+    volatile uint64_t _high_watermark; // 为0表示不限制队列字节数
+    volatile uint64_t _low_watermark;
+    atomic8_t _queue_bytes; // 已推送但未发送完的字节数
+    atomic_t _throttled;    // 是否达到高水位且尚未降到低水位
+    sys::CRecLock _watermark_lock; // 只在水位切换时使用，保证切换和回调的顺序一致，回调中可再推送所以用递归锁
+    atomic_t _queue_messages; // 已推送但未发送完的消息数
+
+private: // 统计，除_queue_messages外只由发送线程写
+    volatile uint64_t _messages_out;
+    volatile uint64_t _bytes_out;
+    volatile uint64_t _bytes_in;
+    volatile uint32_t _reconnect_number;
+    uint64_t _connect_start_microseconds;
+    CLatencyHistogram _first_byte_latency;
+    CLatencyHistogram _complete_latency;
+    CLatencyHistogram _connect_latency;
     volatile int _cur_resend_times;    // 当前已经连续重发的次数
     volatile size_t _current_offset;      // 当前已经发送的字节数
     message_t* _current_message; // 当前正在发送的消息
+    bool _is_corked; // 发送文件消息时是否设置了TCP_CORK，离开发送流程时才取消
+    uint32_t _gather_head;   // _gather_messages中第一个待发消息的下标
+    uint32_t _gather_number; // _gather_messages中待发的消息个数
+    message_t* _gather_messages[DISPATCHER_GATHER_MESSAGES]; // 已从队列取出，排在当前消息之后的消息
+
+private: // 门铃模式
+    CSender* _doorbell_next; // 在门铃就绪栈中的下一个Sender
+    atomic_t _in_doorbell;   // 是否在门铃的就绪栈中
+    bool _waiting_doorbell;
+    atomic_t _reply_deadline_posted; // 是否已请求发送线程处理新的应答期限
+    util::CTimerNode<CSender> _timer_node[timer_kind_number];
 };
 
 DISPATCHER_NAMESPACE_END
@@ -16,11 +16,414 @@
  *
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
+#include <algorithm>
+#include <sstream>
+#include "dispatcher_log.h"
 #include "sender_group.h"
+#include "default_reply_handler.h"
 DISPATCHER_NAMESPACE_BEGIN
 
-CSenderGroup::CSenderGroup()
+/** FNV-1a哈希，用于计算成员虚拟节点在哈希环上的位置 */
+static uint32_t fnv1a_hash(uint32_t hash, const void* data, size_t size)
 {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i=0; i<size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/** 打散键值，使连续的键值也能均匀分布在哈希环上 */
+static uint32_t mix_key(uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6bU;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35U;
+    key ^= key >> 16;
+    return key;
+}
+
+static bool is_same_ip_node(const net::ip_node_t& lhs, const net::ip_node_t& rhs)
+{
+    return (lhs.port == rhs.port) && (lhs.ip == rhs.ip);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CGroupMember
+
+CGroupMember::CGroupMember(const net::ip_node_t& ip_node)
+    :_sender(NULL)
+    ,_ip_node(ip_node)
+{
+    atomic_set(&_healthy, 1); // 在连接失败之前，认为是健康的，以便消息可先入队列
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CGroupReplyHandler
+
+CGroupReplyHandler::~CGroupReplyHandler()
+{
+    delete _reply_handler;
+    _member->dec_refcount();
+}
+
+CGroupReplyHandler::CGroupReplyHandler(CGroupMember* member, IReplyHandler* reply_handler)
+    :_member(member)
+    ,_reply_handler(reply_handler)
+{
+    _member->inc_refcount();
+}
+
+void CGroupReplyHandler::detach_reply_handler()
+{
+    _reply_handler = NULL;
+}
+
+void CGroupReplyHandler::attach(ISender* sender)
+{
+    // 延迟到attach时才创建默认处理器，这样创建Sender失败时无需区分是否为用户的处理器
+    if (NULL == _reply_handler)
+        _reply_handler = new CDefaultReplyHandler;
+
+    _reply_handler->attach(sender);
+}
+
+char* CGroupReplyHandler::get_buffer()
+{
+    return _reply_handler->get_buffer();
+}
+
+size_t CGroupReplyHandler::get_buffer_length() const
+{
+    return _reply_handler->get_buffer_length();
+}
+
+size_t CGroupReplyHandler::get_buffer_offset() const
+{
+    return _reply_handler->get_buffer_offset();
+}
+
+void CGroupReplyHandler::before_send()
+{
+    _reply_handler->before_send();
+}
+
+void CGroupReplyHandler::send_completed()
+{
+    _reply_handler->send_completed();
+}
+
+void CGroupReplyHandler::send_progress(size_t total, size_t finished, size_t current)
+{
+    _reply_handler->send_progress(total, finished, current);
+}
+
+void CGroupReplyHandler::sender_closed()
+{
+    _member->set_healthy(false);
+    _reply_handler->sender_closed();
+}
+
+bool CGroupReplyHandler::sender_timeout()
+{
+    return _reply_handler->sender_timeout();
+}
+
+void CGroupReplyHandler::sender_connected()
+{
+    _member->set_healthy(true);
+    _reply_handler->sender_connected();
+}
+
+void CGroupReplyHandler::sender_connect_failure()
+{
+    _member->set_healthy(false);
+    _reply_handler->sender_connect_failure();
+}
+
+util::handle_result_t CGroupReplyHandler::handle_reply(size_t data_size)
+{
+    return _reply_handler->handle_reply(data_size);
+}
+
+void CGroupReplyHandler::queue_high_watermark()
+{
+    _reply_handler->queue_high_watermark();
+}
+
+void CGroupReplyHandler::queue_low_watermark()
+{
+    _reply_handler->queue_low_watermark();
+}
+
+int CGroupReplyHandler::get_state() const
+{
+    return _reply_handler->get_state();
+}
+
+void CGroupReplyHandler::set_state(int state)
+{
+    _reply_handler->set_state(state);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CSenderGroup
+
+CSenderGroup::~CSenderGroup()
+{
+    sys::WriteLockHelper write_lock(_lock);
+
+    for (std::vector<CGroupMember*>::iterator iter=_member_array.begin(); iter!=_member_array.end(); ++iter)
+    {
+        CGroupMember* member = *iter;
+        _sender_table->close_sender(member->get_sender());
+        member->dec_refcount();
+    }
+
+    _member_array.clear();
+    _hash_ring.clear();
+}
+
+CSenderGroup::CSenderGroup(IUnmanagedSenderTable* sender_table, select_policy_t select_policy)
+    :_sender_table(sender_table)
+    ,_select_policy(select_policy)
+{
+    atomic_set(&_next_index, 0);
+}
+
+std::string CSenderGroup::str() const
+{
+    sys::ReadLockHelper read_lock(_lock);
+    std::stringstream str;
+
+    str << "sender_group://" << _select_policy;
+    for (std::vector<CGroupMember*>::const_iterator iter=_member_array.begin(); iter!=_member_array.end(); ++iter)
+    {
+        const CGroupMember* member = *iter;
+        str << (iter == _member_array.begin()? "@": ",")
+            << member->get_ip_node().ip.to_string()
+            << ":"
+            << member->get_ip_node().port
+            << (member->is_healthy()? "": "(unhealthy)");
+    }
+
+    return str.str();
+}
+
+select_policy_t CSenderGroup::get_select_policy() const
+{
+    return _select_policy;
+}
+
+bool CSenderGroup::add_sender(const SenderInfo& sender_info)
+{
+    sys::WriteLockHelper write_lock(_lock);
+
+    // 成员下标存储在uint16_t中
+    if (_member_array.size() >= 0xFFFF)
+    {
+        DISPATCHER_LOG_ERROR("Too many senders in sender group.\n");
+        return false;
+    }
+
+    CGroupMember* member = new CGroupMember(sender_info.ip_node);
+    CGroupReplyHandler* reply_handler = new CGroupReplyHandler(member, sender_info.reply_handler);
+    SenderInfo group_sender_info = sender_info;
+    group_sender_info.reply_handler = reply_handler;
+
+    ISender* sender = _sender_table->open_sender(group_sender_info);
+    if (NULL == sender)
+    {
+        // 创建失败时，用户的应答处理器仍归调用者
+        reply_handler->detach_reply_handler();
+        delete reply_handler; // 同时删除了member
+        return false;
+    }
+
+    member->set_sender(sender);
+    member->inc_refcount();
+    _member_array.push_back(member);
+    rebuild_hash_ring();
+
+    return true;
+}
+
+bool CSenderGroup::remove_sender(const net::ip_node_t& ip_node)
+{
+    sys::WriteLockHelper write_lock(_lock);
+
+    for (std::vector<CGroupMember*>::iterator iter=_member_array.begin(); iter!=_member_array.end(); ++iter)
+    {
+        CGroupMember* member = *iter;
+        if (is_same_ip_node(member->get_ip_node(), ip_node))
+        {
+            _member_array.erase(iter);
+            rebuild_hash_ring();
+
+            _sender_table->close_sender(member->get_sender());
+            member->dec_refcount();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint16_t CSenderGroup::get_sender_number() const
+{
+    sys::ReadLockHelper read_lock(_lock);
+    return static_cast<uint16_t>(_member_array.size());
+}
+
+uint16_t CSenderGroup::get_healthy_number() const
+{
+    sys::ReadLockHelper read_lock(_lock);
+    uint16_t healthy_number = 0;
+
+    for (std::vector<CGroupMember*>::const_iterator iter=_member_array.begin(); iter!=_member_array.end(); ++iter)
+    {
+        if ((*iter)->is_healthy())
+            ++healthy_number;
+    }
+
+    return healthy_number;
+}
+
+bool CSenderGroup::push_message(file_message_t* message, uint32_t milliseconds, uint32_t key)
+{
+    return do_push_message(message, milliseconds, key);
+}
+
+bool CSenderGroup::push_message(buffer_message_t* message, uint32_t milliseconds, uint32_t key)
+{
+    return do_push_message(message, milliseconds, key);
+}
+
+bool CSenderGroup::push_message(shared_message_t* message, uint32_t milliseconds, uint32_t key)
+{
+    return do_push_message(message, milliseconds, key);
+}
+
+template <typename MessageType>
+bool CSenderGroup::do_push_message(MessageType* message, uint32_t milliseconds, uint32_t key)
+{
+    sys::ReadLockHelper read_lock(_lock);
+    int first_index = select_member(key);
+    if (-1 == first_index)
+    {
+        DISPATCHER_LOG_WARN("No healthy sender in sender group of %d senders.\n", static_cast<int>(_member_array.size()));
+        return false;
+    }
+
+    // 首选成员可等待，其余健康成员依次尝试，但不等待，以免故障转移的总时长成倍增加
+    uint16_t member_number = static_cast<uint16_t>(_member_array.size());
+    for (uint16_t i=0; i<member_number; ++i)
+    {
+        CGroupMember* member = _member_array[(first_index+i) % member_number];
+        if ((i > 0) && !member->is_healthy())
+            continue;
+
+        if (member->get_sender()->push_message(message, (0 == i)? milliseconds: 0))
+            return true;
+    }
+
+    return false;
+}
+
+int CSenderGroup::select_member(uint32_t key)
+{
+    if (_member_array.empty())
+        return -1;
+
+    if (select_least_bytes == _select_policy)
+        return select_least_bytes_member();
+    if (select_consistent_hash == _select_policy)
+        return select_consistent_hash_member(key);
+
+    return select_round_robin_member();
+}
+
+int CSenderGroup::select_round_robin_member()
+{
+    uint16_t member_number = static_cast<uint16_t>(_member_array.size());
+    uint32_t start_index = static_cast<uint32_t>(atomic_inc_return(&_next_index));
+
+    for (uint16_t i=0; i<member_number; ++i)
+    {
+        int index = static_cast<int>((start_index+i) % member_number);
+        if (_member_array[index]->is_healthy())
+            return index;
+    }
+
+    return -1;
+}
+
+int CSenderGroup::select_least_bytes_member() const
+{
+    int least_index = -1;
+    uint64_t least_bytes = 0;
+
+    for (size_t i=0; i<_member_array.size(); ++i)
+    {
+        const CGroupMember* member = _member_array[i];
+        if (!member->is_healthy())
+            continue;
+
+        uint64_t outstanding_bytes = member->get_outstanding_bytes();
+        if ((-1 == least_index) || (outstanding_bytes < least_bytes))
+        {
+            least_index = static_cast<int>(i);
+            least_bytes = outstanding_bytes;
+        }
+    }
+
+    return least_index;
+}
+
+int CSenderGroup::select_consistent_hash_member(uint32_t key) const
+{
+    // 从键值所在位置顺时针找第一个健康成员的虚拟节点，
+    // 这样不健康成员的键值会分摊到其它成员，而其它成员的键值不受影响
+    HashNode hash_node(mix_key(key), 0);
+    std::vector<HashNode>::const_iterator iter = std::lower_bound(_hash_ring.begin(), _hash_ring.end(), hash_node);
+
+    for (size_t i=0; i<_hash_ring.size(); ++i, ++iter)
+    {
+        if (iter == _hash_ring.end())
+            iter = _hash_ring.begin();
+        if (_member_array[iter->second]->is_healthy())
+            return iter->second;
+    }
+
+    return -1;
+}
+
+void CSenderGroup::rebuild_hash_ring()
+{
+    _hash_ring.clear();
+    if (_select_policy != select_consistent_hash)
+        return;
+
+    _hash_ring.reserve(_member_array.size() * DISPATCHER_GROUP_VIRTUAL_NODES);
+    for (size_t i=0; i<_member_array.size(); ++i)
+    {
+        // 虚拟节点的位置只由IP和端口决定，与成员的加入顺序无关
+        const net::ip_node_t& ip_node = _member_array[i]->get_ip_node();
+        uint32_t hash = fnv1a_hash(2166136261U, ip_node.ip.get_address_data(), ip_node.ip.get_address_data_length());
+        hash = fnv1a_hash(hash, &ip_node.port, sizeof(ip_node.port));
+
+        for (uint32_t j=0; j<DISPATCHER_GROUP_VIRTUAL_NODES; ++j)
+        {
+            uint32_t node_hash = fnv1a_hash(hash, &j, sizeof(j));
+            _hash_ring.push_back(HashNode(mix_key(node_hash), static_cast<uint16_t>(i)));
+        }
+    }
+
+    std::sort(_hash_ring.begin(), _hash_ring.end());
 }
 
 DISPATCHER_NAMESPACE_END
@@ -18,13 +18,137 @@
  */
 #ifndef MOOON_DISPATCHER_SENDER_GROUP_H
 #define MOOON_DISPATCHER_SENDER_GROUP_H
-#include "sender.h"
+#include <vector>
+#include <sys/atomic.h>
+#include <sys/ref_countable.h>
+#include <sys/read_write_lock.h>
+#include "dispatcher/dispatcher.h"
 DISPATCHER_NAMESPACE_BEGIN
 
-class CSenderGroup
+/***
+  * 发送者组的成员，记录成员的健康状态，
+  * 由CSenderGroup和CGroupReplyHandler共同持有，
+  * 因为Sender可能晚于组被销毁
+  */
+class CGroupMember: public sys::CRefCountable
 {
 public:
-    CSenderGroup();
+    CGroupMember(const net::ip_node_t& ip_node);
+
+    const net::ip_node_t& get_ip_node() const
+    {
+        return _ip_node;
+    }
+
+    ISender* get_sender() const
+    {
+        return _sender;
+    }
+
+    void set_sender(ISender* sender)
+    {
+        _sender = sender;
+    }
+
+    bool is_healthy() const
+    {
+        return atomic_read(&_healthy) != 0;
+    }
+
+    void set_healthy(bool healthy)
+    {
+        atomic_set(&_healthy, healthy? 1: 0);
+    }
+
+    /** 得到已推送但未发出的字节数，取自Sender的队列字节数，重发和断开时丢弃的消息都已计入 */
+    uint64_t get_outstanding_bytes() const
+    {
+        return _sender->get_queue_bytes();
+    }
+
+private:
+    ISender* _sender;
+    net::ip_node_t _ip_node;
+    atomic_t _healthy;
+};
+
+/***
+  * 组成员的应答处理器，
+  * 在转调用户的应答处理器的同时，更新成员的健康状态
+  */
+class CGroupReplyHandler: public IReplyHandler
+{
+public:
+    ~CGroupReplyHandler();
+    CGroupReplyHandler(CGroupMember* member, IReplyHandler* reply_handler);
+
+    /** 解除对用户应答处理器的持有，用于创建Sender失败时将其归还给调用者 */
+    void detach_reply_handler();
+
+private:
+    virtual void attach(ISender* sender);
+    virtual char* get_buffer();
+    virtual size_t get_buffer_length() const;
+    virtual size_t get_buffer_offset() const;
+    virtual void before_send();
+    virtual void send_completed();
+    virtual void send_progress(size_t total, size_t finished, size_t current);
+    virtual void sender_closed();
+    virtual bool sender_timeout();
+    virtual void sender_connected();
+    virtual void sender_connect_failure();
+    virtual util::handle_result_t handle_reply(size_t data_size);
+    virtual void queue_high_watermark();
+    virtual void queue_low_watermark();
+    virtual int get_state() const;
+    virtual void set_state(int state);
+
+private:
+    CGroupMember* _member;
+    IReplyHandler* _reply_handler;
+};
+
+class CSenderGroup: public ISenderGroup
+{
+public:
+    ~CSenderGroup();
+    CSenderGroup(IUnmanagedSenderTable* sender_table, select_policy_t select_policy);
+
+private: // ISenderGroup
+    virtual std::string str() const;
+    virtual select_policy_t get_select_policy() const;
+    virtual bool add_sender(const SenderInfo& sender_info);
+    virtual bool remove_sender(const net::ip_node_t& ip_node);
+    virtual uint16_t get_sender_number() const;
+    virtual uint16_t get_healthy_number() const;
+    virtual bool push_message(file_message_t* message, uint32_t milliseconds, uint32_t key);
+    virtual bool push_message(buffer_message_t* message, uint32_t milliseconds, uint32_t key);
+    virtual bool push_message(shared_message_t* message, uint32_t milliseconds, uint32_t key);
+
+private:
+    template <typename MessageType>
+    bool do_push_message(MessageType* message, uint32_t milliseconds, uint32_t key);
+
+    /***
+      * 按策略选择一个健康的成员，调用者须持有读锁
+      * @return 如果没有健康的成员，则返回-1，否则返回成员在_member_array中的下标
+      */
+    int select_member(uint32_t key);
+    int select_round_robin_member();
+    int select_least_bytes_member() const;
+    int select_consistent_hash_member(uint32_t key) const;
+
+    /** 成员增减后重建哈希环，调用者须持有写锁 */
+    void rebuild_hash_ring();
+
+private:
+    typedef std::pair<uint32_t, uint16_t> HashNode; // 哈希值和成员下标
+    IUnmanagedSenderTable* _sender_table;
+    select_policy_t _select_policy;
+    atomic_t _next_index; // 轮询的下一个成员
+    mutable sys::CReadWriteLock _lock;
+    std::vector<CGroupMember*> _member_array;
+    std::vector<HashNode> _hash_ring; // 按哈希值升序
 };
 
 DISPATCHER_NAMESPACE_END
@@ -0,0 +1,244 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <sstream>
+#include <util/hash_util.h>
+#include "sender_pool.h"
+#include "dispatcher_context.h"
+#include "default_reply_handler.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+//////////////////////////////////////////////////////////////////////////
+// CPooledSenderTable
+
+CPooledSenderTable::CPooledSenderTable(CDispatcherContext* context)
+    :CSenderTable(context)
+{
+}
+
+CUnmanagedSender* CPooledSenderTable::open_sender(const SenderInfo& sender_info, uint16_t thread_index)
+{
+    CUnmanagedSender* sender = new CUnmanagedSender(sender_info);
+    sys::LockHelper<sys::CLock> lock(_lock);
+
+    sender->inc_refcount();
+    sender->set_in_table(true);
+    sender->attach_sender_table(this);
+    sender->get_sender_info().reply_handler->attach(sender);
+
+    _sender_set.insert(sender);
+    get_context()->add_sender(sender, thread_index);
+
+    return sender;
+}
+
+void CPooledSenderTable::destroy_sender(CUnmanagedSender* sender)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+
+    if (sender->is_in_table())
+    {
+        sender->shutdown();
+        sender->set_in_table(false);
+        _sender_set.erase(sender);
+    }
+
+    (void)sender->dec_refcount();
+}
+
+void CPooledSenderTable::close_sender(CSender* sender)
+{
+    // 由发送线程调用，释放的是发送线程持有的引用，连接池持有的引用由destroy_sender释放
+    sys::LockHelper<sys::CLock> lock(_lock);
+
+    if (sender->is_in_table())
+    {
+        sender->set_in_table(false);
+        _sender_set.erase(sender);
+    }
+
+    (void)sender->dec_refcount();
+}
+
+void CPooledSenderTable::get_sender_stats(std::vector<SenderStats>& stats_array)
+{
+    sys::LockHelper<sys::CLock> lock(_lock);
+
+    for (std::set<CSender*>::const_iterator iter=_sender_set.begin(); iter!=_sender_set.end(); ++iter)
+    {
+        stats_array.push_back(SenderStats());
+        (*iter)->get_stats(stats_array.back());
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CSenderPool
+
+CSenderPool::~CSenderPool()
+{
+    for (std::vector<CUnmanagedSender*>::iterator iter=_sender_array.begin(); iter!=_sender_array.end(); ++iter)
+    {
+        _sender_table->destroy_sender(*iter);
+    }
+
+    _sender_array.clear();
+}
+
+CSenderPool::CSenderPool(CPooledSenderTable* sender_table, const net::ip_node_t& ip_node)
+    :_sender_table(sender_table)
+    ,_ip_node(ip_node)
+{
+    atomic_set(&_next_index, 0);
+}
+
+bool CSenderPool::open(const SenderInfo& sender_info, uint16_t sender_number, uint16_t first_thread_index, IReplyHandlerFactory* reply_handler_factory)
+{
+    if (!check_sender_info(sender_info)) return false;
+
+    SenderInfo pooled_sender_info = sender_info;
+    _sender_array.reserve(sender_number);
+
+    for (uint16_t i=0; i<sender_number; ++i)
+    {
+        // 每个连接须有自己的应答处理器，Sender被销毁时一同被删除
+        pooled_sender_info.key = i;
+        pooled_sender_info.reply_handler = (NULL == reply_handler_factory)? NULL: reply_handler_factory->create_reply_handler(i);
+        if (NULL == pooled_sender_info.reply_handler)
+            pooled_sender_info.reply_handler = new CDefaultReplyHandler;
+
+        _sender_array.push_back(_sender_table->open_sender(pooled_sender_info, first_thread_index+i));
+    }
+
+    return true;
+}
+
+std::string CSenderPool::str() const
+{
+    std::stringstream str;
+
+    str << "sender_pool://"
+        << _ip_node.ip.to_string()
+        << ":"
+        << _ip_node.port
+        << "*"
+        << _sender_array.size();
+
+    return str.str();
+}
+
+const net::ip_node_t& CSenderPool::get_ip_node() const
+{
+    return _ip_node;
+}
+
+uint16_t CSenderPool::get_sender_number() const
+{
+    return static_cast<uint16_t>(_sender_array.size());
+}
+
+bool CSenderPool::push_message(file_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(message, milliseconds);
+}
+
+bool CSenderPool::push_message(buffer_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(message, milliseconds);
+}
+
+bool CSenderPool::push_message(shared_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(message, milliseconds);
+}
+
+bool CSenderPool::push_message(uint32_t key, file_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(key, message, milliseconds);
+}
+
+bool CSenderPool::push_message(uint32_t key, buffer_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(key, message, milliseconds);
+}
+
+bool CSenderPool::push_message(uint32_t key, shared_message_t* message, uint32_t milliseconds)
+{
+    return do_push_message(key, message, milliseconds);
+}
+
+template <typename MessageType>
+bool CSenderPool::do_push_message(MessageType* message, uint32_t milliseconds)
+{
+    uint16_t sender_number = get_sender_number();
+    uint16_t selected = select_least_bytes_sender();
+
+    // 首选的连接可等待，其它的连接只做一次尝试
+    for (uint16_t i=0; i<sender_number; ++i)
+    {
+        CUnmanagedSender* sender = _sender_array[(selected+i) % sender_number];
+        if (!is_available(sender)) continue;
+
+        ISender* sender_ = sender;
+        if (sender_->push_message(message, (0 == i)? milliseconds: 0)) return true;
+    }
+
+    return false;
+}
+
+template <typename MessageType>
+bool CSenderPool::do_push_message(uint32_t key, MessageType* message, uint32_t milliseconds)
+{
+    // 打散后取模，避免连续的键值集中在少数连接上
+    uint64_t hash = util::mix_hash(key);
+    ISender* sender = _sender_array[hash % _sender_array.size()];
+
+    return sender->push_message(message, milliseconds);
+}
+
+uint16_t CSenderPool::select_least_bytes_sender()
+{
+    uint16_t sender_number = get_sender_number();
+    uint16_t start = static_cast<uint16_t>(static_cast<uint32_t>(atomic_add_return(1, &_next_index)) % sender_number);
+    uint16_t selected = start;
+    uint64_t least_bytes = 0;
+    bool found = false;
+
+    for (uint16_t i=0; i<sender_number; ++i)
+    {
+        uint16_t index = (start+i) % sender_number;
+        CUnmanagedSender* sender = _sender_array[index];
+        if (!is_available(sender)) continue;
+
+        uint64_t queue_bytes = sender->get_queue_bytes();
+        if (!found || (queue_bytes < least_bytes))
+        {
+            found = true;
+            selected = index;
+            least_bytes = queue_bytes;
+        }
+    }
+
+    return selected;
+}
+
+bool CSenderPool::is_available(CUnmanagedSender* sender)
+{
+    return sender->is_in_table() && !sender->is_circuit_open();
+}
+
+DISPATCHER_NAMESPACE_END
@@ -0,0 +1,105 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_SENDER_POOL_H
+#define MOOON_DISPATCHER_SENDER_POOL_H
+#include <set>
+#include <vector>
+#include <sys/lock.h>
+#include <sys/atomic.h>
+#include "sender_table.h"
+#include "unmanaged_sender.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+/***
+  * 连接池的Sender表，由分发器持有，所有连接池共用，
+  * 因为Sender可能晚于连接池被发送线程删除，所以表不能属于连接池
+  */
+class CDispatcherContext;
+class CPooledSenderTable: public CSenderTable
+{
+public:
+    CPooledSenderTable(CDispatcherContext* context);
+
+    /***
+      * 创建一个Sender并绑定到指定的发送线程，Sender引用计数增一，由调用者持有
+      * @thread_index: 发送线程的下标，超出时取模
+      */
+    CUnmanagedSender* open_sender(const SenderInfo& sender_info, uint16_t thread_index);
+
+    /** 关闭open_sender创建的Sender，并释放调用者持有的引用 */
+    void destroy_sender(CUnmanagedSender* sender);
+
+    virtual void get_sender_stats(std::vector<SenderStats>& stats_array);
+
+private: // CSenderTable
+    virtual void close_sender(CSender* sender);
+
+private:
+    sys::CLock _lock;
+    std::set<CSender*> _sender_set; // 只用于统计时遍历
+};
+
+/***
+  * 连接池，连接个数在创建后不变，所以选择连接时不需要锁
+  */
+class CSenderPool: public ISenderPool
+{
+public:
+    ~CSenderPool();
+    CSenderPool(CPooledSenderTable* sender_table, const net::ip_node_t& ip_node);
+
+    /***
+      * 建立sender_number个连接，发送线程从first_thread_index开始依次递增
+      * @return 如果sender_info无效，则返回false
+      */
+    bool open(const SenderInfo& sender_info, uint16_t sender_number, uint16_t first_thread_index, IReplyHandlerFactory* reply_handler_factory);
+
+private: // ISenderPool
+    virtual std::string str() const;
+    virtual const net::ip_node_t& get_ip_node() const;
+    virtual uint16_t get_sender_number() const;
+    virtual bool push_message(file_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(buffer_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(shared_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(uint32_t key, file_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(uint32_t key, buffer_message_t* message, uint32_t milliseconds);
+    virtual bool push_message(uint32_t key, shared_message_t* message, uint32_t milliseconds);
+
+private:
+    template <typename MessageType>
+    bool do_push_message(MessageType* message, uint32_t milliseconds);
+
+    template <typename MessageType>
+    bool do_push_message(uint32_t key, MessageType* message, uint32_t milliseconds);
+
+    /** 选择队列中字节数最少的可用连接，从轮询位置开始比较，使字节数相同时分散开 */
+    uint16_t select_least_bytes_sender();
+
+    /** 连接是否可用，被发送线程删除或熔断的不可用 */
+    static bool is_available(CUnmanagedSender* sender);
+
+private:
+    CPooledSenderTable* _sender_table;
+    net::ip_node_t _ip_node;
+    atomic_t _next_index;
+    std::vector<CUnmanagedSender*> _sender_array;
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_SENDER_POOL_H
@@ -0,0 +1,113 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <string.h>
+#include "sender_stats.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+uint64_t get_latency_percentile(const latency_histogram_t& histogram, double percentile)
+{
+    if (0 == histogram.count) return 0;
+
+    // 向上取整，保证P100落在最后一个有数据的桶
+    uint64_t rank = static_cast<uint64_t>(histogram.count * percentile / 100);
+    if (rank * 100 < histogram.count * percentile) ++rank;
+    if (0 == rank) rank = 1;
+
+    uint64_t count = 0;
+    for (int i=0; i<DISPATCHER_LATENCY_BUCKETS-1; ++i)
+    {
+        count += histogram.buckets[i];
+        if (count >= rank)
+        {
+            uint64_t upper_bound = (0 == i)? 0: (static_cast<uint64_t>(1) << i) - 1;
+            return (upper_bound < histogram.max_microseconds)? upper_bound: histogram.max_microseconds;
+        }
+    }
+
+    return histogram.max_microseconds;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CLatencyHistogram
+
+CLatencyHistogram::CLatencyHistogram()
+    :_count(0)
+    ,_total_microseconds(0)
+    ,_max_microseconds(0)
+{
+    for (int i=0; i<DISPATCHER_LATENCY_BUCKETS; ++i)
+        _buckets[i] = 0;
+}
+
+void CLatencyHistogram::record(uint64_t microseconds)
+{
+    // 桶的下标为有效位数，即[2^(i-1), 2^i)落在第i个桶
+    int index = (0 == microseconds)? 0: 64 - __builtin_clzll(microseconds);
+    if (index > DISPATCHER_LATENCY_BUCKETS-1)
+        index = DISPATCHER_LATENCY_BUCKETS-1;
+
+    // 单一写者，不需要原子操作
+    ++_buckets[index];
+    _total_microseconds += microseconds;
+    if (microseconds > _max_microseconds)
+        _max_microseconds = microseconds;
+    ++_count;
+}
+
+void CLatencyHistogram::get_snapshot(latency_histogram_t& histogram) const
+{
+    histogram.count = _count;
+    histogram.total_microseconds = _total_microseconds;
+    histogram.max_microseconds = _max_microseconds;
+    for (int i=0; i<DISPATCHER_LATENCY_BUCKETS; ++i)
+        histogram.buckets[i] = _buckets[i];
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CStatsObservable
+
+CStatsObservable::CStatsObservable(IDispatcher* dispatcher)
+    :_dispatcher(dispatcher)
+{
+}
+
+void CStatsObservable::on_report(observer::IDataReporter* data_reporter)
+{
+    _dispatcher->get_sender_stats(_stats_array);
+
+    for (std::vector<SenderStats>::size_type i=0; i<_stats_array.size(); ++i)
+    {
+        const SenderStats& stats = _stats_array[i];
+        data_reporter->report("dispatcher %s:%u key=%u connected=%d reconnect=%u"
+                              " queue_messages=%u queue_bytes=%"PRIu64
+                              " messages_out=%"PRIu64" bytes_out=%"PRIu64" bytes_in=%"PRIu64
+                              " first_byte_p50=%"PRIu64"us first_byte_p99=%"PRIu64"us"
+                              " complete_p50=%"PRIu64"us complete_p99=%"PRIu64"us"
+                              " connect_p99=%"PRIu64"us\n"
+            , stats.ip_node.ip.to_string().c_str(), stats.ip_node.port, stats.key
+            , stats.connected? 1: 0, stats.reconnect_number
+            , stats.queue_messages, stats.queue_bytes
+            , stats.messages_out, stats.bytes_out, stats.bytes_in
+            , get_latency_percentile(stats.first_byte_latency, 50), get_latency_percentile(stats.first_byte_latency, 99)
+            , get_latency_percentile(stats.complete_latency, 50), get_latency_percentile(stats.complete_latency, 99)
+            , get_latency_percentile(stats.connect_latency, 99));
+    }
+}
+
+DISPATCHER_NAMESPACE_END
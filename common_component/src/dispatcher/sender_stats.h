@@ -0,0 +1,62 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_DISPATCHER_SENDER_STATS_H
+#define MOOON_DISPATCHER_SENDER_STATS_H
+#include "dispatcher/dispatcher.h"
+DISPATCHER_NAMESPACE_BEGIN
+
+/***
+  * 延迟直方图，只由发送线程写，其它线程可无锁读取快照
+  */
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram();
+
+    /** 记录一次延迟，只能在发送线程中调用 */
+    void record(uint64_t microseconds);
+
+    /** 读取快照，可在任意线程中调用 */
+    void get_snapshot(latency_histogram_t& histogram) const;
+
+private:
+    volatile uint64_t _count;
+    volatile uint64_t _total_microseconds;
+    volatile uint64_t _max_microseconds;
+    volatile uint64_t _buckets[DISPATCHER_LATENCY_BUCKETS];
+};
+
+/***
+  * 统计的可观察者，每次上报时对所有Sender做快照，每个Sender上报一行
+  */
+class CStatsObservable: public observer::IObservable
+{
+public:
+    CStatsObservable(IDispatcher* dispatcher);
+
+private:
+    virtual void on_report(observer::IDataReporter* data_reporter);
+
+private:
+    IDispatcher* _dispatcher;
+    std::vector<SenderStats> _stats_array; // 重用以免每次上报都分配内存
+};
+
+DISPATCHER_NAMESPACE_END
+#endif // MOOON_DISPATCHER_SENDER_STATS_H
@@ -34,6 +34,9 @@ public:
     CSenderTable(CDispatcherContext* context);
     virtual void close_sender(CSender* sender) = 0; 
 
+    /** Senderͳƿ׷ӵstats_array */
+    virtual void get_sender_stats(std::vector<SenderStats>& stats_array) = 0;
+
 protected:
     CDispatcherContext* get_context();
 
@@ -46,12 +46,11 @@ ISender* CUnmanagedSenderTable::open_sender(const SenderInfo& sender_info)
         return NULL;
     }
 
-    sys::LockHelper<sys::CLock> lock(_lock);
-    std::pair<SenderMap::iterator, bool> retval;
+    Shard& shard = get_shard(sender_info.ip_node);
+    sys::LockHelper<sys::CLock> lock(shard.lock);
     CUnmanagedSender* sender = new CUnmanagedSender(sender_info);
     
-    retval = _sender_map.insert(std::make_pair(sender_info.ip_node, sender));
-    if (!retval.second)
+    if (!shard.sender_map.insert(sender_info.ip_node, sender))
     {
         delete sender;
         sender = NULL;
@@ -75,13 +74,14 @@ void CUnmanagedSenderTable::close_sender(ISender* sender)
     CUnmanagedSender* sender_ = static_cast<CUnmanagedSender*>(sender);
     const SenderInfo& sender_info = sender->get_sender_info();
     net::ip_node_t ip_node = sender_info.ip_node;
-    sys::LockHelper<sys::CLock> lock(_lock);    
+    Shard& shard = get_shard(ip_node);
+    sys::LockHelper<sys::CLock> lock(shard.lock);    
     
     if (sender_->is_in_table())
     {
         sender_->shutdown();
         sender_->set_in_table(false);
-        _sender_map.erase(ip_node);        
+        shard.sender_map.erase(ip_node);        
     }
     
     (void)sender_->dec_refcount();    
@@ -92,13 +92,14 @@ void CUnmanagedSenderTable::release_sender(ISender* sender)
     CUnmanagedSender* sender_ = static_cast<CUnmanagedSender*>(sender);    
     const SenderInfo& sender_info = sender->get_sender_info();
     net::ip_node_t ip_node = sender_info.ip_node;
-    sys::LockHelper<sys::CLock> lock(_lock);
+    Shard& shard = get_shard(ip_node);
+    sys::LockHelper<sys::CLock> lock(shard.lock);
 
     if (sender_->is_in_table() && sender_->dec_refcount())
     {        
         // Ϊߵ˵SenderѾdeleted
         // ûҪsender_->set_in_table(false);
-        _sender_map.erase(ip_node);
+        shard.sender_map.erase(ip_node);
     }
 }
 
@@ -107,12 +108,13 @@ void CUnmanagedSenderTable::remove_sender(ISender* sender)
     CUnmanagedSender* sender_ = static_cast<CUnmanagedSender*>(sender);   
     const SenderInfo& sender_info = sender->get_sender_info();
     net::ip_node_t ip_node = sender_info.ip_node;
-    sys::LockHelper<sys::CLock> lock(_lock);
+    Shard& shard = get_shard(ip_node);
+    sys::LockHelper<sys::CLock> lock(shard.lock);
 
     if (sender_->is_in_table())
     {
         sender_->set_in_table(false);
-        _sender_map.erase(ip_node);
+        shard.sender_map.erase(ip_node);
     }
 
     (void)sender_->dec_refcount();    
@@ -120,30 +122,73 @@ void CUnmanagedSenderTable::remove_sender(ISender* sender)
 
 ISender* CUnmanagedSenderTable::get_sender(const net::ip_node_t& ip_node)
 {
-    sys::LockHelper<sys::CLock> lock(_lock);
+    Shard& shard = get_shard(ip_node);
+    sys::LockHelper<sys::CLock> lock(shard.lock);
     CUnmanagedSender* sender_ = NULL;
 
-    SenderMap::iterator iter = _sender_map.find(ip_node);
-    if (iter != _sender_map.end())
+    CUnmanagedSender** sender_ptr = shard.sender_map.find(ip_node);
+    if (sender_ptr != NULL)
     {
-        sender_ = iter->second;
+        sender_ = *sender_ptr;
         sender_->inc_refcount();
     }
 
     return sender_;
 }
 
-void CUnmanagedSenderTable::clear_sender()
+CUnmanagedSenderTable::Shard& CUnmanagedSenderTable::get_shard(const net::ip_node_t& ip_node)
 {
-    sys::LockHelper<sys::CLock> lock(_lock);
+    // ôɢĸλѡƬƬڵĹϣõλ߻
+    uint64_t hash = util::mix_hash(net::ip_node_hasher()(ip_node));
+    return _shards[hash >> (64 - SHARD_BITS)];
+}
 
-    while (!_sender_map.empty())
+/** ԱSenderüһ */
+struct SenderReleaser
+{
+    void operator ()(const net::ip_node_t& ip_node, CUnmanagedSender* sender)
     {
-        SenderMap::iterator iter = _sender_map.begin();
-        CUnmanagedSender* sender = iter->second;
-
         sender->dec_refcount();
-        _sender_map.erase(iter);
+    }
+};
+
+/** ԱеSenderͳƿ */
+struct SenderStatsCollector
+{
+    SenderStatsCollector(std::vector<SenderStats>& stats_array_)
+        :stats_array(stats_array_)
+    {
+    }
+
+    void operator ()(const net::ip_node_t& ip_node, CUnmanagedSender* sender)
+    {
+        stats_array.push_back(SenderStats());
+        sender->get_stats(stats_array.back());
+    }
+
+    std::vector<SenderStats>& stats_array;
+};
+
+void CUnmanagedSenderTable::get_sender_stats(std::vector<SenderStats>& stats_array)
+{
+    SenderStatsCollector sender_stats_collector(stats_array);
+
+    for (int i=0; i<SHARD_NUMBER; ++i)
+    {
+        sys::LockHelper<sys::CLock> lock(_shards[i].lock);
+        _shards[i].sender_map.for_each(sender_stats_collector);
+    }
+}
+
+void CUnmanagedSenderTable::clear_sender()
+{
+    SenderReleaser sender_releaser;
+
+    for (int i=0; i<SHARD_NUMBER; ++i)
+    {
+        sys::LockHelper<sys::CLock> lock(_shards[i].lock);
+        _shards[i].sender_map.for_each(sender_releaser);
+        _shards[i].sender_map.clear();
     }
 }
 
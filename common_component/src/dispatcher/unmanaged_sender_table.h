@@ -18,18 +18,25 @@
  */
 #ifndef MOOON_DISPATCHER_UNMANAGED_SENDER_TABLE_H
 #define MOOON_DISPATCHER_UNMANAGED_SENDER_TABLE_H
+#include <sys/lock.h>
 #include <net/ip_node.h>
-#include <util/hash_map.h>
+#include <util/open_hash_map.h>
 #include "sender_table.h"
 #include "unmanaged_sender.h"
 DISPATCHER_NAMESPACE_BEGIN
 
 class CDispatcherContext;
+
+/***
+  * 按ip_node分片的Sender表，每个分片一把锁和一个开放寻址的哈希表，
+  * 不同对端的get_sender和release_sender分散在不同分片上，互不竞争
+  */
 class CUnmanagedSenderTable: public IUnmanagedSenderTable, public CSenderTable
 {
 public:
     ~CUnmanagedSenderTable();
     CUnmanagedSenderTable(CDispatcherContext* context);    
+    virtual void get_sender_stats(std::vector<SenderStats>& stats_array);
     
 private: // CSenderTable
     virtual void close_sender(CSender* sender);
@@ -42,12 +49,25 @@ private: // IUnmanagedSenderTable
     virtual ISender* get_sender(const net::ip_node_t& ip_node);  
     
 private:
+    typedef util::COpenHashMap<net::ip_node_t, CUnmanagedSender*, net::ip_node_hasher, net::ip_node_comparer> SenderMap;
+    struct Shard
+    {
+        sys::CLock lock;
+        SenderMap sender_map;
+        char padding[64]; // 避免相邻分片的锁落在同一个缓存行
+    };
+
+    enum
+    {
+        SHARD_BITS = 6, // 用哈希值的最高SHARD_BITS位选分片
+        SHARD_NUMBER = 1 << SHARD_BITS
+    };
+
+    Shard& get_shard(const net::ip_node_t& ip_node);
     void clear_sender();
 
 private:
-    typedef net::ip_hash_map<CUnmanagedSender*> SenderMap;
-    sys::CLock _lock;
-    SenderMap _sender_map;
+    Shard _shards[SHARD_NUMBER];
 };
 
 DISPATCHER_NAMESPACE_END
@@ -0,0 +1,203 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: JianYi, eyjian@qq.com
+ */
+#include <sstream>
+#include "buffer_pool.h"
+#include "log.h"
+SERVER_NAMESPACE_BEGIN
+
+#define BUFFER_MAGIC 0x4D4F4F4E /* MOON */
+#define HEAP_SIZE_CLASS 0xFFFFFFFF
+
+// 各级Buffer的大小，不包含头
+const uint32_t CBufferPool::_class_size[SIZE_CLASS_NUMBER] = { 256, 1024, 4096, 16384 };
+
+// 每个server线程绑定的缓冲池
+static __thread CBufferPool* tls_buffer_pool = NULL;
+
+CBufferPool::CBufferPool()
+    :_created(false)
+    ,_bucket_number(0)
+    ,_remote_head(NULL)
+    ,_hit_number(0)
+    ,_miss_number(0)
+    ,_oversize_number(0)
+    ,_remote_number(0)
+{
+}
+
+CBufferPool::~CBufferPool()
+{
+    destroy();
+}
+
+void CBufferPool::create(uint32_t bucket_number)
+{
+    _owner_thread = pthread_self();
+    tls_buffer_pool = this;
+    
+    _bucket_number = bucket_number;
+    _created = bucket_number > 0;
+}
+
+void CBufferPool::destroy()
+{
+    if (tls_buffer_pool == this)
+        tls_buffer_pool = NULL;
+    
+    if (_created)
+    {
+        _created = false;
+        reclaim_remote();
+        for (int i=0; i<SIZE_CLASS_NUMBER; ++i)
+            _mem_pool[i].destroy();
+    }
+}
+
+char* CBufferPool::borrow(size_t size)
+{
+    if (!_created) return heap_allocate(size);
+    
+    for (uint32_t i=0; i<SIZE_CLASS_NUMBER; ++i)
+    {
+        if (size > _class_size[i]) continue;
+        
+        if (_remote_head != NULL)
+            reclaim_remote();
+        if (0 == _mem_pool[i].get_pool_size())
+        {
+            // 不从CRawMemPool的堆上分配，池借完时由borrow自己从堆上分配并打上标记
+            _mem_pool[i].create(_class_size[i]+BUFFER_HEADER_SIZE, _bucket_number, false, 0);
+        }
+
+        char* bucket = static_cast<char*>(_mem_pool[i].allocate());
+        if (NULL == bucket)
+        {
+            ++_miss_number;
+            return heap_allocate(size);
+        }
+
+        BufferHeader* header = reinterpret_cast<BufferHeader*>(bucket);
+        header->pool = this;
+        header->size_class = i;
+        header->magic = BUFFER_MAGIC;
+
+        ++_hit_number;
+        return bucket + BUFFER_HEADER_SIZE;
+    }
+
+    ++_oversize_number;
+    return heap_allocate(size);
+}
+
+void CBufferPool::give_back(char* buffer)
+{
+    if (NULL == buffer) return;
+
+    BufferHeader* header = reinterpret_cast<BufferHeader*>(buffer - BUFFER_HEADER_SIZE);
+    if (header->magic != BUFFER_MAGIC)
+    {
+        SERVER_LOG_ERROR("Invalid buffer %p returned.\n", buffer);
+        return;
+    }
+    if (NULL == header->pool)
+    {
+        delete [](char*)header;
+        return;
+    }
+
+    CBufferPool* pool = header->pool;
+    if (pthread_equal(pool->_owner_thread, pthread_self()))
+    {
+        pool->reclaim(header);
+    }
+    else
+    {
+        // 压入借出线程的无锁栈
+        BufferHeader* old_head;
+        do
+        {
+            old_head = pool->_remote_head;
+            *reinterpret_cast<BufferHeader**>(buffer) = old_head;
+        } while (!__sync_bool_compare_and_swap(&pool->_remote_head, old_head, header));
+
+        __sync_add_and_fetch(&pool->_remote_number, 1);
+    }
+}
+
+CBufferPool* CBufferPool::get_thread_buffer_pool()
+{
+    return tls_buffer_pool;
+}
+
+std::string CBufferPool::to_string() const
+{
+    std::stringstream ss;
+    ss << "buffer_pool://"
+       << _hit_number << "|"
+       << _miss_number << "|"
+       << _oversize_number << "|"
+       << _remote_number;
+
+    return ss.str();
+}
+
+void CBufferPool::reclaim(BufferHeader* header)
+{
+    header->magic = 0; // 防止重复归还
+    _mem_pool[header->size_class].reclaim(header);
+}
+
+void CBufferPool::reclaim_remote()
+{
+    // 一次取走整个栈
+    BufferHeader* header = __sync_lock_test_and_set(&_remote_head, (BufferHeader*)NULL);
+    while (header != NULL)
+    {
+        char* buffer = reinterpret_cast<char*>(header) + BUFFER_HEADER_SIZE;
+        BufferHeader* next = *reinterpret_cast<BufferHeader**>(buffer);
+        
+        reclaim(header);
+        header = next;
+    }
+}
+
+char* CBufferPool::heap_allocate(size_t size)
+{
+    char* bucket = new char[size + BUFFER_HEADER_SIZE];
+    BufferHeader* header = reinterpret_cast<BufferHeader*>(bucket);
+    
+    header->pool = NULL;
+    header->size_class = HEAP_SIZE_CLASS;
+    header->magic = BUFFER_MAGIC;
+    return bucket + BUFFER_HEADER_SIZE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+char* borrow_buffer(size_t size)
+{
+    CBufferPool* buffer_pool = CBufferPool::get_thread_buffer_pool();
+    return (NULL == buffer_pool)? CBufferPool::heap_allocate(size): buffer_pool->borrow(size);
+}
+
+void return_buffer(char* buffer)
+{
+    CBufferPool::give_back(buffer);
+}
+
+SERVER_NAMESPACE_END
@@ -0,0 +1,91 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: JianYi, eyjian@qq.com
+ */
+#ifndef MOOON_SERVER_BUFFER_POOL_INTERNAL_H
+#define MOOON_SERVER_BUFFER_POOL_INTERNAL_H
+#include <pthread.h>
+#include <sys/mem_pool.h>
+#include "server/buffer_pool.h"
+SERVER_NAMESPACE_BEGIN
+
+/***
+  * 按大小分级的Buffer池，每个server线程一个
+  * 每级是一个CRawMemPool，借出和本线程归还都不加锁，
+  * 其它线程归还的Buffer放入一个无锁栈中，由本线程在下次借时回收
+  * 每块Buffer前有一个头，记录所属的池和级别
+  */
+class CBufferPool
+{
+public:
+    CBufferPool();
+    ~CBufferPool();
+
+    /***
+      * 创建缓冲池，并绑定到调用线程，必须在使用缓冲池的线程中调用
+      * 借出的Buffer须在缓冲池销毁前归还
+      * @bucket_number: 每级的Buffer个数，为0时不使用缓冲池，总是从堆上分配，
+      *                 各级在第一次借时才分配内存
+      */
+    void create(uint32_t bucket_number);
+    void destroy();
+
+    char* borrow(size_t size);
+    static void give_back(char* buffer);
+    /** 从堆上分配一块带头的Buffer，同样由give_back释放 */
+    static char* heap_allocate(size_t size);
+
+    /** 得到当前线程绑定的缓冲池，如果不是server线程则返回NULL */
+    static CBufferPool* get_thread_buffer_pool();
+
+    uint64_t get_hit_number() const { return _hit_number; }
+    uint64_t get_miss_number() const { return _miss_number; }
+    uint64_t get_oversize_number() const { return _oversize_number; }
+    std::string to_string() const;
+
+private:
+    struct BufferHeader
+    {
+        CBufferPool* pool;   // 所属的池，为NULL表示从堆上分配
+        uint32_t size_class; // 所属的级别
+        uint32_t magic;      // 用来检查是否为borrow借出的Buffer
+    };
+
+    void reclaim(BufferHeader* header);
+    void reclaim_remote();
+    
+private:
+    enum
+    {
+        SIZE_CLASS_NUMBER = 4,
+        BUFFER_HEADER_SIZE = 16 // 保持数据部分16字节对齐
+    };
+    
+    static const uint32_t _class_size[SIZE_CLASS_NUMBER];
+    sys::CRawMemPool _mem_pool[SIZE_CLASS_NUMBER];
+    bool _created;
+    uint32_t _bucket_number;
+    pthread_t _owner_thread;
+    BufferHeader* volatile _remote_head; // 其它线程归还的Buffer，以数据部分的首个指针链接
+    uint64_t _hit_number;      // 从池中借到的次数
+    uint64_t _miss_number;     // 对应级别已借完，从堆上分配的次数
+    uint64_t _oversize_number; // 超出最大级别，从堆上分配的次数
+    volatile uint64_t _remote_number; // 其它线程归还的次数
+};
+
+SERVER_NAMESPACE_END
+#endif // MOOON_SERVER_BUFFER_POOL_INTERNAL_H
@@ -17,12 +17,14 @@
  * Author: jian yi, eyjian@qq.com
  */
 #include "builtin_packet_handler.h"
+#include "buffer_pool.h"
 #include "log.h"
 SERVER_NAMESPACE_BEGIN
 
 CBuiltinPacketHandler::CBuiltinPacketHandler(IConnection* connection, IMessageObserver* message_observer)
  :_connection(connection)
  ,_message_observer(message_observer)
+ ,_use_buffer_pool(message_observer->use_buffer_pool())
  ,_recv_machine(this)
 {
     _request_context.request_size = sizeof(_request_header);
@@ -46,6 +48,8 @@ bool CBuiltinPacketHandler::on_header(const net::TCommonMessageHeader& header)
     _request_context.request_offset = 0;
     if (0 == size)
         _request_context.request_buffer = NULL;
+    else if (_use_buffer_pool)
+        _request_context.request_buffer = borrow_buffer(size);
     else
         _request_context.request_buffer = new char[size];
 
@@ -69,13 +73,19 @@ bool CBuiltinPacketHandler::on_message(
         }
 
         // 防止on_message()抛异常
-        const char* request_buffer = _request_context.request_buffer;
+        char* request_buffer = _request_context.request_buffer;
         _request_context.request_buffer = NULL;
 
-        if (!_message_observer->on_message(header
+        bool success = _message_observer->on_message(header
                                         , request_buffer
                                         , &_response_context.response_buffer
-                                        , &_response_context.response_size))
+                                        , &_response_context.response_size);
+        if (_use_buffer_pool)
+        {
+            // 使用缓冲池时，请求由框架归还
+            return_buffer(request_buffer);
+        }
+        if (!success)
         {
             SERVER_LOG_DEBUG("%s on_message ERROR.\n", _connection->str().c_str());
             return false;
@@ -100,13 +110,21 @@ void CBuiltinPacketHandler::reset()
     // 复位请求参数
     char* request_buffer= reinterpret_cast<char*>(&_request_header);
     if (_request_context.request_buffer != request_buffer)
-        delete []_request_context.request_buffer;
+    {
+        if (_use_buffer_pool)
+            return_buffer(_request_context.request_buffer);
+        else
+            delete []_request_context.request_buffer;
+    }
     _request_context.request_buffer = reinterpret_cast<char*>(&_request_header);
     _request_context.request_size = sizeof(_request_header);
     _request_context.request_offset = 0;
 
     // 复位响应参数
-    delete []_response_context.response_buffer;
+    if (_use_buffer_pool)
+        return_buffer(_response_context.response_buffer);
+    else
+        delete []_response_context.response_buffer;
     _response_context.response_buffer = NULL;
     _response_context.response_size = 0;
     _response_context.response_offset = 0;
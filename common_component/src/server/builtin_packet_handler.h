@@ -52,6 +52,7 @@ private:
 private:
     IConnection* _connection;
     IMessageObserver* _message_observer;
+    bool _use_buffer_pool;
     net::TCommonMessageHeader _request_header;
     net::CRecvMachine<net::TCommonMessageHeader, CBuiltinPacketHandler> _recv_machine;
 };
@@ -55,6 +55,7 @@ CContext::~CContext()
 CContext::CContext(IConfig* config, IFactory* factory)
     :_config(config)
     ,_factory(factory)
+    ,_reuse_port(false)
 {
 }
 
@@ -104,6 +105,50 @@ CWorkThread* CContext::get_thread(uint16_t thread_index) const
     return _thread_pool.get_thread(thread_index);
 }
 
+uint16_t CContext::select_balance_thread(uint16_t hot_index) const
+{
+    uint16_t thread_count = _thread_pool.get_thread_count();
+    CWorkThread** thread_array = _thread_pool.get_thread_array();
+    uint64_t waiter_number = 0;
+    uint64_t kbytes_per_second = 0;
+    uint64_t busy_permille = 0;
+    
+    for (uint16_t i=0; i<thread_count; ++i)
+    {
+        const ThreadLoad& load = thread_array[i]->get_load();
+        waiter_number += atomic_read(&load.waiter_number);
+        kbytes_per_second += atomic_read(&load.kbytes_per_second);
+        busy_permille += atomic_read(&load.busy_permille);
+    }
+
+    // 每项指标都按平均值折算成百分比后相加，平均负载的线程得分为300
+    uint16_t cold_index = hot_index;
+    uint64_t cold_score = 0;
+    uint64_t hot_score = 0;
+    for (uint16_t i=0; i<thread_count; ++i)
+    {
+        const ThreadLoad& load = thread_array[i]->get_load();
+        uint64_t score = 0;
+        score += (0 == waiter_number)? 100: (uint64_t)atomic_read(&load.waiter_number) * 100 * thread_count / waiter_number;
+        score += (0 == kbytes_per_second)? 100: (uint64_t)atomic_read(&load.kbytes_per_second) * 100 * thread_count / kbytes_per_second;
+        score += (0 == busy_permille)? 100: (uint64_t)atomic_read(&load.busy_permille) * 100 * thread_count / busy_permille;
+        
+        if (i == hot_index)
+        {
+            hot_score = score;
+        }
+        else if ((cold_index == hot_index) || (score < cold_score))
+        {
+            cold_index = i;
+            cold_score = score;
+        }
+    }
+
+    if (hot_score * 100 < 300 * (100 + (uint64_t)_config->get_balance_threshold_percent())) return hot_index;
+    if (cold_score >= 300) return hot_index;
+    return cold_index;
+}
+
 bool CContext::IgnorePipeSignal()
 {
     // 忽略PIPE信号
@@ -138,8 +183,30 @@ bool CContext::create_listen_manager()
 		               , listen_parameter[i].second);
     }
 
-	_listen_manager.create(true);
-	SERVER_LOG_INFO("Created listen manager success.\n");
+    _reuse_port = (listen_reuseport == _config->get_listen_mode());
+    if (!_reuse_port)
+    {
+        _listen_manager.create(true);
+    }
+    else
+    {
+        try
+        {
+            // 这组监听归0号线程所有，其它线程在before_start中创建自己的监听
+            _listen_manager.create(true, true);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            // 内核不支持SO_REUSEPORT，退回到共享监听模式
+            if (ex.get_errcode() != ENOPROTOOPT) throw;
+
+            _reuse_port = false;
+            SERVER_LOG_WARN("SO_REUSEPORT not supported, fall back to shared listeners.\n");
+            _listen_manager.create(true);
+        }
+    }
+
+	SERVER_LOG_INFO("Created listen manager success, reuse port: %s.\n", _reuse_port? "true": "false");
     
     return true;
 }
@@ -153,6 +220,13 @@ bool CContext::create_thread_pool(net::CListenManager<CListener>* listen_manager
         return false;
     }
 
+    // 计算各线程绑定的CPU
+    if (!_cpu_placement.create(_config->get_placement_policy(), _config->get_placement_cpus().c_str()))
+    {
+        SERVER_LOG_ERROR("Invalid placement cpus: %s.\n", _config->get_placement_cpus().c_str());
+        return false;
+    }
+
 	// 创建线程池
 	_thread_pool.create(_config->get_thread_number(), this);	
 
@@ -162,6 +236,9 @@ bool CContext::create_thread_pool(net::CListenManager<CListener>* listen_manager
 	// 设置线程运行时参数
 	for (uint16_t i=0; i<thread_count; ++i)
 	{
+		// SO_REUSEPORT模式下，除0号线程外，其它线程已在before_start中注册了自己的监听
+		if (_reuse_port && (i > 0)) continue;
+
 		uint16_t listen_count = listen_manager->get_listener_count();
 		CListener* listener_array = listen_manager->get_listener_array();
 		
@@ -38,9 +38,17 @@ public:
 public:
     IConfig* get_config() const { return _config; }
     IFactory* get_factory() const { return _factory; }
+    bool is_reuse_port() const { return _reuse_port; }
+    const sys::CCpuPlacement& get_cpu_placement() const { return _cpu_placement; }
     CWorkThread* get_thread(uint16_t thread_index);
     CWorkThread* get_thread(uint16_t thread_index) const;
 
+    /***
+      * 根据各线程的负载，为hot_index线程选择迁入连接的线程
+      * @return: hot_index线程不是热点，或者没有负载低于平均的线程时，返回hot_index
+      */
+    uint16_t select_balance_thread(uint16_t hot_index) const;
+
 private:
     bool IgnorePipeSignal();
     bool create_listen_manager();
@@ -49,6 +57,8 @@ private:
 private:
     IConfig* _config;
     IFactory* _factory;   
+    bool _reuse_port; // 是否为每个线程独立的SO_REUSEPORT监听
+    sys::CCpuPlacement _cpu_placement; // 各线程绑定的CPU
     sys::CThreadPool<CWorkThread> _thread_pool;
     net::CListenManager<CListener> _listen_manager;    
 };
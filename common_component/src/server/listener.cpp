@@ -24,27 +24,40 @@ SERVER_NAMESPACE_BEGIN
 
 net::epoll_event_t CListener::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
 {           
-    try
+    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+    uint32_t accept_batch_size = thread->get_accept_batch_size();
+    uint32_t accept_number = 0;
+
+    // 一次唤醒尽量多accept，直到无新连接或达到上限，以减少epoll_wait的次数
+    while (accept_number < accept_batch_size)
     {
-        net::port_t peer_port;
-        net::ip_address_t peer_ip;
-        
-        int newfd = accept(peer_ip, peer_port);
-        if (newfd != -1)
+        try
         {
-            CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+            net::port_t peer_port;
+            net::ip_address_t peer_ip;
+
+            // 直接得到非阻塞的新连接，不用再调用fcntl
+            int newfd = accept(peer_ip, peer_port, SOCK_NONBLOCK|SOCK_CLOEXEC);
+            if (-1 == newfd)
+            {
+                break; // 没有新连接了
+            }
+
+            ++accept_number;
             if (!thread->add_waiter(newfd, peer_ip, peer_port, get_listen_ip(), get_listen_port()))
             {
                 net::close_fd(newfd);
             }
         }
-    }
-    catch (sys::CSyscallException& ex)
-    {
-		// 对于某些server，这类信息巨大，如webserver
-        SERVER_LOG_ERROR("Accept error: %s.\n", ex.to_string().c_str());            
+        catch (sys::CSyscallException& ex)
+        {
+		    // 对于某些server，这类信息巨大，如webserver
+            SERVER_LOG_ERROR("Accept error: %s.\n", ex.to_string().c_str());            
+            break;
+        }
     }
     
+    thread->on_accepted(accept_number);
     return net::epoll_none;
 }
 
@@ -0,0 +1,313 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <algorithm>
+#include "pipeline_packet_handler.h"
+#include "buffer_pool.h"
+#include "log.h"
+SERVER_NAMESPACE_BEGIN
+
+// 接收缓冲区大小，刚好使用缓冲池的4K级
+#define PIPELINE_BUFFER_SIZE 4096
+
+static void release_heap_response(ResponseSegment* segment)
+{
+    delete [](char*)segment->buffer;
+}
+
+static void release_pooled_response(ResponseSegment* segment)
+{
+    return_buffer((char*)segment->buffer);
+}
+
+CPipelinePacketHandler::CPipelinePacketHandler(IConnection* connection, IMessageObserver* message_observer, uint16_t pipeline_depth)
+ :_connection(connection)
+ ,_message_observer(message_observer)
+ ,_use_buffer_pool(message_observer->use_buffer_pool())
+ ,_pipeline_depth(pipeline_depth)
+ ,_recv_buffer(NULL)
+ ,_recv_size(0)
+ ,_header_ready(false)
+ ,_body_direct(false)
+ ,_request_body(NULL)
+ ,_body_offset(0)
+ ,_response_number(0)
+{
+    _segments = new ResponseSegment[_pipeline_depth];
+    prepare_receive();
+}
+
+CPipelinePacketHandler::~CPipelinePacketHandler()
+{
+    delete _message_observer;
+    reset();
+    delete []_segments;
+}
+
+void CPipelinePacketHandler::reset()
+{
+    // 积压的响应总是已设置为响应链，如果连接关闭时框架已释放，这里不会重复释放
+    _response_context.release_segments();
+    _response_context.reset();
+    _response_number = 0;
+
+    // 未收完的请求
+    if (_header_ready)
+        free_buffer(_request_body);
+    _request_body = NULL;
+    _header_ready = false;
+    _body_offset = 0;
+
+    // 连接空闲时不占用接收缓冲区
+    return_buffer(_recv_buffer);
+    _recv_buffer = NULL;
+    _recv_size = 0;
+    prepare_receive();
+}
+
+util::handle_result_t CPipelinePacketHandler::on_handle_request(size_t data_size, Indicator& indicator)
+{
+    SERVER_LOG_TRACE("enter %s.\n", __FUNCTION__);
+
+    if (NULL == _recv_buffer)
+    {
+        // 首次接收的数据在_request_header中，移到接收缓冲区
+        _recv_size = data_size;
+        _recv_buffer = borrow_buffer(PIPELINE_BUFFER_SIZE);
+        memcpy(_recv_buffer, &_request_header, _recv_size);
+    }
+    else if (_body_direct)
+    {
+        _body_offset += data_size;
+    }
+    else
+    {
+        _recv_size += data_size;
+    }
+
+    if (!parse())
+        return util::handle_error;
+
+    prepare_receive();
+    if (0 == _response_number)
+        return util::handle_continue;
+
+    // 本次收到的请求都已处理，合并发送它们的响应
+    flush_responses();
+    return util::handle_finish;
+}
+
+void CPipelinePacketHandler::on_connection_closed()
+{
+    _message_observer->on_connection_closed();
+}
+
+bool CPipelinePacketHandler::on_connection_timeout()
+{
+    return _message_observer->on_connection_timeout();
+}
+
+util::handle_result_t CPipelinePacketHandler::on_response_completed(Indicator& indicator)
+{
+    // 接收缓冲区中可能还有未处理的请求，不能复位
+    indicator.reset = false;
+
+    // 框架已调用release_response_segments释放了各响应
+    uint16_t response_number = _response_number;
+    _response_number = 0;
+    _response_context.reset();
+
+    for (uint16_t i=0; i<response_number; ++i)
+    {
+        util::handle_result_t handle_result = _message_observer->on_response_completed();
+        if (util::handle_error == handle_result)
+            return util::handle_error;
+        if (handle_result != util::handle_continue)
+            return util::handle_close;
+    }
+
+    // 继续处理因积压而暂停解析的请求
+    if (!parse())
+        return util::handle_error;
+
+    prepare_receive();
+    if (_response_number > 0)
+    {
+        flush_responses();
+        indicator.epoll_events = EPOLLOUT;
+    }
+
+    return util::handle_continue;
+}
+
+bool CPipelinePacketHandler::parse()
+{
+    bool success = true;
+    size_t offset = 0;
+    uint16_t response_number = _response_number;
+
+    while (_response_number < _pipeline_depth)
+    {
+        if (!_header_ready)
+        {
+            if (_recv_size - offset < sizeof(_request_header))
+                break;
+
+            memcpy(&_request_header, _recv_buffer+offset, sizeof(_request_header));
+            offset += sizeof(_request_header);
+
+            uint32_t size = _request_header.size.to_int();
+            if (0 == size)
+                _request_body = NULL;
+            else if (_use_buffer_pool)
+                _request_body = borrow_buffer(size);
+            else
+                _request_body = new char[size];
+
+            _body_offset = 0;
+            _header_ready = true;
+        }
+
+        size_t body_size = _request_header.size.to_int();
+        size_t copy_size = std::min(body_size-_body_offset, _recv_size-offset);
+        if (copy_size > 0)
+        {
+            memcpy(_request_body+_body_offset, _recv_buffer+offset, copy_size);
+            _body_offset += copy_size;
+            offset += copy_size;
+        }
+        if (_body_offset < body_size)
+            break;
+
+        if (!dispatch_message())
+        {
+            // 本次解析出的响应还未设置为响应链，框架不会释放它们
+            release_responses(response_number);
+            success = false;
+            break;
+        }
+    }
+
+    // 未处理的数据移到接收缓冲区的开头
+    if (offset > 0)
+    {
+        _recv_size -= offset;
+        memmove(_recv_buffer, _recv_buffer+offset, _recv_size);
+    }
+
+    return success;
+}
+
+bool CPipelinePacketHandler::dispatch_message()
+{
+    // 防止on_message()抛异常
+    char* request_body = _request_body;
+    _request_body = NULL;
+    _header_ready = false;
+
+    char* response_buffer = NULL;
+    size_t response_size = 0;
+    bool success = _message_observer->on_message(_request_header
+                                                , request_body
+                                                , &response_buffer
+                                                , &response_size);
+    if (_use_buffer_pool)
+    {
+        // 使用缓冲池时，请求由框架归还
+        return_buffer(request_body);
+    }
+    if (!success)
+    {
+        SERVER_LOG_DEBUG("%s on_message ERROR.\n", _connection->str().c_str());
+        free_buffer(response_buffer);
+        return false;
+    }
+    if (NULL == response_buffer)
+    {
+        return true;
+    }
+    if (0 == response_size)
+    {
+        SERVER_LOG_WARN("%s response size is 0.\n", _connection->str().c_str());
+        free_buffer(response_buffer);
+        return true;
+    }
+
+    ResponseSegment& segment = _segments[_response_number++];
+    segment.is_fd = false;
+    segment.size = response_size;
+    segment.file_offset = 0;
+    segment.buffer = response_buffer;
+    segment.release = _use_buffer_pool? release_pooled_response: release_heap_response;
+    segment.release_param = NULL;
+
+    return true;
+}
+
+void CPipelinePacketHandler::prepare_receive()
+{
+    if (NULL == _recv_buffer)
+    {
+        // 空闲连接先收到_request_header中，收到数据后再分配接收缓冲区
+        _request_context.request_buffer = reinterpret_cast<char*>(&_request_header);
+        _request_context.request_size = sizeof(_request_header);
+        _request_context.request_offset = 0;
+        _body_direct = false;
+    }
+    else if (_header_ready
+          && (0 == _recv_size)
+          && (_request_header.size.to_int() - _body_offset >= PIPELINE_BUFFER_SIZE))
+    {
+        // 剩余的包体较大，直接收到包体中
+        _request_context.request_buffer = _request_body;
+        _request_context.request_size = _request_header.size.to_int();
+        _request_context.request_offset = _body_offset;
+        _body_direct = true;
+    }
+    else
+    {
+        _request_context.request_buffer = _recv_buffer;
+        _request_context.request_size = PIPELINE_BUFFER_SIZE;
+        _request_context.request_offset = _recv_size;
+        _body_direct = false;
+    }
+}
+
+void CPipelinePacketHandler::flush_responses()
+{
+    _response_context.set_segments(_segments, _response_number);
+    SERVER_LOG_DEBUG("%s.\n", _response_context.to_string().c_str());
+}
+
+void CPipelinePacketHandler::release_responses(uint16_t first)
+{
+    for (uint16_t i=first; i<_response_number; ++i)
+        (*_segments[i].release)(&_segments[i]);
+
+    _response_number = first;
+}
+
+void CPipelinePacketHandler::free_buffer(char* buffer) const
+{
+    if (_use_buffer_pool)
+        return_buffer(buffer);
+    else
+        delete []buffer;
+}
+
+SERVER_NAMESPACE_END
@@ -0,0 +1,76 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_SERVER_PIPELINE_PACKET_HANDLER_H
+#define MOOON_SERVER_PIPELINE_PACKET_HANDLER_H
+#include <server/connection.h>
+#include <server/message_observer.h>
+#include <server/packet_handler.h>
+#include <net/inttypes.h>
+SERVER_NAMESPACE_BEGIN
+
+/***
+  * 内置的流水线包处理器，消息格式和CBuiltinPacketHandler相同，
+  * 但允许对端不等响应就连续发送多个请求：
+  * 一次接收到的所有完整请求依次交给IMessageObserver处理，
+  * 得到的响应组成响应链，由框架用一次writev发送，
+  * 积压的响应数达到pipeline_depth时，暂停解析和接收，直到响应发送完毕
+  */
+class CPipelinePacketHandler: public IPacketHandler
+{
+public:
+    CPipelinePacketHandler(IConnection* connection, IMessageObserver* message_observer, uint16_t pipeline_depth);
+    ~CPipelinePacketHandler();
+
+private:
+    virtual void reset();
+    virtual util::handle_result_t on_handle_request(size_t data_size, Indicator& indicator);
+    virtual void on_connection_closed();
+    virtual bool on_connection_timeout();
+    virtual util::handle_result_t on_response_completed(Indicator& indicator);
+
+private:
+    bool parse();            // 解析接收缓冲区中的请求，直到数据不足或积压的响应数达到上限
+    bool dispatch_message(); // 将一个完整的请求交给IMessageObserver处理
+    void prepare_receive();  // 设置下一次接收的位置
+    void flush_responses();  // 将积压的响应设置为响应链
+    void release_responses(uint16_t first); // 释放从first开始还未设置为响应链的响应
+    void free_buffer(char* buffer) const;
+
+private:
+    IConnection* _connection;
+    IMessageObserver* _message_observer;
+    bool _use_buffer_pool;
+    uint16_t _pipeline_depth;
+
+private:
+    char* _recv_buffer;    // 接收缓冲区，首次收到数据时才分配
+    size_t _recv_size;     // 接收缓冲区中未解析的字节数
+    bool _header_ready;    // 是否已解析出当前请求的包头
+    bool _body_direct;     // 是否直接收到包体中，包体较大时不经接收缓冲区复制
+    char* _request_body;   // 当前请求的包体
+    size_t _body_offset;   // 当前请求的包体已收到的字节数
+    net::TCommonMessageHeader _request_header;
+
+private:
+    ResponseSegment* _segments; // 积压的响应，最多pipeline_depth个
+    uint16_t _response_number;  // 积压的响应个数
+};
+
+SERVER_NAMESPACE_END
+#endif // MOOON_SERVER_PIPELINE_PACKET_HANDLER_H
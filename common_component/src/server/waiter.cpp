@@ -17,6 +17,7 @@
  * Author: JianYi, eyjian@qq.com
  */
 #include <sstream>
+#include <sys/uio.h>
 #include <net/util.h>
 #include <sys/thread.h>
 #include <util/string_util.h>
@@ -24,12 +25,23 @@
 #include "work_thread.h"
 SERVER_NAMESPACE_BEGIN
 
+// 一次writev最多合并的Buffer段个数
+static const int MAX_SEGMENT_IOVEC = 64;
+
 CWaiter::CWaiter()
     :_is_sending(false)
+    ,_is_corked(false)
+    ,_is_readable(false)
+    ,_is_writable(false)
+    ,_epoll_interest(EPOLLIN)
     ,_is_in_pool(false) // 只能初始化为false
     ,_thread_index(0)
+    ,_takeover_next(NULL)
+    ,_takeover_events(EPOLLIN)
     ,_packet_handler(NULL)
 {
+    for (uint8_t kind=0; kind<timer_kind_number; ++kind)
+        _timer_node[kind].set_owner(this, kind);
 }
 
 CWaiter::~CWaiter()
@@ -41,6 +53,7 @@ CWaiter::~CWaiter()
 void CWaiter::reset()
 {
     _is_sending = false;
+    _is_corked = false;
     _packet_handler->reset();
 }
 
@@ -56,6 +69,7 @@ void CWaiter::on_switch_failure(bool overflow)
 
 void CWaiter::before_close()
 {
+    _packet_handler->release_response_segments();
     _packet_handler->on_connection_closed();
 }
 
@@ -75,6 +89,10 @@ net::epoll_event_t CWaiter::handle_epoll_event(void* input_ptr, uint32_t events,
         {
             retval = do_handle_epoll_error((void*)"error", ouput_ptr);
         }
+        else if (thread->is_edge_triggered())
+        {
+            retval = do_handle_epoll_edge(input_ptr, events, ouput_ptr);
+        }
         else if (EPOLLIN & events)
         {
             retval = do_handle_epoll_read(input_ptr, ouput_ptr);
@@ -107,6 +125,7 @@ net::epoll_event_t CWaiter::handle_epoll_event(void* input_ptr, uint32_t events,
 
 net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_ptr)
 {
+    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
     size_t size;
     size_t offset;
     ssize_t retval;
@@ -134,8 +153,12 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
     {
         try
         {
-            // 发送文件或数据
-            if (response_context->is_response_fd)
+            // 发送响应链、文件或数据
+            if (response_context->segments != NULL)
+            {
+                retval = send_segments(response_context);
+            }
+            else if (response_context->is_response_fd)
             {
                 // 发送文件
                 off_t file_offset = (off_t)offset;
@@ -178,18 +201,32 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
         {
             // Would block
             //SERVER_LOG_DEBUG("%s send block.\n", to_string().c_str());
+            _is_writable = false;
+            thread->set_waiter_deadline(this, timer_write, true);
             return net::epoll_write;
         }
 
         // 更新已经发送的大小值
+        thread->add_traffic_bytes((size_t)retval);
         _packet_handler->move_response_offset((size_t)retval);	
         if (response_context->response_size > response_context->response_offset)
         {
             // 没有发完，需要继续发
+            thread->set_waiter_deadline(this, timer_write, true);
             return net::epoll_write;        
         }
     }              
 
+    thread->set_waiter_deadline(this, timer_write, false);
+    if (_is_corked)
+    {
+        _is_corked = false;
+        net::set_tcp_option(get_fd(), false, TCP_CORK);
+    }
+
+    // 响应链已发送完毕，释放各数据段
+    _packet_handler->release_response_segments();
+
     Indicator indicator;
     indicator.reset = true;
     indicator.thread_index = get_thread_index();
@@ -215,6 +252,19 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
     }
     if (util::handle_continue == handle_result)
     {
+        // 响应已发完且接下来只是收，是迁移连接的安全点，由负载均衡决定是否迁到其它线程
+        if ((EPOLLIN == indicator.epoll_events) && (indicator.thread_index == get_thread_index()))
+        {
+            uint16_t balance_index = thread->get_balance_thread_index();
+            if (balance_index != get_thread_index())
+            {
+                SERVER_LOG_DEBUG("%s will be balanced to thread[%u].\n", str().c_str(), balance_index);
+                handover_param->thread_index = balance_index;
+                handover_param->epoll_events = EPOLLIN;
+                return net::epoll_release;
+            }
+        }
+        
         // 这里，忽略handover_param->thread_index
         handover_param->epoll_events = indicator.epoll_events;
         return net::epoll_none;
@@ -226,6 +276,87 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
     }
 }
 
+ssize_t CWaiter::send_segments(const ResponseContext* response_context)
+{
+    const ResponseSegment* segments = response_context->segments;
+    uint16_t segment_count = response_context->segment_count;
+    uint16_t index = 0;
+    size_t offset = response_context->response_offset;
+    size_t sent = 0;
+
+    // 找到第一个未发完的数据段，offset为它已发送的字节数
+    while ((index < segment_count) && (offset >= segments[index].size))
+    {
+        offset -= segments[index].size;
+        ++index;
+    }
+
+    // 有文件段时，让前面的Buffer段和文件数据合并成满的TCP包
+    if (!_is_corked)
+    {
+        for (uint16_t i=index; i<segment_count; ++i)
+        {
+            if (segments[i].is_fd)
+            {
+                _is_corked = true;
+                net::set_tcp_option(get_fd(), true, TCP_CORK);
+                break;
+            }
+        }
+    }
+
+    while (index < segment_count)
+    {
+        ssize_t retval;
+        size_t request_size;
+        
+        if (segments[index].is_fd)
+        {
+            off_t file_offset = segments[index].file_offset + (off_t)offset;
+            request_size = segments[index].size - offset;
+            retval = CTcpWaiter::send_file(segments[index].fd, &file_offset, request_size);
+        }
+        else
+        {
+            // 连续的Buffer段合并成一次writev
+            int iovcnt = 0;
+            struct iovec iov[MAX_SEGMENT_IOVEC];
+
+            request_size = 0;
+            for (uint16_t i=index; (i<segment_count) && (iovcnt<MAX_SEGMENT_IOVEC) && !segments[i].is_fd; ++i)
+            {
+                size_t skip = (i == index)? offset: 0;
+                iov[iovcnt].iov_base = const_cast<char*>(segments[i].buffer) + skip;
+                iov[iovcnt].iov_len = segments[i].size - skip;
+                request_size += iov[iovcnt].iov_len;
+                ++iovcnt;
+            }
+
+            retval = CTcpWaiter::writev(iov, iovcnt);
+        }
+
+        if (-1 == retval)
+        {
+            // Would block
+            _is_writable = false;
+            break;
+        }
+
+        sent += (size_t)retval;
+        offset += (size_t)retval;
+        while ((index < segment_count) && (offset >= segments[index].size))
+        {
+            offset -= segments[index].size;
+            ++index;
+        }
+
+        // 未全部写入，说明发送缓冲区已满
+        if ((size_t)retval < request_size) break;
+    }
+
+    return (0 == sent)? -1: (ssize_t)sent;
+}
+
 net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_ptr)
 {
     ssize_t retval;
@@ -256,6 +387,7 @@ net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_pt
         }
         if (-1 == retval)
         {
+            _is_readable = false;
             return net::epoll_none;
         }
     }
@@ -288,7 +420,12 @@ net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_pt
     indicator.thread_index = get_thread_index();
     indicator.epoll_events = EPOLLOUT;
 
+    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+    thread->add_traffic_bytes((size_t)retval);
     util::handle_result_t handle_result = _packet_handler->on_handle_request((size_t)retval, indicator);
+
+    // 请求未收完时开始计时，收完时停止，只有请求的第一部分数据会启动计时
+    thread->set_waiter_deadline(this, timer_read, util::handle_continue == handle_result);
     if (indicator.reset)
     {
         reset();
@@ -319,6 +456,47 @@ net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_pt
     }    
 }
 
+net::epoll_event_t CWaiter::do_handle_epoll_edge(void* input_ptr, uint32_t events, void* ouput_ptr)
+{
+    // 边缘触发只通知一次，所以记下可读写状态，一直读写到EAGAIN
+    if (EPOLLIN & events) _is_readable = true;
+    if (EPOLLOUT & events) _is_writable = true;
+
+    HandOverParam* handover_param = static_cast<HandOverParam*>(ouput_ptr);
+    net::epoll_event_t retval = (EPOLLOUT & _epoll_interest)? net::epoll_write: net::epoll_read;
+    
+    for (;;)
+    {
+        if (net::epoll_read == retval)
+        {
+            if (!_is_readable) break;
+            retval = do_handle_epoll_read(input_ptr, ouput_ptr);
+
+            // 请求未收完，继续收
+            if (net::epoll_none == retval) retval = net::epoll_read;
+        }
+        else if (net::epoll_write == retval)
+        {
+            // 请求收完后直接发送，不用等EPOLLOUT
+            if (!_is_writable) break;
+            retval = do_handle_epoll_send(input_ptr, ouput_ptr);
+
+            // 响应发送完毕，按on_response_completed的指示继续收或发
+            if (net::epoll_none == retval)
+                retval = (EPOLLOUT & handover_param->epoll_events)? net::epoll_write: net::epoll_read;
+        }
+        else
+        {
+            // 关闭或切换线程等
+            return retval;
+        }
+    }
+
+    // 到了EAGAIN，等待下一次边缘触发，这里不需要调用epoll_ctl
+    _epoll_interest = (net::epoll_write == retval)? EPOLLOUT: EPOLLIN;
+    return net::epoll_none;
+}
+
 net::epoll_event_t CWaiter::do_handle_epoll_error(void* input_ptr, void* ouput_ptr)
 {
     SERVER_LOG_DEBUG("%s: %s.\n", to_string().c_str(), (char*)input_ptr);
@@ -22,11 +22,23 @@
 #include <util/listable.h>
 #include <net/tcp_waiter.h>
 #include <util/timeoutable.h>
+#include <util/timing_wheel.h>
 #include "log.h"
 #include "server/connection.h"
 #include "server/packet_handler.h"
 SERVER_NAMESPACE_BEGIN
 
+/***
+  * 连接的定时器类型，仅在使用时间轮时有效
+  */
+enum
+{
+    timer_idle        = 0, /** 空闲超时 */
+    timer_read        = 1, /** 请求读取超时 */
+    timer_write       = 2, /** 响应发送超时 */
+    timer_kind_number = 3
+};
+
 class CWaiter: public net::CTcpWaiter
              , public util::CTimeoutable
              , public util::CListable<CWaiter>
@@ -42,6 +54,21 @@ public:
     bool on_timeout();
     void on_switch_failure(bool overflow);
     void set_thread_index(uint16_t index) { _thread_index = index; }    
+    util::CTimerNode<CWaiter>* get_timer_node(uint8_t kind) { return &_timer_node[kind]; }
+
+    /***
+      * 设置边缘触发模式下关注的事件，取值EPOLLIN或EPOLLOUT，
+      * 边缘触发模式下连接总是注册了EPOLLIN|EPOLLOUT，由它决定事件到来时是收还是发
+      */
+    void set_epoll_interest(uint32_t epoll_interest) { _epoll_interest = epoll_interest; }
+    /** 复位边缘触发模式下的可读写状态，在连接加入epoll时调用 */
+    void reset_edge_state() { _is_readable = false; _is_writable = false; }
+
+    /** 接管队列的链接指针和注入的epoll事件，只在连接切换线程时使用 */
+    CWaiter* get_takeover_next() const { return _takeover_next; }
+    void set_takeover_next(CWaiter* waiter) { _takeover_next = waiter; }
+    uint32_t get_takeover_events() const { return _takeover_events; }
+    void set_takeover_events(uint32_t epoll_events) { _takeover_events = epoll_events; }
 
 private: // 只有CWaiterPool会调用
     bool is_in_pool() const { return _is_in_pool; }
@@ -64,13 +91,22 @@ private:
     net::epoll_event_t do_handle_epoll_send(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t do_handle_epoll_read(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t do_handle_epoll_error(void* input_ptr, void* ouput_ptr);
+    ssize_t send_segments(const ResponseContext* response_context);
+    net::epoll_event_t do_handle_epoll_edge(void* input_ptr, uint32_t events, void* ouput_ptr);
 
 private:        
     bool _is_sending; // 是否处于正发送数据状态中
+    bool _is_corked;  // 发送响应链时是否设置了TCP_CORK
+    bool _is_readable; // 边缘触发模式下，是否仍可能有数据可读，即还未读到EAGAIN
+    bool _is_writable; // 边缘触发模式下，是否仍可写，即还未写到EAGAIN
+    uint32_t _epoll_interest; // 边缘触发模式下关注的事件
     bool _is_in_pool; // 是否在连接池中
     uint16_t _thread_index;
+    CWaiter* _takeover_next;   // 在接管队列中的下一个连接
+    uint32_t _takeover_events; // 被接管后注册的epoll事件
     IPacketHandler* _packet_handler;
     mutable std::string _string_id;
+    util::CTimerNode<CWaiter> _timer_node[timer_kind_number];
 };
 
 SERVER_NAMESPACE_END
@@ -21,6 +21,7 @@
 #include "waiter_pool.h"
 #include "work_thread.h"
 #include "builtin_packet_handler.h"
+#include "pipeline_packet_handler.h"
 SERVER_NAMESPACE_BEGIN
 
 CWaiterPool::~CWaiterPool()
@@ -38,9 +39,10 @@ CWaiterPool::~CWaiterPool()
     }
 }
 
-CWaiterPool::CWaiterPool(CWorkThread* thread, IFactory* factory, uint32_t waiter_count) throw (std::runtime_error)
+CWaiterPool::CWaiterPool(CWorkThread* thread, IFactory* factory, uint32_t waiter_count, uint16_t pipeline_depth) throw (std::runtime_error)
     :_thread(thread)
     ,_factory(factory)
+    ,_pipeline_depth(pipeline_depth)
 {
     _waiter_array = new CWaiter[waiter_count];
     _waiter_queue = new util::CArrayQueue<CWaiter*>(waiter_count);
@@ -118,7 +120,11 @@ void CWaiterPool::init_waiter(CWaiter* waiter) throw (std::runtime_error)
         }
         else
         {
-            handler = new CBuiltinPacketHandler(waiter, message_observer);
+            // 允许积压多个响应时，才使用流水线包处理器
+            if (_pipeline_depth > 1)
+                handler = new CPipelinePacketHandler(waiter, message_observer, _pipeline_depth);
+            else
+                handler = new CBuiltinPacketHandler(waiter, message_observer);
         }
     }
 
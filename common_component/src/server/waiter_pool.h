@@ -29,7 +29,7 @@ class CWaiterPool
 {
 public:
     ~CWaiterPool();
-    CWaiterPool(CWorkThread* thread, IFactory* factory, uint32_t waiter_count) throw(std::runtime_error);
+    CWaiterPool(CWorkThread* thread, IFactory* factory, uint32_t waiter_count, uint16_t pipeline_depth) throw(std::runtime_error);
     
     void destroy();
     void create(uint32_t connection_count, IFactory* factory);
@@ -45,6 +45,7 @@ private:
     CWorkThread* _thread;
     CWaiter* _waiter_array;
     IFactory* _factory;
+    uint16_t _pipeline_depth;
     util::CArrayQueue<CWaiter*>* _waiter_queue;
 };
 
@@ -19,18 +19,47 @@
 #include <sstream>
 #include <net/util.h>
 #include <sys/util.h>
+#include <sys/clock.h>
 #include "context.h"
 #include "work_thread.h"
 SERVER_NAMESPACE_BEGIN
 
+/** 秒数转为毫秒数，用64位计算，超过32位时取最大值，以免大的超时秒数回绕成很小的值 */
+static uint32_t seconds_to_milliseconds(uint32_t seconds)
+{
+    uint64_t milliseconds = static_cast<uint64_t>(seconds) * 1000;
+    return (milliseconds > 0xFFFFFFFF)? 0xFFFFFFFF: static_cast<uint32_t>(milliseconds);
+}
+
 CWorkThread::CWorkThread()
     :_waiter_pool(NULL)
+    ,_use_timing_wheel(false)
+    ,_use_edge_triggered(false)
+    ,_current_milliseconds(0)
     ,_context(NULL)
     ,_follower(NULL)
-    ,_takeover_waiter_queue(NULL)
+    ,_accept_batch_size(1)
+    ,_accept_number_max(0)
+    ,_accept_number(0)
+    ,_accept_wakeup_number(0)
+    ,_use_load_balance(false)
+    ,_balance_interval_milliseconds(1000)
+    ,_balance_migration_number(0)
+    ,_balance_quota(0)
+    ,_balance_thread_index(0)
+    ,_balance_milliseconds(0)
+    ,_busy_milliseconds(0)
+    ,_traffic_bytes(0)
+    ,_waiter_number(0)
+    ,_takeover_queue_size(0)
+    ,_takeover_head(NULL)
 {
-    _current_time = time(NULL);
+    atomic_set(&_takeover_number, 0);
+    _current_time = sys::CClock::get_monotonic_seconds();
     _timeout_manager.set_timeout_handler(this);  
+    _timing_wheel.set_timer_handler(this);
+    for (int i=0; i<timer_kind_number; ++i)
+        _timer_milliseconds[i] = 0;
 
     init_epoll_event_proc();     
 }
@@ -38,16 +67,31 @@ CWorkThread::CWorkThread()
 CWorkThread::~CWorkThread()
 {
     _epoller.destroy();
+    _listen_manager.destroy();
     delete _follower;
-    delete _takeover_waiter_queue;
 }
 
 void CWorkThread::run()
 {
     int retval; // _epoller.timed_wait的返回值
+    uint32_t epoll_timeout_milliseconds = _context->get_config()->get_epoll_timeout_milliseconds();
 
-    _timeout_manager.check_timeout(_current_time);
+    if (_use_timing_wheel)
+    {
+        _timing_wheel.check_timeout(_current_milliseconds);
+        epoll_timeout_milliseconds = _timing_wheel.get_wait_milliseconds(_current_milliseconds, epoll_timeout_milliseconds);
+    }
+    else
+    {
+        _timeout_manager.check_timeout(_current_time);
+    }
     check_pending_queue();
+    if (_use_load_balance)
+    {
+        uint64_t current_milliseconds = sys::CClock::get_monotonic_milliseconds();
+        if (current_milliseconds >= _balance_milliseconds + _balance_interval_milliseconds)
+            update_load(current_milliseconds);
+    }
         
     // epoll前回调
     if (_follower != NULL)
@@ -57,7 +101,7 @@ void CWorkThread::run()
     try
     {                
         // EPOLL检测
-        retval = _epoller.timed_wait(_context->get_config()->get_epoll_timeout_milliseconds());        
+        retval = _epoller.timed_wait(epoll_timeout_milliseconds);        
     }
     catch (sys::CSyscallException& ex)
     {
@@ -67,15 +111,19 @@ void CWorkThread::run()
 
     try
     {        
-        // 得到当前时间
-        _current_time = time(NULL);
+        // 得到当前时间，使用单调时钟，系统时间被调整也不会导致连接批量超时
+        _current_time = sys::CClock::get_monotonic_seconds();
+        if (_use_timing_wheel || _use_load_balance)
+        {
+            _current_milliseconds = sys::CClock::get_monotonic_milliseconds();
+        }
 
         if (0 == retval) // timeout
         {
             // epoll后回调: 超时
             if (_follower != NULL)
             {
-                _follower->after_epoll(_current_time, true);
+                _follower->after_epoll(sys::CClock::get_realtime_seconds(), true);
             }
 
             return; // 直接返回，再次进入epoll等待
@@ -84,7 +132,7 @@ void CWorkThread::run()
         // epoll后回调: 网络事件
         if (_follower != NULL)
         {
-            _follower->after_epoll(_current_time, false);
+            _follower->after_epoll(sys::CClock::get_realtime_seconds(), false);
         }
         for (int i=0; i<retval; ++i)
         {            
@@ -101,6 +149,12 @@ void CWorkThread::run()
                 epoll_event_close(epollable, NULL);
             }            
         }
+
+        // 统计事件循环的忙碌时间
+        if (_use_load_balance)
+        {
+            _busy_milliseconds += sys::CClock::get_monotonic_milliseconds() - _current_milliseconds;
+        }
     }
     catch (sys::CSyscallException& ex)
     {
@@ -116,6 +170,13 @@ bool CWorkThread::before_run()
     sys::CUtil::set_process_name(thread_name.str().c_str());
 #endif // ENABLE_SET_SERVER_THREAD_NAME
 
+    // 必须在本线程中创建，以绑定到本线程
+    _buffer_pool.create(_context->get_config()->get_buffer_pool_size());
+
+    // 在本线程中分配，以便绑定CPU后由本线程首次访问，落在本线程所在的NUMA节点上
+    if (_context->get_cpu_placement().is_enabled())
+        _epoller.relocate_events();
+
     if (NULL == _follower) return true;
     return _follower->before_run();
 }
@@ -124,7 +185,7 @@ void CWorkThread::after_run()
 {
     if (_follower != NULL)
         _follower->after_run();
-    SERVER_LOG_INFO("Server thread %u has exited.\n", get_thread_id());
+    SERVER_LOG_INFO("Server thread %u has exited, %s.\n", get_thread_id(), _buffer_pool.to_string().c_str());
 }
 
 bool CWorkThread::before_start()
@@ -134,21 +195,64 @@ bool CWorkThread::before_start()
         IConfig* config = _context->get_config();
         IFactory* factory = _context->get_factory();
 
+        // 绑定CPU，线程一启动就运行在指定的CPU上
+        cpu_set_t cpu_set;
+        if (_context->get_cpu_placement().get_cpu_set(get_index(), &cpu_set))
+        {
+            set_cpu_set(cpu_set);
+            SERVER_LOG_INFO("Server thread[%u] will run on cpu %d.\n", get_index(), _context->get_cpu_placement().get_cpu(get_index()));
+        }
+
         _follower = factory->create_thread_follower(get_index());
-        _takeover_waiter_queue = new util::CArrayQueue<PendingInfo*>(config->get_takeover_queue_size());
+        _takeover_queue_size = config->get_takeover_queue_size();
         _timeout_manager.set_timeout_seconds(config->get_connection_timeout_seconds());       
+        _use_edge_triggered = config->use_edge_triggered();
+        _use_timing_wheel = config->use_timing_wheel();
+        if (_use_timing_wheel)
+        {
+            _timer_milliseconds[timer_idle] = seconds_to_milliseconds(config->get_connection_timeout_seconds());
+            _timer_milliseconds[timer_read] = config->get_read_timeout_milliseconds();
+            _timer_milliseconds[timer_write] = config->get_write_timeout_milliseconds();
+            _timing_wheel.set_tick_milliseconds(config->get_timer_tick_milliseconds());
+            _current_milliseconds = sys::CClock::get_monotonic_milliseconds();
+        }
+        _accept_batch_size = config->get_accept_batch_size();
+        if (0 == _accept_batch_size)
+            _accept_batch_size = 1;
+
+        // 连接池中的连接不能切换线程，所以只有动态创建连接时才能做负载均衡
+        _use_load_balance = config->use_load_balance() && (config->get_thread_number() > 1);
+        if (_use_load_balance && (config->get_connection_pool_size() > 0))
+        {
+            SERVER_LOG_WARN("Server thread[%u] disabled load balance for connection pool.\n", get_index());
+            _use_load_balance = false;
+        }
+        if (_use_load_balance)
+        {
+            _balance_interval_milliseconds = config->get_balance_interval_milliseconds();
+            if (0 == _balance_interval_milliseconds)
+                _balance_interval_milliseconds = 1000;
+            _balance_migration_number = config->get_balance_migration_number();
+            _balance_thread_index = get_index();
+            _balance_milliseconds = sys::CClock::get_monotonic_milliseconds();
+            _current_milliseconds = _balance_milliseconds;
+        }
         
         _epoller.create(config->get_epoll_size());        
-        
-        uint32_t thread_connection_pool_size = config->get_connection_pool_size();
-        
+        if (_context->is_reuse_port() && (get_index() > 0))
+        {
+            create_listen_manager(config);
+        }
+
+        // 连接池在主线程中创建，工厂的create_packet_handler等不会被多个线程同时调用，
+        // 失败时也能由服务启动报告出来
         try
         {
-            _waiter_pool = new CWaiterPool(this, factory, thread_connection_pool_size);
+            _waiter_pool = new CWaiterPool(this, factory, config->get_connection_pool_size(), config->get_pipeline_depth());
         }
         catch (std::runtime_error& ex)
         {
-            SERVER_LOG_ERROR("%s.\n", ex.what());
+            SERVER_LOG_ERROR("Server thread[%u] created waiter pool error: %s.\n", get_index(), ex.what());
             return false;
         }
 
@@ -181,19 +285,46 @@ void CWorkThread::on_timeout_event(CWaiter* waiter)
     }
     else
     {
-        try
-        {
-            _epoller.del_events(waiter);                    
-        }
-        catch (sys::CSyscallException& ex)
-        {
-            SERVER_LOG_ERROR("Deleted %s error: %s.\n", waiter->to_string().c_str(), ex.to_string().c_str());
-        }
-        
-        _waiter_pool->push_waiter(waiter);
+        close_timeout_waiter(waiter);
     }
 }
 
+void CWorkThread::on_timer_expired(CWaiter* waiter, uint8_t kind)
+{
+    SERVER_LOG_DEBUG("%s is timeout by timer[%u].\n", waiter->to_string().c_str(), kind);
+
+    if (!waiter->on_timeout())
+    {
+        _timing_wheel.arm(waiter->get_timer_node(kind), _timer_milliseconds[kind], _current_milliseconds);
+    }
+    else
+    {
+        cancel_waiter_timers(waiter);
+        close_timeout_waiter(waiter);
+    }
+}
+
+void CWorkThread::close_timeout_waiter(CWaiter* waiter)
+{
+    --_waiter_number;
+    try
+    {
+        _epoller.del_events(waiter);                    
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        SERVER_LOG_ERROR("Deleted %s error: %s.\n", waiter->to_string().c_str(), ex.to_string().c_str());
+    }
+    
+    _waiter_pool->push_waiter(waiter);
+}
+
+void CWorkThread::cancel_waiter_timers(CWaiter* waiter)
+{
+    for (uint8_t kind=0; kind<timer_kind_number; ++kind)
+        _timing_wheel.cancel(waiter->get_timer_node(kind));
+}
+
 uint16_t CWorkThread::index() const
 {
     return get_index();
@@ -201,30 +332,107 @@ uint16_t CWorkThread::index() const
 
 bool CWorkThread::takeover_waiter(CWaiter* waiter, uint32_t epoll_event)
 {
-    if (_takeover_waiter_queue->is_full()) return false;
-    
-    sys::LockHelper<sys::CLock> lock_helper(_pending_lock);
-    if (_takeover_waiter_queue->is_full()) return false;
-    
-    PendingInfo* pending_info = new PendingInfo(waiter, epoll_event);
-    _takeover_waiter_queue->push_back(pending_info);
+    // 先占位，超过接管队列大小时拒绝
+    if (atomic_add_return(1, &_takeover_number) > (int)_takeover_queue_size)
+    {
+        atomic_dec(&_takeover_number);
+        return false;
+    }
+
+    // 多个线程可同时压入，只有本线程取，所以没有ABA问题
+    CWaiter* head;
+    waiter->set_takeover_events(epoll_event);
+    do
+    {
+        head = _takeover_head;
+        waiter->set_takeover_next(head);
+    } while (!__sync_bool_compare_and_swap(&_takeover_head, head, waiter));
+
     _epoller.wakeup();
-    
     return true;
 }
 
+uint16_t CWorkThread::get_balance_thread_index()
+{
+    if (_balance_thread_index == get_index()) return get_index();
+    if (0 == _balance_quota) return get_index();
+
+    --_balance_quota;
+    return _balance_thread_index;
+}
+
+void CWorkThread::update_load(uint64_t current_milliseconds)
+{
+    uint64_t elapsed_milliseconds = current_milliseconds - _balance_milliseconds;
+    uint64_t busy_permille = _busy_milliseconds * 1000 / elapsed_milliseconds;
+    uint64_t kbytes_per_second = _traffic_bytes * 1000 / elapsed_milliseconds / 1024;
+
+    atomic_set(&_load.waiter_number, (int)_waiter_number);
+    atomic_set(&_load.kbytes_per_second, (int)kbytes_per_second);
+    atomic_set(&_load.busy_permille, (int)((busy_permille > 1000)? 1000: busy_permille));
+
+    _balance_milliseconds = current_milliseconds;
+    _busy_milliseconds = 0;
+    _traffic_bytes = 0;
+
+    // 其它线程的负载可能还是上个周期的，但对于均衡已经足够
+    _balance_quota = _balance_migration_number;
+    _balance_thread_index = _context->select_balance_thread(get_index());
+    if (_balance_thread_index != get_index())
+    {
+        SERVER_LOG_DETAIL("Server thread[%u] will move at most %u waiters to thread[%u].\n"
+                        , get_index(), _balance_quota, _balance_thread_index);
+    }
+}
+
+void CWorkThread::create_listen_manager(IConfig* config)
+{
+    const net::ip_port_pair_array_t& listen_parameter = config->get_listen_parameter();
+    for (net::ip_port_pair_array_t::size_type i=0; i<listen_parameter.size(); ++i)
+    {
+        _listen_manager.add(listen_parameter[i].first, listen_parameter[i].second);
+    }
+
+    // 和0号线程的监听同IP同端口，由内核将新连接分配到各线程
+    _listen_manager.create(true, true);
+    add_listener_array(_listen_manager.get_listener_array(), _listen_manager.get_listener_count());
+    SERVER_LOG_INFO("Server thread[%u] created %u reuse-port listeners.\n", get_index(), _listen_manager.get_listener_count());
+}
+
+void CWorkThread::on_accepted(uint32_t accept_number)
+{
+    ++_accept_wakeup_number;
+    _accept_number += accept_number;
+    if (accept_number > _accept_number_max)
+        _accept_number_max = accept_number;
+
+    SERVER_LOG_DETAIL("Server thread[%u] accepted %u connections in one wakeup.\n", get_index(), accept_number);
+}
+
 void CWorkThread::check_pending_queue()
 {
-    if (!_takeover_waiter_queue->is_empty())
+    if (NULL == _takeover_head) return;
+
+    // 一次取走整个队列，并反转成先进先出的顺序
+    CWaiter* head = __sync_lock_test_and_set(&_takeover_head, (CWaiter*)NULL);
+    CWaiter* waiter = NULL;
+    while (head != NULL)
     {
-        sys::LockHelper<sys::CLock> lock_helper(_pending_lock);
-        while (!_takeover_waiter_queue->is_empty())
-        {
-            PendingInfo* pending_info = _takeover_waiter_queue->pop_front();
-            pending_info->waiter->set_thread_index(get_index());
-            watch_waiter(pending_info->waiter, pending_info->epoll_events);
-            delete pending_info;
-        }
+        CWaiter* next = head->get_takeover_next();
+        head->set_takeover_next(waiter);
+        waiter = head;
+        head = next;
+    }
+
+    while (waiter != NULL)
+    {
+        CWaiter* next = waiter->get_takeover_next();
+        waiter->set_takeover_next(NULL);
+        atomic_dec(&_takeover_number);
+
+        waiter->set_thread_index(get_index());
+        watch_waiter(waiter, waiter->get_takeover_events());
+        waiter = next;
     }
 }
 
@@ -232,8 +440,19 @@ bool CWorkThread::watch_waiter(CWaiter* waiter, uint32_t epoll_events)
 {
     try
     {               
-        _epoller.set_events(waiter, epoll_events);
-        _timeout_manager.push(waiter, _current_time);
+        if (_use_edge_triggered)
+        {
+            // 只注册一次，之后由waiter根据关注的事件决定收还是发
+            waiter->reset_edge_state();
+            waiter->set_epoll_interest(epoll_events);
+            _epoller.set_events(waiter, EPOLLIN|EPOLLOUT|EPOLLET);
+        }
+        else
+        {
+            _epoller.set_events(waiter, epoll_events);
+        }
+        update_waiter(waiter);
+        ++_waiter_number;
 
         return true;
     }
@@ -278,10 +497,14 @@ void CWorkThread::del_waiter(CWaiter* waiter)
 
 void CWorkThread::remove_waiter(CWaiter* waiter)
 {
+    --_waiter_number;
     try
     {
         _epoller.del_events(waiter);        
-        _timeout_manager.remove(waiter);        
+        if (_use_timing_wheel)
+            cancel_waiter_timers(waiter);
+        else
+            _timeout_manager.remove(waiter);        
     }
     catch (sys::CSyscallException& ex)
     {
@@ -291,8 +514,26 @@ void CWorkThread::remove_waiter(CWaiter* waiter)
 
 void CWorkThread::update_waiter(CWaiter* waiter)
 {
-    _timeout_manager.remove(waiter);
-    _timeout_manager.push(waiter, _current_time);
+    if (!_use_timing_wheel)
+    {
+        _timeout_manager.remove(waiter);
+        _timeout_manager.push(waiter, _current_time);
+    }
+    else if (_timer_milliseconds[timer_idle] > 0)
+    {
+        _timing_wheel.arm(waiter->get_timer_node(timer_idle), _timer_milliseconds[timer_idle], _current_milliseconds);
+    }
+}
+
+void CWorkThread::set_waiter_deadline(CWaiter* waiter, uint8_t kind, bool armed)
+{
+    if (!_use_timing_wheel || (0 == _timer_milliseconds[kind])) return;
+
+    util::CTimerNode<CWaiter>* timer_node = waiter->get_timer_node(kind);
+    if (!armed)
+        _timing_wheel.cancel(timer_node);
+    else if (!timer_node->is_armed())
+        _timing_wheel.arm(timer_node, _timer_milliseconds[kind], _current_milliseconds);
 }
 
 bool CWorkThread::add_waiter(int fd, const net::ip_address_t& peer_ip, net::port_t peer_port
@@ -305,8 +546,7 @@ bool CWorkThread::add_waiter(int fd, const net::ip_address_t& peer_ip, net::port
         return false;
     }    
         
-    waiter->attach(fd, peer_ip, peer_port);
-    waiter->set_nonblock(true); // 设置为非阻塞
+    waiter->attach(fd, peer_ip, peer_port); // fd已由accept4设置为非阻塞
     waiter->set_self(self_ip, self_port);
     return watch_waiter(waiter, EPOLLIN);    
 }
@@ -332,23 +572,35 @@ void CWorkThread::init_epoll_event_proc()
 
 void CWorkThread::epoll_event_none(net::CEpollable* epollable, void* param)
 {
+    // 边缘触发模式下，waiter已自行记录关注的事件
+    if (_use_edge_triggered) return;
+    
     HandOverParam* handover_param = static_cast<HandOverParam*>(param);
     _epoller.set_events(epollable, handover_param->epoll_events);
 }
 
 void CWorkThread::epoll_event_read(net::CEpollable* epollable, void* param)
 {
-    _epoller.set_events(epollable, EPOLLIN);
+    if (_use_edge_triggered)
+        static_cast<CWaiter*>(epollable)->set_epoll_interest(EPOLLIN);
+    else
+        _epoller.set_events(epollable, EPOLLIN);
 }
 
 void CWorkThread::epoll_event_write(net::CEpollable* epollable, void* param)
 {
-    _epoller.set_events(epollable, EPOLLOUT);
+    if (_use_edge_triggered)
+        static_cast<CWaiter*>(epollable)->set_epoll_interest(EPOLLOUT);
+    else
+        _epoller.set_events(epollable, EPOLLOUT);
 }
 
 void CWorkThread::epoll_event_readwrite(net::CEpollable* epollable, void* param)
 {
-    _epoller.set_events(epollable, EPOLLIN|EPOLLOUT);
+    if (_use_edge_triggered)
+        static_cast<CWaiter*>(epollable)->set_epoll_interest(EPOLLIN|EPOLLOUT);
+    else
+        _epoller.set_events(epollable, EPOLLIN|EPOLLOUT);
 }
 
 void CWorkThread::epoll_event_remove(net::CEpollable* epollable, void* param)
@@ -381,7 +633,16 @@ void CWorkThread::epoll_event_release(net::CEpollable* epollable, void* param)
         if (handover_param->thread_index == get_index())
         {
             // 同一线程，只做epoll事件的变更
-            _epoller.set_events(epollable, handover_param->epoll_events);
+            if (_use_edge_triggered)
+            {
+                // 还未读写到EAGAIN时不会再有边缘，重新修改一次以得到新的边缘
+                waiter->set_epoll_interest(handover_param->epoll_events);
+                _epoller.rearm_events(epollable);
+            }
+            else
+            {
+                _epoller.set_events(epollable, handover_param->epoll_events);
+            }
         }
         else
         {
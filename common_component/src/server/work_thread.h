@@ -19,10 +19,14 @@
 #ifndef MOOON_SERVER_THREAD_H
 #define MOOON_SERVER_THREAD_H
 #include <net/epoller.h>
+#include <net/listen_manager.h>
+#include <sys/atomic.h>
 #include <sys/pool_thread.h>
+#include <util/timing_wheel.h>
 #include <util/timeout_manager.h>
 #include "log.h"
 #include "listener.h"
+#include "buffer_pool.h"
 #include "waiter_pool.h"
 SERVER_NAMESPACE_BEGIN
 
@@ -39,9 +43,25 @@ struct HandOverParam
     }
 };
 
+// 线程的负载，由线程自己在每个均衡周期更新，其它线程只读
+struct ThreadLoad
+{
+    atomic_t waiter_number;     // 活跃的连接数
+    atomic_t kbytes_per_second; // 每秒收发的K字节数
+    atomic_t busy_permille;     // 事件循环处理事件的时间占比，单位为千分之一
+
+    ThreadLoad()
+    {
+        atomic_set(&waiter_number, 0);
+        atomic_set(&kbytes_per_second, 0);
+        atomic_set(&busy_permille, 0);
+    }
+};
+
 class CContext;
 class CWorkThread: public sys::CPoolThread
                  , public util::ITimeoutHandler<CWaiter>
+                 , public util::ITimerHandler<CWaiter>
 {
 public:
     CWorkThread();
@@ -50,11 +70,40 @@ public:
     void del_waiter(CWaiter* waiter);       
     void remove_waiter(CWaiter* waiter);       
     void update_waiter(CWaiter* waiter);  
+    /***
+      * 启动或停止连接的请求读取和响应发送定时器，仅在使用时间轮时有效
+      * 启动时如果定时器已在计时，则保持原计时不变
+      */
+    void set_waiter_deadline(CWaiter* waiter, uint8_t kind, bool armed);
     bool add_waiter(int fd, const net::ip_address_t& peer_ip, net::port_t peer_port
                           , const net::ip_address_t& self_ip, net::port_t self_port);   
       
     void add_listener_array(CListener* listener_array, uint16_t listen_count);    
     bool takeover_waiter(CWaiter* waiter, uint32_t epoll_event);
+
+    /** 是否为边缘触发模式 */
+    bool is_edge_triggered() const { return _use_edge_triggered; }
+
+    /** 每次监听事件最多接受的连接数 */
+    uint32_t get_accept_batch_size() const { return _accept_batch_size; }
+    /** 一次监听事件处理完后被调用，accept_number为本次接受的连接数 */
+    void on_accepted(uint32_t accept_number);
+    /** 得到监听事件被触发的次数 */
+    uint64_t get_accept_wakeup_number() const { return _accept_wakeup_number; }
+    /** 得到已接受的连接总数 */
+    uint64_t get_accept_number() const { return _accept_number; }
+    /** 得到单次监听事件接受的最多连接数 */
+    uint32_t get_accept_number_max() const { return _accept_number_max; }
+
+    /** 累计本线程收发的字节数，用于负载统计 */
+    void add_traffic_bytes(size_t bytes) { _traffic_bytes += bytes; }
+    /** 得到本线程最近一个均衡周期的负载 */
+    const ThreadLoad& get_load() const { return _load; }
+    /***
+      * 在连接迁移的安全点调用，得到连接应当去的线程
+      * 本线程不是热点或本周期的迁出配额已用完时，返回本线程的顺序号
+      */
+    uint16_t get_balance_thread_index();
         
 private:
     virtual void run();
@@ -63,6 +112,7 @@ private:
     virtual bool before_start(); 
     virtual void before_stop();
     virtual void on_timeout_event(CWaiter* waiter);
+    virtual void on_timer_expired(CWaiter* waiter, uint8_t kind);
     virtual uint16_t index() const;    
 
 public:
@@ -70,30 +120,48 @@ public:
 
 private:    
     void check_pending_queue();
+    void close_timeout_waiter(CWaiter* waiter);
+    void cancel_waiter_timers(CWaiter* waiter);
+    void create_listen_manager(IConfig* config);
     bool watch_waiter(CWaiter* waiter, uint32_t epoll_events);
     void handover_waiter(CWaiter* waiter, const HandOverParam& handover_param);
+    void update_load(uint64_t current_milliseconds);
 
 private:    
-    time_t _current_time;
+    time_t _current_time; // 单调递增的秒数，由sys::CClock得到
     net::CEpoller _epoller;
     CWaiterPool* _waiter_pool;       
     util::CTimeoutManager<CWaiter> _timeout_manager;    
+    bool _use_timing_wheel;
+    bool _use_edge_triggered;
+    uint64_t _current_milliseconds; // 单调递增的毫秒时间，仅在使用时间轮时更新
+    uint32_t _timer_milliseconds[timer_kind_number]; // 各类定时器的毫秒数，为0表示不启动
+    util::CTimingWheel<CWaiter> _timing_wheel;
     CContext* _context;
     IThreadFollower* _follower;
+    uint32_t _accept_batch_size;
+    uint32_t _accept_number_max;    // 单次监听事件接受的最多连接数
+    uint64_t _accept_number;        // 接受的连接总数
+    uint64_t _accept_wakeup_number; // 监听事件被触发的次数
+    net::CListenManager<CListener> _listen_manager; // 仅SO_REUSEPORT模式下使用，线程独有的监听
+    CBufferPool _buffer_pool; // 线程独有的请求和响应缓冲池
+
+private: // 负载均衡
+    bool _use_load_balance;
+    uint32_t _balance_interval_milliseconds;
+    uint32_t _balance_migration_number; // 每个周期最多迁出的连接数
+    uint32_t _balance_quota;            // 本周期剩余的迁出配额
+    uint16_t _balance_thread_index;     // 本周期迁入的线程，为本线程时表示不迁出
+    uint64_t _balance_milliseconds;     // 本周期开始的时间
+    uint64_t _busy_milliseconds;        // 本周期处理事件的毫秒数
+    uint64_t _traffic_bytes;            // 本周期收发的字节数
+    uint32_t _waiter_number;            // 本线程的活跃连接数
+    ThreadLoad _load;
     
-private:    
-    struct PendingInfo
-    {
-        CWaiter* waiter;
-        uint32_t epoll_events;
-        PendingInfo(CWaiter* waiter_, uint32_t epoll_events_)
-            :waiter(waiter_)
-            ,epoll_events(epoll_events_)
-        {
-        }
-    };
-    sys::CLock _pending_lock;
-    util::CArrayQueue<PendingInfo*>* _takeover_waiter_queue;
+private: // 接管队列，其它线程无锁压入，本线程一次取走
+    uint32_t _takeover_queue_size;
+    atomic_t _takeover_number;       // 接管队列中的连接数
+    CWaiter* volatile _takeover_head; // 接管队列，后进的在前
     
 private:
     typedef void (CWorkThread::*epoll_event_proc_t)(net::CEpollable* epollable, void* param);
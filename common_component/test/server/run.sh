@@ -0,0 +1,9 @@
+#!/bin/sh
+
+export LD_LIBRARY_PATH=.:../../src/server:../../../common_library/src/util:../../../common_library/src/net:../../../common_library/src/sys:$LD_LIBRARY_PATH
+
+FILES=`ls ut_*|grep -v ".cpp"`
+for file in $FILES;
+do
+	sh -c ./$file
+done
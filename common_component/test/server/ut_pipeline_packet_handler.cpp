@@ -0,0 +1,191 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "pipeline_packet_handler.h"
+using namespace mooon;
+
+// 统计new[]出来还未delete[]的块数，用来检查响应是否都已释放
+static int g_live_arrays = 0;
+
+void* operator new[](size_t size) throw (std::bad_alloc)
+{
+    void* p = malloc(size? size: 1);
+    if (NULL == p) throw std::bad_alloc();
+
+    ++g_live_arrays;
+    return p;
+}
+
+void operator delete[](void* p) throw ()
+{
+    if (p != NULL)
+    {
+        --g_live_arrays;
+        free(p);
+    }
+}
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { ++failures; printf("FAILED at line %d: %s\n", __LINE__, #condition); } \
+    } while (false)
+
+class CConnection: public server::IConnection
+{
+private:
+    virtual std::string str() const { return "connection://test"; }
+    virtual net::port_t self_port() const { return 0; }
+    virtual net::port_t peer_port() const { return 0; }
+    virtual const net::ip_address_t& self_ip() const { return _ip; }
+    virtual const net::ip_address_t& peer_ip() const { return _ip; }
+    virtual uint16_t get_thread_index() const { return 0; }
+
+private:
+    net::ip_address_t _ip;
+};
+
+// 命令字为0的请求视为错误的请求，其它请求原样回应包体
+class CEchoObserver: public server::IMessageObserver
+{
+public:
+    CEchoObserver(int* response_number)
+        :_response_number(response_number)
+    {
+    }
+
+private:
+    virtual bool on_message(const net::TCommonMessageHeader& request_header
+                          , const char* request_body
+                          , char** response_buffer
+                          , size_t* response_size)
+    {
+        size_t body_size = request_header.size.to_int();
+        delete []request_body;
+        if (0 == request_header.command.to_int()) return false;
+
+        *response_buffer = new char[body_size];
+        *response_size = body_size;
+        ++*_response_number;
+        return true;
+    }
+
+private:
+    int* _response_number;
+};
+
+static void append_frame(std::string* stream, uint32_t command, const char* body)
+{
+    net::TCommonMessageHeader header;
+    header.size = static_cast<uint32_t>(strlen(body));
+    header.command = command;
+    stream->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream->append(body);
+}
+
+// 按框架的方式把stream分多次收到包处理器中，返回最后一次on_handle_request的结果
+static util::handle_result_t feed(server::IPacketHandler* packet_handler, const std::string& stream)
+{
+    util::handle_result_t handle_result = util::handle_continue;
+    size_t offset = 0;
+
+    while ((offset < stream.size()) && (util::handle_continue == handle_result))
+    {
+        server::RequestContext* request_context = packet_handler->get_request_context();
+        size_t size = std::min(request_context->request_size - request_context->request_offset, stream.size() - offset);
+        memcpy(request_context->request_buffer + request_context->request_offset, stream.data() + offset, size);
+        offset += size;
+
+        server::Indicator indicator;
+        indicator.reset = false;
+        indicator.thread_index = 0;
+        indicator.epoll_events = EPOLLOUT;
+        handle_result = packet_handler->on_handle_request(size, indicator);
+    }
+
+    return handle_result;
+}
+
+static void test_pipelined_requests()
+{
+    int live_arrays = g_live_arrays;
+    int response_number = 0;
+    CConnection connection;
+    server::IPacketHandler* packet_handler = new server::CPipelinePacketHandler(&connection, new CEchoObserver(&response_number), 8);
+
+    std::string stream;
+    append_frame(&stream, 1, "first");
+    append_frame(&stream, 2, "second");
+    append_frame(&stream, 3, "third");
+    CHECK(util::handle_finish == feed(packet_handler, stream));
+    CHECK(3 == response_number);
+    CHECK(3 == packet_handler->get_response_context()->segment_count);
+    CHECK(strlen("firstsecondthird") == packet_handler->get_response_context()->response_size);
+
+    // 发送完毕，框架释放响应链
+    server::Indicator indicator;
+    indicator.reset = true;
+    indicator.thread_index = 0;
+    indicator.epoll_events = EPOLLIN;
+    packet_handler->release_response_segments();
+    CHECK(util::handle_continue == packet_handler->on_response_completed(indicator));
+
+    delete packet_handler;
+    CHECK(live_arrays == g_live_arrays);
+}
+
+static void test_malformed_request()
+{
+    int live_arrays = g_live_arrays;
+    int response_number = 0;
+    CConnection connection;
+    server::IPacketHandler* packet_handler = new server::CPipelinePacketHandler(&connection, new CEchoObserver(&response_number), 8);
+
+    // 错误的请求之前已有响应积压，之后的请求不再处理
+    std::string stream;
+    append_frame(&stream, 1, "first");
+    append_frame(&stream, 2, "second");
+    append_frame(&stream, 0, "malformed");
+    append_frame(&stream, 3, "third");
+    CHECK(util::handle_error == feed(packet_handler, stream));
+    CHECK(2 == response_number);
+    CHECK(0 == packet_handler->get_response_context()->segment_count);
+
+    // 出错时框架关闭连接
+    packet_handler->release_response_segments();
+    packet_handler->on_connection_closed();
+    packet_handler->reset();
+    delete packet_handler;
+    CHECK(live_arrays == g_live_arrays);
+}
+
+int main()
+{
+    test_pipelined_requests();
+    test_malformed_request();
+
+    printf("pipeline packet handler: %s\n", (0 == failures)? "SUCCESS": "FAILURE");
+    return (0 == failures)? 0: 1;
+}
@@ -49,6 +49,13 @@ public:
       */
     void destroy();
 
+    /***
+      * 重新分配事件数组，应当由调用timed_wait的线程调用，
+      * 以便线程绑定CPU后，事件数组落在线程所在的NUMA节点上
+      * 不会抛出任何异常
+      */
+    void relocate_events();
+
     /***
       * 以超时方式等待Epoll有事件，如果指定的时间内无事件，则超时返回
       * @milliseconds: 最长等待的毫秒数，总是保证等待这个时长，即使被中断
@@ -70,6 +77,14 @@ public:
       */
     void set_events(CEpollable* epollable, int events, bool force=false);
 
+    /***
+      * 以原有的事件重新修改一次，用于边缘触发模式，
+      * 如果句柄当前已就绪，则会再产生一次事件
+      * @epollable: 指向已在Epoll中的可Epoll对象的指针
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void rearm_events(CEpollable* epollable);
+
     /***
       * 将一个可Epoll对象从Epoll中删除
       * @epollable: 指向可Epoll对象的指针
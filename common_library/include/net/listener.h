@@ -40,20 +40,24 @@ public:
       * @ip: 监听IP地址
       * @port: 监听端口号
       * @enabled_address_zero: 是否允许在0.0.0.0上监听，安全起见，默认不允许
-      * @exception: 如果发生错误，则抛出CSyscallException异常
+      * @reuse_port: 是否设置SO_REUSEPORT，以允许多个套接字同时监听相同的IP和端口
+      * @exception: 如果发生错误，则抛出CSyscallException异常，
+      *             如果内核不支持SO_REUSEPORT，则错误码为ENOPROTOOPT
       */
-    void listen(const ip_address_t& ip, uint16_t port, bool nonblock=true, bool enabled_address_zero=false);
-    void listen(const ipv4_node_t& ip_node, bool nonblock=true, bool enabled_address_zero=false);
-    void listen(const ipv6_node_t& ip_node, bool nonblock=true, bool enabled_address_zero=false);
+    void listen(const ip_address_t& ip, uint16_t port, bool nonblock=true, bool enabled_address_zero=false, bool reuse_port=false);
+    void listen(const ipv4_node_t& ip_node, bool nonblock=true, bool enabled_address_zero=false, bool reuse_port=false);
+    void listen(const ipv6_node_t& ip_node, bool nonblock=true, bool enabled_address_zero=false, bool reuse_port=false);
 
     /***
       * 接受连接请求
       * @peer_ip: 用来存储对端的IP地址
       * @peer_port: 用来存储对端端口号
-      * @return: 新的SOCKET句柄
+      * @flags: 传递给accept4的标志，可取SOCK_NONBLOCK和SOCK_CLOEXEC的组合，
+      *         这样新连接不用再单独调用fcntl设置
+      * @return: 新的SOCKET句柄，如果非阻塞监听且无新连接，则返回-1
       * @exception: 如果发生错误，则抛出CSyscallException异常
       */
-    int accept(ip_address_t& peer_ip, uint16_t& peer_port);
+    int accept(ip_address_t& peer_ip, uint16_t& peer_port, int flags=0);
     
     /** 得到监听的IP地址 */
     const ip_address_t& get_listen_ip() const { return _ip; }
@@ -0,0 +1,198 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_MPMC_EPOLLABLE_QUEUE_H
+#define MOOON_NET_MPMC_EPOLLABLE_QUEUE_H
+#include <sys/eventfd.h>
+#include "sys/clock.h"
+#include "sys/futex_event.h"
+#include "util/mpmc_queue.h"
+#include "net/epollable.h"
+NET_NAMESPACE_BEGIN
+
+/** 可以放入Epoll监控的无锁队列，和CEpollableQueue的接口相同，可以直接替换它
+  * 放入和取出都不加锁，用eventfd代替管道：
+  * 队列由空变为非空时才写一次eventfd，消费者取空队列时才读一次，
+  * 而不是每个元素各写一次和读一次管道
+  * 为线程安全类
+  */
+template <typename DataType>
+class CMpmcEpollableQueue: public CEpollable
+{
+public:
+    /** 构造一个可Epoll的无锁队列，注意只可监控读事件，也就是队列中是否有数据
+      * @queue_max: 队列最少可容纳的元素个数，实际容量为不小于它的2的幂
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    CMpmcEpollableQueue(uint32_t queue_max)
+        :_raw_queue(queue_max)
+        ,_signaled(0)
+    {
+        int fd = eventfd(0, EFD_NONBLOCK);
+        if (-1 == fd) throw sys::CSyscallException(errno, __FILE__, __LINE__, "eventfd");
+        set_fd(fd);
+    }
+
+    /** 判断队列是否已满，并发时只是一个近似值 */
+    bool is_full() const
+    {
+        return _raw_queue.is_full();
+    }
+
+    /** 判断队列是否为空，并发时只是一个近似值 */
+    bool is_empty() const
+    {
+        return _raw_queue.is_empty();
+    }
+
+    /***
+      * 弹出队首元素
+      * @elem: 存储弹出的队首元素
+      * @return: 如果队列为空，则返回false，否则取到元素并返回true
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool pop_front(DataType& elem)
+    {
+        return 1 == do_pop_front(&elem, 1);
+    }
+
+    void pop_front()
+    {
+        DataType elem;
+        (void)pop_front(elem);
+    }
+
+    /***
+      * 从队首依次弹出多个元素
+      * @elem_array: 存储弹出的队首元素数组
+      * @array_size: 输入和输出参数，存储实际弹出的元素个数
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    void pop_front(DataType* elem_array, uint32_t& array_size)
+    {
+        array_size = do_pop_front(elem_array, array_size);
+    }
+
+	/***
+      * 向队尾插入一元素
+      * @elem: 待插入到队尾的元素
+      * @millisecond: 如果队列满，等待队列非满的毫秒数，如果为0则不等待，直接返回false
+      * @return: 如果队列已经满，则返回false，否则插入成功并返回true
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool push_back(DataType elem, uint32_t millisecond=0)
+    {
+        return 1 == push_back(&elem, 1, millisecond);
+    }
+
+    /***
+      * 依次向队尾插入多个元素，队列满时等待，直到至少插入一个或超时
+      * @return: 实际插入的元素个数，超时返回0
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    uint32_t push_back(const DataType* elem_array, uint32_t array_size, uint32_t millisecond=0)
+    {
+        uint64_t deadline = 0;
+        for (;;)
+        {
+            uint32_t number = _raw_queue.push_back(elem_array, array_size);
+            if (number > 0)
+            {
+                ring();
+                return number;
+            }
+            if (0 == millisecond)
+            {
+                return 0;
+            }
+
+            uint64_t now = sys::CClock::get_monotonic_milliseconds();
+            if (0 == deadline) deadline = now + millisecond;
+            if (now >= deadline) return 0;
+
+            // 登记后再检查一次，之后的pop_front一定能唤醒本线程
+            int sequence = _not_full_event.prepare_wait();
+            number = _raw_queue.push_back(elem_array, array_size);
+            if (number > 0)
+            {
+                _not_full_event.cancel_wait();
+                ring();
+                return number;
+            }
+
+            (void)_not_full_event.wait(sequence, static_cast<uint32_t>(deadline - now));
+        }
+    }
+
+    /** 得到队列中当前存储的元素个数，并发时只是一个近似值 */
+    uint32_t size() const
+    {
+        return _raw_queue.size();
+    }
+
+private:
+    /** 队列由空变为非空后第一次放入时写eventfd，使句柄可读 */
+    void ring()
+    {
+        __sync_synchronize(); // 和do_pop_front中清除_signaled后的屏障配对
+        if ((0 == _signaled) && __sync_bool_compare_and_swap(&_signaled, 0, 1))
+        {
+            uint64_t value = 1;
+            while (-1 == write(get_fd(), &value, sizeof(value)))
+            {
+                if (errno != EINTR)
+                    throw sys::CSyscallException(errno, __FILE__, __LINE__, "eventfd write");
+            }
+        }
+    }
+
+    uint32_t do_pop_front(DataType* elem_array, uint32_t array_size)
+    {
+        uint32_t number = _raw_queue.pop_front(elem_array, array_size);
+        if (number < array_size)
+        {
+            // 队列已空，先读空eventfd并清除标志再检查一次，
+            // 之后的push_back一定会重新写eventfd，没有数据时不再有读事件
+            uint64_t value;
+            if ((-1 == read(get_fd(), &value, sizeof(value))) && (errno != EAGAIN) && (errno != EINTR))
+                throw sys::CSyscallException(errno, __FILE__, __LINE__, "eventfd read");
+
+            _signaled = 0;
+            __sync_synchronize();
+            uint32_t more = _raw_queue.pop_front(elem_array+number, array_size-number);
+            if (more > 0)
+            {
+                // 可能还有，保持句柄可读
+                number += more;
+                ring();
+            }
+        }
+
+        // 如果有等待者，则唤醒
+        if (number > 0) _not_full_event.signal(static_cast<int>(number));
+        return number;
+    }
+
+private:
+    util::CMpmcQueue<DataType> _raw_queue; /** 无锁队列 */
+    sys::CFutexEvent _not_full_event;      /** 等待队列非满 */
+    volatile int _signaled;                /** 是否已写eventfd且尚未被读 */
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_MPMC_EPOLLABLE_QUEUE_H
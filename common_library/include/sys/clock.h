@@ -0,0 +1,58 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_SYS_CLOCK_H
+#define MOOON_SYS_CLOCK_H
+#include <time.h>
+#include "sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 时钟服务，供事件循环和日志等高频调用的地方使用
+  * 单调时钟使用CLOCK_MONOTONIC_COARSE，不受系统时间调整的影响，
+  * 适合计算超时，精度为内核的一个tick（通常1到4毫秒），但开销远小于time(NULL)
+  */
+class CClock
+{
+public:
+    /** 得到单调递增的秒数，用于超时计算 */
+    static time_t get_monotonic_seconds();
+
+    /** 得到单调递增的毫秒数，用于超时计算 */
+    static uint64_t get_monotonic_milliseconds();
+
+    /** 得到单调递增的微秒数，使用精确时钟，用于度量延迟，开销略大于COARSE时钟 */
+    static uint64_t get_monotonic_microseconds();
+
+    /** 得到当前的日历秒数，精度和单调时钟相同 */
+    static time_t get_realtime_seconds();
+
+    /***
+      * 得到当前日期和时间，格式为: YYYY-MM-DD HH:MM:SS
+      * 每次只读一次COARSE时钟，结果缓存在线程私有的缓冲区中，
+      * 秒数变化时才调用localtime_r重新格式化
+      * @return: 指向线程私有缓冲区，在本线程下一次调用前有效
+      */
+    static const char* get_cached_datetime();
+
+    /** 同get_cached_datetime()，但格式化指定的日历秒数，和它共用同一个缓存 */
+    static const char* get_cached_datetime(time_t seconds);
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CLOCK_H
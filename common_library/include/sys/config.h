@@ -28,6 +28,7 @@
 #define HAVE_UIO_H 0          /** 是否可以使用writev和readv */
 #define COMPILE_FS_UTIL_CPP 1 /** 是否编译fs_util.cpp */
 #define ENABLE_SET_LOG_THREAD_NAME 1 /** 是否设置日志线程名 */
+#define ENABLE_MPMC_QUEUE 0   /** agent、dispatcher和scheduler的队列是否使用无锁的CMpmcQueue，否则使用加锁的CArrayQueue */
 
 // 定义名字空间宏
 #define SYS_NAMESPACE_BEGIN namespace mooon { namespace sys {
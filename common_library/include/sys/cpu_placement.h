@@ -0,0 +1,90 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_SYS_CPU_PLACEMENT_H
+#define MOOON_SYS_CPU_PLACEMENT_H
+#include <sched.h>
+#include <vector>
+#include "sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 线程放置策略，决定线程池中第N个线程绑定到哪个CPU
+  */
+typedef enum
+{
+    placement_none     = 0, /** 不绑定，由内核调度 */
+    placement_compact  = 1, /** 紧凑放置，先占满一个NUMA节点的CPU，再使用下一个节点 */
+    placement_scatter  = 2, /** 分散放置，依次轮流放到各NUMA节点上 */
+    placement_explicit = 3  /** 按指定的CPU列表依次放置 */
+}placement_policy_t;
+
+/***
+  * 线程的CPU放置，线程个数多于CPU个数时，从头循环使用
+  * 绑定后在线程中分配的内存，按first-touch原则会落在线程所在的NUMA节点上
+  */
+class CCpuPlacement
+{
+public:
+    /***
+      * 解析CPU列表，格式如：0-3,8,10-11，和/sys/devices/system/node/node0/cpulist相同
+      * @cpu_list: CPU列表字符串
+      * @cpus: 输出参数，解析出的CPU编号
+      * @return: 格式正确返回true，否则（包括CPU编号不小于CPU_SETSIZE）返回false
+      */
+    static bool parse_cpu_list(const char* cpu_list, std::vector<uint16_t>* cpus);
+
+    /***
+      * 得到各NUMA节点的CPU，取不到NUMA信息时只有一个节点，包含所有CPU
+      * @node_cpus: 输出参数，下标为节点号，节点号不连续或节点没有CPU时对应的元素为空
+      */
+    static void get_numa_cpus(std::vector<std::vector<uint16_t> >* node_cpus);
+
+public:
+    CCpuPlacement();
+
+    /***
+      * 按策略计算各线程绑定的CPU
+      * @policy: 放置策略
+      * @cpu_list: 仅placement_explicit时有效，格式同parse_cpu_list，
+      *           其中的CPU编号须小于CUtil::get_cpu_number()
+      * @return: 参数无效时返回false，这时不绑定
+      */
+    bool create(placement_policy_t policy, const char* cpu_list=NULL);
+
+    /** 是否需要绑定 */
+    bool is_enabled() const { return !_cpus.empty(); }
+
+    /***
+      * 得到第index个线程应当绑定的CPU
+      * @return: 不绑定时返回-1
+      */
+    int get_cpu(uint16_t index) const;
+
+    /***
+      * 得到第index个线程应当绑定的CPU集合
+      * @return: 不绑定时返回false
+      */
+    bool get_cpu_set(uint16_t index, cpu_set_t* cpu_set) const;
+
+private:
+    std::vector<uint16_t> _cpus; /** 各线程依次绑定的CPU */
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CPU_PLACEMENT_H
@@ -0,0 +1,65 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_SYS_FUTEX_EVENT_H
+#define MOOON_SYS_FUTEX_EVENT_H
+#include "sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 基于futex的事件，用于无锁队列的阻塞等待，没有等待者时signal只是一次内存读
+  * 用法：
+  * 1) sequence = prepare_wait();
+  * 2) 重新检查条件，满足则调用cancel_wait()后返回
+  * 3) wait(sequence, milliseconds);
+  * 条件改变的一方在改变之后调用signal()，
+  * 因为序号在检查条件之前取得，所以检查之后的signal不会丢失
+  */
+class CFutexEvent
+{
+public:
+    CFutexEvent();
+
+    /** 登记为等待者，返回传给wait的序号 */
+    int prepare_wait();
+
+    /** 不再等待，和prepare_wait一一对应 */
+    void cancel_wait();
+
+    /***
+      * 等待signal，返回时已结束本次等待，不需要再调用cancel_wait
+      * @milliseconds: 最长等待的毫秒数
+      * @return: 超时返回false，被唤醒或序号已变化返回true
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool wait(int sequence, uint32_t milliseconds);
+
+    /***
+      * 唤醒等待者，没有等待者时不做系统调用
+      * @number: 最多唤醒的等待者个数，批量放入或取出时为元素个数
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    void signal(int number=1);
+
+private:
+    volatile int _sequence;
+    volatile int _waiter_number;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_FUTEX_EVENT_H
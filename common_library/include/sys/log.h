@@ -77,6 +77,10 @@ public:
     virtual void set_single_filesize(uint32_t filesize) {}
     /** 设置日志文件备份个数，不包正在写的日志文件 */
     virtual void set_backup_number(uint16_t backup_number) {}
+    /** 设置按时间滚动的间隔秒数，按整点对齐，如3600为每小时滚动一次，0表示只按大小滚动 */
+    virtual void set_rotate_seconds(uint32_t rotate_seconds) {}
+    /** 是否用gzip压缩滚动出的日志文件，压缩在后台线程中进行 */
+    virtual void enable_compress(bool enabled) {}
 
     /** 是否允许二进制日志 */
     virtual bool enabled_bin() { return false; }
@@ -110,6 +114,51 @@ public:
     virtual void bin_log(const char* filename, int lineno, const char* module_name, const char* log, uint16_t size) {}
 };
 
+//////////////////////////////////////////////////////////////////////////
+// CLogLimiter
+
+/***
+  * 日志调用点的限流，由__MYLOG_XXX宏在每个调用点定义一个静态对象，在格式化之前检查，
+  * 每个调用点一个令牌桶，令牌用完后每sample_number行放行一行，
+  * 被丢弃的行数每隔summary_seconds秒在该调用点以一行摘要输出。
+  * 没有构造函数，静态对象被零初始化，调用点不需要线程安全的局部静态变量初始化
+  */
+class CLogLimiter
+{
+public:
+    /***
+      * 设置所有调用点的限流参数，可随时调用
+      * @rate: 每个调用点每秒最多的行数，为0表示不限流
+      * @burst: 令牌桶的容量，即允许的突发行数，为0时等于rate
+      * @sample_number: 令牌用完后每多少行放行一行，为0表示全部丢弃
+      * @summary_seconds: 输出被丢弃行数的间隔秒数
+      */
+    static void set_limit(uint32_t rate, uint32_t burst=0, uint32_t sample_number=0, uint32_t summary_seconds=10);
+
+    /***
+      * 是否允许写日志，调用者已判断过日志级别
+      * @return: 被限流时返回false，并计入被丢弃的行数
+      */
+    bool allow(ILogger* logger, log_level_t log_level, const char* filename, int lineno, const char* module_name);
+
+private:
+    bool take_token(uint64_t now_milliseconds, uint32_t rate);
+    void log_summary(ILogger* logger, log_level_t log_level, const char* filename, int lineno, const char* module_name, uint64_t now_milliseconds);
+
+private:
+    volatile uint64_t _refill_milliseconds;  // 上一次补充令牌的时间
+    volatile uint64_t _summary_milliseconds; // 上一次输出摘要或开始丢弃的时间
+    volatile int32_t _tokens;                // 以千分之一行为单位的令牌数
+    volatile uint32_t _sample_counter;
+    volatile uint32_t _suppressed_number;    // 上次摘要后被丢弃的行数
+
+private:
+    static volatile uint32_t _rate;
+    static volatile uint32_t _burst;
+    static volatile uint32_t _sample_number;
+    static volatile uint32_t _summary_seconds;
+};
+
 //////////////////////////////////////////////////////////////////////////
 // 日志宏，方便记录日志
 extern ILogger* g_logger; // 只是声明，不是定义，不能赋值哦！
@@ -121,7 +170,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_detail()) { \
-		logger->log_detail(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_DETAIL, __FILE__, __LINE__, module_name)) \
+			logger->log_detail(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -132,7 +183,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_debug()) { \
-		logger->log_debug(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_DEBUG, __FILE__, __LINE__, module_name)) \
+			logger->log_debug(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -143,7 +196,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_info()) { \
-		logger->log_info(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_INFO, __FILE__, __LINE__, module_name)) \
+			logger->log_info(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -154,7 +209,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_warn()) { \
-		logger->log_warn(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_WARN, __FILE__, __LINE__, module_name)) \
+			logger->log_warn(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -165,7 +222,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_error()) { \
-		logger->log_error(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_ERROR, __FILE__, __LINE__, module_name)) \
+			logger->log_error(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -176,7 +235,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_fatal()) { \
-		logger->log_fatal(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_FATAL, __FILE__, __LINE__, module_name)) \
+			logger->log_fatal(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -187,7 +248,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_state()) { \
-		logger->log_state(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_STATE, __FILE__, __LINE__, module_name)) \
+			logger->log_state(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -198,7 +261,9 @@ do { \
 		printf(format, ##__VA_ARGS__); \
 	} \
 	else if (logger->enabled_trace()) { \
-		logger->log_trace(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		static ::mooon::sys::CLogLimiter __mylog_limiter; \
+		if (__mylog_limiter.allow(logger, ::mooon::sys::LOG_LEVEL_TRACE, __FILE__, __LINE__, module_name)) \
+			logger->log_trace(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
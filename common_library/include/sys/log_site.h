@@ -0,0 +1,152 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_SYS_LOG_SITE_H
+#define MOOON_SYS_LOG_SITE_H
+#include <string>
+#include <vector>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/log.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 延迟格式化模式下的日志记录类型
+  */
+enum
+{
+    log_record_text   = 1, /** 已格式化的文本，调用点不支持延迟格式化时使用 */
+    log_record_binary = 2, /** 调用点编号和原始参数，由日志线程或log_decoder格式化 */
+    log_record_site   = 3  /** 调用点定义，只出现在二进制日志文件中，先于使用它的记录 */
+};
+
+/***
+  * 日志记录标志，记录写日志时Logger的设置，格式化时使用
+  */
+enum
+{
+    LOG_RECORD_FLAG_ADDDOT  = 0x01, /** 自动添加结尾的点号 */
+    LOG_RECORD_FLAG_NEWLINE = 0x02  /** 自动添加换行符 */
+};
+
+/***
+  * 日志记录头，记录在线程环形缓冲区和二进制日志文件中首尾相接
+  */
+typedef struct
+{
+    uint16_t length;    /** 包括记录头在内的字节数 */
+    uint8_t type;       /** 记录类型 */
+    uint8_t flags;      /** 日志记录标志 */
+    uint32_t site_id;   /** 调用点编号 */
+    uint32_t thread_id; /** 写日志的线程 */
+    uint32_t seconds;   /** 写日志的日历秒数 */
+}log_record_t;
+
+/***
+  * 日志调用点，即一个MYLOG_XXX宏所在的位置，
+  * 创建时解析格式串，将其拆分成每段最多一个参数，
+  * 这样写日志时只需按类型复制参数，格式化时逐段调用snprintf
+  */
+class CLogSite
+{
+public:
+    /***
+      * 构造调用点，保存文件名、模块名和格式串的副本，
+      * 同时记下filename和format的地址，用于快速匹配同一个调用点
+      */
+    CLogSite(uint32_t site_id, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format);
+
+    /***
+      * 是否为指定的调用点，先比较地址，地址相同时再比较格式串的内容，
+      * 因为ILogger::log_xxx可由调用者传入运行时的格式串，同一块缓冲区可能先后存放不同的格式
+      */
+    bool matches(log_level_t log_level, const char* filename, int lineno, const char* format) const
+    {
+        return (format == _format_address) && (lineno == _lineno) && (filename == _filename_address) && (log_level == _log_level)
+            && (0 == strcmp(format, _format.c_str()));
+    }
+
+    uint32_t get_site_id() const { return _site_id; }
+    log_level_t get_log_level() const { return _log_level; }
+    int get_lineno() const { return _lineno; }
+
+    /***
+      * 是否可延迟格式化，
+      * 含有%n、%m、%ls、%Lf等不支持的转换时不可以，须在调用线程中格式化
+      */
+    bool is_deferrable() const { return _deferrable; }
+
+    /***
+      * 从args中取出参数，编码到buffer中，字符串参数在buffer不够时被截断
+      * @return: 编码后的字节数，buffer连定长参数也放不下时返回-1
+      */
+    int encode_args(char* buffer, uint32_t buffer_size, va_list& args) const;
+
+    /***
+      * 用encode_args编码的参数格式化日志行，包括日志头，
+      * 并按记录标志添加结尾的点号和换行符
+      * @line: 至少有line_size+2个字节，最后两个字节留给点号和换行符
+      * @record: 日志记录头
+      * @args: encode_args编码的参数
+      * @return: 写入line的字节数
+      */
+    uint32_t format(char* line, uint32_t line_size, const log_record_t& record, const char* args, uint32_t args_size) const;
+
+    /** 编码成log_record_site类型的记录，用于写入二进制日志文件 */
+    void encode_site(std::string* site_record) const;
+
+    /***
+      * 从log_record_site类型的记录中解码出调用点
+      * @return: 记录格式错误时返回NULL
+      */
+    static CLogSite* decode_site(const log_record_t& record, const char* payload, uint32_t payload_size);
+
+private:
+    void parse_format();
+
+private:
+    struct Segment
+    {
+        std::string format;   // 含一个转换，或者为最后一段不含转换的文本（已将%%还原为%）
+        uint8_t star_number;  // 宽度和精度中*的个数，对应的int参数在主参数之前
+        char arg_type;        // 主参数的类型，为0表示不含转换
+    };
+
+    uint32_t _site_id;
+    log_level_t _log_level;
+    int _lineno;
+    bool _deferrable;
+    std::string _filename;
+    std::string _module_name;
+    std::string _format;
+    std::vector<Segment> _segments;
+    const char* _filename_address;
+    const char* _format_address;
+};
+
+/***
+  * 将二进制日志文件转换成文本
+  * @binary_fd: 二进制日志文件
+  * @text_fd: 输出文本的文件
+  * @return: 转换的日志行数
+  * @exception: 读写出错或文件格式错误时抛出CSyscallException异常
+  */
+extern uint64_t decode_binary_log(int binary_fd, int text_fd);
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_LOG_SITE_H
@@ -28,8 +28,14 @@
  */
 #ifndef MOOON_SYS_LOGGER_H
 #define MOOON_SYS_LOGGER_H
+#include <list>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <sys/log.h>
 #include <sys/lock.h>
+#include <sys/log_site.h>
 #include <sys/event.h>
 #include <sys/epoll.h>
 #include <sys/thread.h>
@@ -39,6 +45,7 @@ SYS_NAMESPACE_BEGIN
 
 class CLogger;
 class CLogThread;
+class CLogArchiveThread;
 
 /***
   * 常量定义
@@ -46,9 +53,23 @@ class CLogThread;
 enum
 {
     LOGGER_NUMBER_MAX = 100,     /** 允许创建的最多Logger个数 */
-    LOG_NUMBER_WRITED_ONCE = 10  /** 一次可连接写入的日志条数，最大不能超过IOV_MAX */
+    LOG_NUMBER_WRITED_ONCE = 10,  /** 一次可连接写入的日志条数，最大不能超过IOV_MAX */
+    LOG_RING_SIZE_MIN = 65536,    /** 线程环形缓冲区的最小字节数 */
+    LOG_RING_IOV_NUMBER = 64,     /** 环形缓冲区模式下一次writev的最多段数，每个缓冲区最多两段，最大不能超过IOV_MAX */
+    LOG_SITE_NUMBER_MAX = 4096,   /** 延迟格式化模式下每个Logger最多的调用点个数，超出的调用点在调用线程中格式化 */
+    LOG_FORMAT_BUFFER_SIZE = 65536 /** 延迟格式化模式下日志线程格式化缓冲区的字节数 */
 };
 
+/***
+  * 环形缓冲区模式下日志的格式
+  */
+typedef enum
+{
+    log_format_text,     /** 调用线程格式化成文本 */
+    log_format_deferred, /** 调用线程只记录调用点编号和参数，由日志线程格式化成文本 */
+    log_format_binary    /** 调用线程只记录调用点编号和参数，日志线程直接写入文件，由log_decoder转换成文本 */
+}log_format_t;
+
 //////////////////////////////////////////////////////////////////////////
 // log_message_t
 typedef struct
@@ -57,6 +78,65 @@ typedef struct
     char content[4]; // 日志内容
 }log_message_t;
 
+//////////////////////////////////////////////////////////////////////////
+// log_archive_t
+typedef struct
+{
+    std::string segment_filename; // 滚动时改名后的日志文件
+    std::string log_filename;     // 日志文件全路径，备份文件名为它加上序号
+    uint16_t backup_number;       // 保留的备份个数，超出的被删除
+    bool compress;                // 是否压缩成.gz文件
+}log_archive_t;
+
+//////////////////////////////////////////////////////////////////////////
+// CLogRing
+
+/***
+  * 单生产者单消费者的环形缓冲区，生产者为写日志的线程，消费者为日志线程
+  * 日志行在缓冲区中首尾相接，不需要行头，所以日志线程一次最多两段即可写出全部日志，
+  * 行须连续存放，尾部放不下时从头开始，尾部剩余的空间跳过，由_wrap_end标记
+  */
+class CLogRing
+{
+public:
+    CLogRing(uint32_t ring_size);
+    ~CLogRing();
+
+    /***
+      * 生产者调用，得到至少size字节的连续空间
+      * @return: 空间不够时返回NULL
+      */
+    char* reserve(uint32_t size);
+
+    /** 生产者调用，提交reserve得到的空间中的前length字节 */
+    void commit(char* position, uint32_t length);
+
+    /***
+      * 消费者调用，得到待写出的数据
+      * @iov: 至少两个元素，存放待写出的数据
+      * @iovcnt: 输出参数，有效的iov个数，为0表示没有数据
+      * @return: 写出后须传给release的位置
+      */
+    uint32_t peek(struct iovec* iov, int& iovcnt) const;
+
+    /** 消费者调用，释放peek得到的数据 */
+    void release(uint32_t head);
+
+    /** 所属线程是否已退出，退出且为空时可被删除 */
+    bool is_closed() const { return _closed; }
+    void set_closed() { _closed = true; }
+    bool is_empty() const { return _head == _tail; }
+
+private:
+    char* _buffer;
+    uint32_t _ring_size;
+    volatile uint32_t _head;     // 消费者写，生产者读
+    volatile uint32_t _tail;     // 生产者写，消费者读
+    volatile uint32_t _wrap_end; // 从头开始前，尾部有效数据的结束位置
+    bool _wrap_pending;          // reserve的空间是否从头开始，只由生产者使用
+    volatile bool _closed;
+};
+
 //////////////////////////////////////////////////////////////////////////
 // CLogProber
 class CLogProber
@@ -101,9 +181,25 @@ public:
       * @log_queue_size: 所有日志队列加起来的总大小
       * @log_queue_number: 日志队列个数
       * @thread_orderly: 同一个线程的日志是否按时间顺序写
+      * @ring_size: 为0表示所有线程共用一个加锁的队列，
+      *  否则每个写日志的线程一个ring_size字节的环形缓冲区，写日志时不分配内存也不加锁，
+      *  由日志线程批量写出，此时每行日志的最大长度为log_line_size，超出部分被截断，
+      *  ring_size小于LOG_RING_SIZE_MIN或4条最长日志的字节数时被调大
       * @exception: 如果出错抛出CSyscallException异常
       */
-    void create(const char* log_path, const char* log_filename, uint32_t log_queue_size=1000);
+    void create(const char* log_path, const char* log_filename, uint32_t log_queue_size=1000, uint32_t ring_size=0);
+
+    /** 设置日志线程可运行的CPU，所有日志器共享同一个日志线程，
+      * 所以须在第一个日志器create之前调用
+      * @cpu_list: CPU列表，格式如：0-3,8,10-11
+      * @return: 格式错误返回false
+      */
+    static bool set_thread_cpus(const char* cpu_list);
+
+    /** 设置日志的格式，须在create之前调用，create之后调用被忽略，只在ring_size大于0时有效，
+      * 延迟格式化时不支持打屏，打屏时日志仍在调用线程中格式化
+      */
+    void set_log_format(log_format_t log_format);
 
     bool is_registered() const { return _registered; }
     void set_registered(bool registered) { _registered = registered; }
@@ -125,6 +221,10 @@ public:
     virtual void set_single_filesize(uint32_t filesize);
     /** 设置备份日志的个数，如果为0，则不备份 */
     virtual void set_backup_number(uint16_t backup_number);
+    /** 设置按时间滚动的间隔秒数，下一次滚动后才生效，0表示只按大小滚动 */
+    virtual void set_rotate_seconds(uint32_t rotate_seconds);
+    /** 是否压缩滚动出的日志文件 */
+    virtual void enable_compress(bool enabled);
 
     virtual bool enabled_bin();
 
@@ -151,7 +251,7 @@ public:
 private: // 日志文件操作
     void close_logfile();
     void create_logfile(bool truncate);
-    bool need_rotate_file() const { return _current_bytes > (uint32_t)atomic_read(&_max_bytes); }
+    bool need_rotate_file();
     void rotate_file();
     bool need_create_file() const;
 
@@ -163,6 +263,24 @@ private:
     bool single_write();
     void do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
     void push_log_message(log_message_t* log_message);
+
+private: // 线程环形缓冲区模式
+    bool ring_write();
+    void do_ring_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
+    uint32_t format_log_line(char* line, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
+    CLogRing* get_thread_ring();
+    void wakeup_log_thread();
+    static void close_thread_ring(void* ring);
+    char* reserve_ring_space(CLogRing* ring, uint32_t size);
+    int write_ring_data(const struct iovec* iov_array, int iovcnt);
+    int write_iov(const struct iovec* iov_array, int iovcnt);
+    int write_data(const char* data, uint32_t size);
+
+private: // 延迟格式化
+    void do_deferred_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
+    CLogSite* get_log_site(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format);
+    int write_deferred_data(const struct iovec* iov_array, int iovcnt);
+    int write_binary_data(const struct iovec* iov_array, int iovcnt);
     
 private:    
     int _log_fd;
@@ -179,6 +297,10 @@ private:
     bool _screen_enabled; 
     atomic_t _max_bytes;     
     atomic_t _backup_number;
+    atomic_t _rotate_seconds;
+    volatile bool _compress_enabled;
+    time_t _rotate_time;       // 下一次按时间滚动的时间，为0表示尚未计算
+    uint32_t _rotate_sequence; // 滚动时改名用的序号，保证待归档的文件名不重复
     uint32_t _current_bytes;
     char _log_path[PATH_MAX];
     char _log_filename[FILENAME_MAX];
@@ -187,9 +309,27 @@ private:
     CEvent _queue_event;
     CLock _queue_lock; // 保护_log_queue的锁       
 
+private: // 线程环形缓冲区模式
+    uint32_t _ring_size; // 为0表示不使用环形缓冲区
+    pthread_key_t _ring_key;
+    atomic_t _ring_signaled; // 是否已通知日志线程且尚未被处理，用于合并通知
+    CLock _ring_lock; // 保护_ring_array，只在线程第一次写日志和日志线程写出时使用
+    std::vector<CLogRing*> _ring_array;
+
+private: // 延迟格式化
+    log_format_t _log_format;
+    CLock _site_lock; // 保护新增调用点，查找调用点不加锁
+    CLogSite* volatile* _site_table; // 以filename、lineno和format的地址为键的开放寻址表，大小为LOG_SITE_NUMBER_MAX的两倍
+    CLogSite* volatile* _site_array; // 以调用点编号为下标
+    volatile uint32_t _site_number;
+    std::vector<bool> _site_written; // 调用点是否已写入当前的二进制日志文件，只由日志线程使用
+    char* _format_buffer; // 日志线程的格式化缓冲区
+
 private: // 所有Logger共享同一个CLogThread
     static CLock _thread_lock; // 保护_log_thread的锁
     static CLogThread* _log_thread;
+    static bool _has_thread_cpu_set; // 是否设置了日志线程可运行的CPU
+    static cpu_set_t _thread_cpu_set;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -202,6 +342,7 @@ public:
 
     void remove_logger(CLogger* logger);
     void register_logger(CLogger* logger);
+    void archive_file(const log_archive_t& log_archive);
     void inc_log_number() { atomic_inc(&_log_number); }
     void dec_log_number(int number) { atomic_sub(number, &_log_number); }
     int get_log_number() const { return atomic_read(&_log_number); }
@@ -220,6 +361,29 @@ private:
     int _epoll_fd; 
     atomic_t _log_number; /** 队列中日志总条数 */
     struct epoll_event* _epoll_events;
+    CLogArchiveThread* _archive_thread;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// CLogArchiveThread
+
+/***
+  * 日志归档线程，以最低的CPU和IO优先级运行，
+  * 依次完成备份文件改名、压缩和删除超出个数的备份，不阻塞日志线程
+  */
+class CLogArchiveThread: public CThread
+{
+public:
+    /** 由日志线程调用，按加入的顺序归档 */
+    void add_archive(const log_archive_t& log_archive);
+
+private:
+    virtual void run();
+    void archive(const log_archive_t& log_archive);
+    void compress_file(const char* src_filename, const char* dst_filename);
+
+private:
+    std::list<log_archive_t> _archive_list; // 由CThread::_lock保护
 };
 
 SYS_NAMESPACE_END
@@ -0,0 +1,201 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_MPMC_EVENT_QUEUE_H
+#define MOOON_SYS_MPMC_EVENT_QUEUE_H
+#include <sched.h>
+#include "sys/clock.h"
+#include "sys/futex_event.h"
+#include "util/mpmc_queue.h"
+SYS_NAMESPACE_BEGIN
+
+/** 无锁的事件队列，线程安全，和CEventQueue的语义相同，可以直接替换它
+  * 特性1: 如果队列为空，则可等待队列有数据时
+  * 特性2: 如果队列已满，则可等待队列为非满时
+  * 放入和取出都不加锁，只在需要等待时才使用futex，没有等待者时唤醒也不做系统调用
+  */
+template <typename DataType>
+class CMpmcEventQueue
+{
+public:
+    /** 队列中的元素数据类型 */
+    typedef DataType _DataType;
+
+    /***
+      * 构造一个无锁事件队列，参数和CEventQueue相同
+      * @queue_max: 需要构造的队列大小，实际容量为不小于它的2的幂
+      * @pop_milliseconds: pop_front时等待队列为非空时的毫秒数，为0表示不等待
+      * @push_milliseconds: push_back时等待队列为非满时的毫秒数，为0表示不等待
+      */
+    CMpmcEventQueue(uint32_t queue_max, uint32_t pop_milliseconds, uint32_t push_milliseconds)
+        :_raw_queue(queue_max)
+        ,_pop_milliseconds(pop_milliseconds)
+        ,_push_milliseconds(push_milliseconds)
+    {
+    }
+
+    /** 判断队列是否已满，并发时只是一个近似值 */
+    bool is_full() const
+    {
+        return _raw_queue.is_full();
+    }
+
+    /** 判断队列是否为空，并发时只是一个近似值 */
+    bool is_empty() const
+    {
+        return _raw_queue.is_empty();
+    }
+
+    /***
+      * 弹出队首元素
+      * @elem: 存储被弹出的队首元素
+      * @return: 如果成功从队列弹出数据则返回true，否则（队列为空或超时）返回false
+      * @exception: 可能抛出CSyscallException异常
+      */
+    bool pop_front(DataType& elem)
+    {
+        return 1 == pop_front(&elem, 1);
+    }
+
+    void pop_front()
+    {
+        DataType elem;
+        (void)pop_front(elem);
+    }
+
+    /***
+      * 从队首依次弹出多个元素，队列为空时等待，直到至少弹出一个或超时
+      * @return: 实际弹出的元素个数，超时返回0
+      * @exception: 可能抛出CSyscallException异常
+      */
+    uint32_t pop_front(DataType* elem_array, uint32_t array_size)
+    {
+        uint64_t deadline = 0;
+        for (int spin=0;; ++spin)
+        {
+            uint32_t number = _raw_queue.pop_front(elem_array, array_size);
+            if (number > 0)
+            {
+                _not_full_event.signal(static_cast<int>(number));
+                return number;
+            }
+            if ((spin < SPIN_NUMBER) && (_pop_milliseconds > 0))
+            {
+                sched_yield();
+                continue;
+            }
+
+            uint32_t milliseconds;
+            if (!get_remaining_milliseconds(_pop_milliseconds, deadline, milliseconds)) return 0;
+
+            // 登记后再检查一次，之后的push_back一定能唤醒本线程
+            int sequence = _not_empty_event.prepare_wait();
+            number = _raw_queue.pop_front(elem_array, array_size);
+            if (number > 0)
+            {
+                _not_empty_event.cancel_wait();
+                _not_full_event.signal(static_cast<int>(number));
+                return number;
+            }
+
+            (void)_not_empty_event.wait(sequence, milliseconds);
+        }
+    }
+
+    /***
+      * 往队尾插入一个元素
+      * @elem: 需要插入队尾的数据
+      * @return: 如果成功往对尾插入了数据，则返回true，否则（队列满或超时）返回false
+      * @exception: 可能抛出CSyscallException异常
+      */
+    bool push_back(DataType elem)
+    {
+        return 1 == push_back(&elem, 1);
+    }
+
+    /***
+      * 依次往队尾插入多个元素，队列满时等待，直到至少插入一个或超时
+      * @return: 实际插入的元素个数，超时返回0
+      * @exception: 可能抛出CSyscallException异常
+      */
+    uint32_t push_back(const DataType* elem_array, uint32_t array_size)
+    {
+        uint64_t deadline = 0;
+        for (int spin=0;; ++spin)
+        {
+            uint32_t number = _raw_queue.push_back(elem_array, array_size);
+            if (number > 0)
+            {
+                _not_empty_event.signal(static_cast<int>(number));
+                return number;
+            }
+            if ((spin < SPIN_NUMBER) && (_push_milliseconds > 0))
+            {
+                sched_yield();
+                continue;
+            }
+
+            uint32_t milliseconds;
+            if (!get_remaining_milliseconds(_push_milliseconds, deadline, milliseconds)) return 0;
+
+            int sequence = _not_full_event.prepare_wait();
+            number = _raw_queue.push_back(elem_array, array_size);
+            if (number > 0)
+            {
+                _not_full_event.cancel_wait();
+                _not_empty_event.signal(static_cast<int>(number));
+                return number;
+            }
+
+            (void)_not_full_event.wait(sequence, milliseconds);
+        }
+    }
+
+    /** 得到队列中存储的元素个数，并发时只是一个近似值 */
+    uint32_t size() const
+    {
+        return _raw_queue.size();
+    }
+
+private:
+    /** 睡眠前先让出CPU重试的次数，避免队列短暂为空或满时每次都进出内核 */
+    enum { SPIN_NUMBER = 16 };
+
+    /** 计算剩余的等待毫秒数，第一次调用时确定截止时间，已超时返回false */
+    static bool get_remaining_milliseconds(uint32_t milliseconds, uint64_t& deadline, uint32_t& remaining)
+    {
+        if (0 == milliseconds) return false;
+
+        uint64_t now = CClock::get_monotonic_milliseconds();
+        if (0 == deadline) deadline = now + milliseconds;
+        if (now >= deadline) return false;
+
+        remaining = static_cast<uint32_t>(deadline - now);
+        return true;
+    }
+
+private:
+    util::CMpmcQueue<DataType> _raw_queue;
+    CFutexEvent _not_empty_event;  /** 等待队列有数据 */
+    CFutexEvent _not_full_event;   /** 等待队列有空位置 */
+    uint32_t _pop_milliseconds;    /** 出队时等待超时毫秒数 */
+    uint32_t _push_milliseconds;   /** 入队时等待超时毫秒数 */
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_MPMC_EVENT_QUEUE_H
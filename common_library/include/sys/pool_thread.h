@@ -112,6 +112,12 @@ public:
       */
     size_t get_stack_size() const;
 
+    /** 设置线程可运行的CPU集合，应当在before_start中设置。
+      * @cpu_set: CPU集合
+      * @exception: 不抛出异常
+      */
+    void set_cpu_set(const cpu_set_t& cpu_set);
+
     /** 得到本线程号 */
     uint32_t get_thread_id() const;
 
@@ -18,6 +18,7 @@
  */
 #ifndef MOOON_SYS_THREAD_H
 #define MOOON_SYS_THREAD_H
+#include <sched.h>
 #include <pthread.h>
 #include "sys/util.h"
 #include "sys/event.h"
@@ -79,6 +80,13 @@ public:
       */
     size_t get_stack_size() const;
 
+    /** 设置线程可运行的CPU集合。应当在start之前调用，如放在before_start当中，
+      * 这样线程一开始就运行在这些CPU上，它分配的内存也就落在这些CPU所在的NUMA节点上。
+      * @cpu_set: CPU集合
+      * @exception: 不抛出异常
+      */
+    void set_cpu_set(const cpu_set_t& cpu_set);
+
     /** 得到本线程号 */
     uint32_t get_thread_id() const { return _thread; }
     
@@ -132,6 +140,8 @@ private:
     pthread_t _thread;
     pthread_attr_t _attr;
     size_t _stack_size;    
+    bool _has_cpu_set;
+    cpu_set_t _cpu_set;
 };
 
 
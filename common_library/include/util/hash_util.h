@@ -21,6 +21,20 @@
 #include "util/config.h"
 UTIL_NAMESPACE_BEGIN
 
+/***
+  * 打散hash值，使低位和高位都均匀分布，
+  * 用于弥补简单hash函数（如IP加端口）在低位上的聚集
+  */
+inline uint64_t mix_hash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
 /** 求128类型的hash函数 */
 struct uint128_hasher
 {
@@ -0,0 +1,207 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTIL_MPMC_QUEUE_H
+#define MOOON_UTIL_MPMC_QUEUE_H
+#include "util/config.h"
+UTIL_NAMESPACE_BEGIN
+
+/***
+  * 多生产者多消费者的有界无锁队列，线程安全，不阻塞
+  * 每个元素带一个序号，生产者和消费者各自用CAS推进位置，再通过序号交接元素，
+  * 容量向上取整为2的幂，用与运算代替取模，
+  * 生产者和消费者的位置各占一个缓存行，避免伪共享
+  */
+template <typename DataType>
+class CMpmcQueue
+{
+public:
+    /** 队列中的元素数据类型 */
+    typedef DataType _DataType;
+
+    /***
+      * 构造一个无锁队列
+      * @queue_max: 最少可容纳的元素个数，实际容量为不小于它的2的幂
+      */
+    CMpmcQueue(uint32_t queue_max)
+        :_enqueue_position(0)
+        ,_dequeue_position(0)
+    {
+        _capacity = 2;
+        while (_capacity < queue_max)
+            _capacity <<= 1;
+
+        _mask = _capacity - 1;
+        _cell_array = new Cell[_capacity];
+        for (uint32_t i=0; i<_capacity; ++i)
+            _cell_array[i].sequence = i;
+    }
+
+    ~CMpmcQueue()
+    {
+        delete []_cell_array;
+    }
+
+    /***
+      * 往队尾插入一个元素
+      * @return: 队列满时返回false
+      */
+    bool push_back(const DataType& elem)
+    {
+        Cell* cell;
+        uint32_t position = _enqueue_position;
+
+        for (;;)
+        {
+            cell = &_cell_array[position & _mask];
+            int32_t diff = static_cast<int32_t>(cell->sequence - position);
+            if (0 == diff)
+            {
+                // 位置空闲，抢占它
+                uint32_t current = __sync_val_compare_and_swap(&_enqueue_position, position, position+1);
+                if (current == position) break;
+                position = current;
+            }
+            else if (diff < 0)
+            {
+                // 该位置上一轮的元素还未被取走
+                return false;
+            }
+            else
+            {
+                position = _enqueue_position;
+            }
+        }
+
+        cell->data = elem;
+        __sync_synchronize(); // 元素先于序号对消费者可见
+        cell->sequence = position + 1;
+        return true;
+    }
+
+    /***
+      * 弹出队首元素
+      * @return: 队列为空时返回false
+      */
+    bool pop_front(DataType& elem)
+    {
+        Cell* cell;
+        uint32_t position = _dequeue_position;
+
+        for (;;)
+        {
+            cell = &_cell_array[position & _mask];
+            int32_t diff = static_cast<int32_t>(cell->sequence - (position + 1));
+            if (0 == diff)
+            {
+                uint32_t current = __sync_val_compare_and_swap(&_dequeue_position, position, position+1);
+                if (current == position) break;
+                position = current;
+            }
+            else if (diff < 0)
+            {
+                // 该位置的元素还未被放入
+                return false;
+            }
+            else
+            {
+                position = _dequeue_position;
+            }
+        }
+
+        elem = cell->data;
+        __sync_synchronize(); // 取走元素后才让生产者重用该位置
+        cell->sequence = position + _capacity;
+        return true;
+    }
+
+    /***
+      * 依次往队尾插入多个元素，队列满时停止
+      * @return: 实际插入的元素个数
+      */
+    uint32_t push_back(const DataType* elem_array, uint32_t array_size)
+    {
+        uint32_t i = 0;
+        while ((i < array_size) && push_back(elem_array[i]))
+            ++i;
+
+        return i;
+    }
+
+    /***
+      * 从队首依次弹出多个元素，队列空时停止
+      * @return: 实际弹出的元素个数
+      */
+    uint32_t pop_front(DataType* elem_array, uint32_t array_size)
+    {
+        uint32_t i = 0;
+        while ((i < array_size) && pop_front(elem_array[i]))
+            ++i;
+
+        return i;
+    }
+
+    /** 判断队列是否为空，并发时只是一个近似值 */
+    bool is_empty() const
+    {
+        return 0 == size();
+    }
+
+    /** 判断队列是否已满，并发时只是一个近似值 */
+    bool is_full() const
+    {
+        return size() >= _capacity;
+    }
+
+    /** 得到队列中存储的元素个数，并发时只是一个近似值 */
+    uint32_t size() const
+    {
+        uint32_t dequeue_position = _dequeue_position;
+        uint32_t enqueue_position = _enqueue_position;
+        int32_t size = static_cast<int32_t>(enqueue_position - dequeue_position);
+
+        return (size < 0)? 0: static_cast<uint32_t>(size);
+    }
+
+    /** 得到队列的容量 */
+    uint32_t capacity() const
+    {
+        return _capacity;
+    }
+
+private:
+    enum { CACHE_LINE_SIZE = 64 };
+
+    struct Cell
+    {
+        volatile uint32_t sequence; // 等于位置时可放入，等于位置加1时可取出
+        DataType data;
+    };
+
+    char _pad0[CACHE_LINE_SIZE];
+    volatile uint32_t _enqueue_position;
+    char _pad1[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    volatile uint32_t _dequeue_position;
+    char _pad2[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t _capacity;
+    uint32_t _mask;
+    Cell* _cell_array;
+};
+
+UTIL_NAMESPACE_END
+#endif // MOOON_UTIL_MPMC_QUEUE_H
@@ -0,0 +1,212 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_UTIL_OPEN_HASH_MAP_H
+#define MOOON_UTIL_OPEN_HASH_MAP_H
+#include "util/config.h"
+#include "util/hash_util.h"
+UTIL_NAMESPACE_BEGIN
+
+/***
+  * 开放寻址的哈希表，线性探测，
+  * 所有元素存储在一个连续数组中，查找通常只访问一两个缓存行，
+  * 删除时将后面的元素前移填补空位，因此不需要墓碑，查找长度不会因删除而变长
+  * 非线程安全
+  * @Key: 键类型，须可复制和赋值
+  * @Value: 值类型，须可复制和赋值
+  * @Hasher: 求Key的hash值的函数对象，结果会被mix_hash打散，因此可以较简单
+  * @Comparer: 比较两个Key是否相等的函数对象
+  */
+template <typename Key, typename Value, class Hasher, class Comparer>
+class COpenHashMap
+{
+public:
+    /***
+      * 构造哈希表
+      * @capacity: 初始容量，会被调整为2的幂，元素个数超过容量的3/4时容量翻倍
+      */
+    COpenHashMap(uint32_t capacity=16)
+        :_size(0)
+    {
+        _capacity = 16;
+        while (_capacity < capacity)
+            _capacity <<= 1;
+
+        _slots = new Slot[_capacity];
+    }
+
+    ~COpenHashMap()
+    {
+        delete []_slots;
+    }
+
+    uint32_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return 0 == _size;
+    }
+
+    /***
+      * 插入元素
+      * @return: 如果Key已经存在，则返回false，否则返回true
+      */
+    bool insert(const Key& key, const Value& value)
+    {
+        if (find(key) != NULL)
+            return false;
+
+        if ((_size+1) * 4 > _capacity * 3)
+            rehash(_capacity << 1);
+
+        do_insert(key, value);
+        ++_size;
+        return true;
+    }
+
+    /***
+      * 查找元素
+      * @return: 如果Key不存在，则返回NULL，否则返回指向值的指针，
+      *          在下一次insert或erase之前有效
+      */
+    Value* find(const Key& key) const
+    {
+        uint32_t mask = _capacity - 1;
+        for (uint32_t i=get_ideal_index(key);; i=(i+1)&mask)
+        {
+            Slot& slot = _slots[i];
+            if (!slot.used)
+                return NULL;
+            if (_comparer(slot.key, key))
+                return &slot.value;
+        }
+    }
+
+    /***
+      * 删除元素
+      * @return: 如果Key不存在，则返回false，否则返回true
+      */
+    bool erase(const Key& key)
+    {
+        uint32_t mask = _capacity - 1;
+        uint32_t i = get_ideal_index(key);
+        for (;; i=(i+1)&mask)
+        {
+            if (!_slots[i].used)
+                return false;
+            if (_comparer(_slots[i].key, key))
+                break;
+        }
+
+        // 后面同一探测链上的元素，如果移到空位不会越过它的理想位置，则前移
+        for (uint32_t j=(i+1)&mask; _slots[j].used; j=(j+1)&mask)
+        {
+            uint32_t ideal = get_ideal_index(_slots[j].key);
+            if (((j-ideal) & mask) >= ((j-i) & mask))
+            {
+                _slots[i] = _slots[j];
+                i = j;
+            }
+        }
+
+        _slots[i].used = false;
+        --_size;
+        return true;
+    }
+
+    void clear()
+    {
+        for (uint32_t i=0; i<_capacity; ++i)
+            _slots[i].used = false;
+        _size = 0;
+    }
+
+    /***
+      * 遍历所有元素，对每个元素调用visitor(key, value)
+      * 遍历过程中不能增删元素
+      */
+    template <class Visitor>
+    void for_each(Visitor& visitor) const
+    {
+        for (uint32_t i=0; i<_capacity; ++i)
+        {
+            if (_slots[i].used)
+                visitor(_slots[i].key, _slots[i].value);
+        }
+    }
+
+private:
+    struct Slot
+    {
+        Slot(): used(false) {}
+
+        bool used;
+        Key key;
+        Value value;
+    };
+
+    uint32_t get_ideal_index(const Key& key) const
+    {
+        return static_cast<uint32_t>(mix_hash(_hasher(key))) & (_capacity-1);
+    }
+
+    void do_insert(const Key& key, const Value& value)
+    {
+        uint32_t mask = _capacity - 1;
+        uint32_t i = get_ideal_index(key);
+        while (_slots[i].used)
+            i = (i+1) & mask;
+
+        _slots[i].used = true;
+        _slots[i].key = key;
+        _slots[i].value = value;
+    }
+
+    void rehash(uint32_t capacity)
+    {
+        Slot* old_slots = _slots;
+        uint32_t old_capacity = _capacity;
+
+        _slots = new Slot[capacity];
+        _capacity = capacity;
+        for (uint32_t i=0; i<old_capacity; ++i)
+        {
+            if (old_slots[i].used)
+                do_insert(old_slots[i].key, old_slots[i].value);
+        }
+
+        delete []old_slots;
+    }
+
+private:
+    COpenHashMap(const COpenHashMap&);
+    COpenHashMap& operator =(const COpenHashMap&);
+
+private:
+    Hasher _hasher;
+    Comparer _comparer;
+    uint32_t _size;
+    uint32_t _capacity; // 总是2的幂
+    Slot* _slots;
+};
+
+UTIL_NAMESPACE_END
+#endif // MOOON_UTIL_OPEN_HASH_MAP_H
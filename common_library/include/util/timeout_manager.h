@@ -43,6 +43,8 @@ public:
   * 非线程安全类，因此通常一个线程一个CTimeoutManager实例，而
   * TimeoutableClass类型的对象通常也不跨线程，
   * 这保证高效的前提，使得整个超时检测0查找
+  * 传入的current_time应当为单调递增的秒数，如sys::CClock::get_monotonic_seconds()，
+  * 否则系统时间被向后调整时，队列中的对象会被批量判定为超时
   */
 template <class TimeoutableClass>
 class CTimeoutManager
@@ -0,0 +1,399 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#ifndef MOOON_UTIL_TIMING_WHEEL_H
+#define MOOON_UTIL_TIMING_WHEEL_H
+#include "util/config.h"
+UTIL_NAMESPACE_BEGIN
+
+/***
+  * 时间轮定时器节点
+  * 以成员的方式嵌入到需要定时的对象中，一个对象可以嵌入多个节点，
+  * 各节点用kind区分，从而同时支持多种不同时长的定时器，如：
+  * class CMyClass
+  * {
+  *     CTimerNode<CMyClass> _timer_node[3];
+  * };
+  */
+template <class OwnerClass>
+class CTimerNode
+{
+    template <class T> friend class CTimingWheel;
+
+public:
+    CTimerNode()
+        :_prev(NULL)
+        ,_next(NULL)
+        ,_owner(NULL)
+        ,_kind(0)
+        ,_expire_tick(0)
+    {
+    }
+
+    /** 设置节点所属的对象和定时器类型，只需要设置一次 */
+    void set_owner(OwnerClass* owner, uint8_t kind)
+    {
+        _owner = owner;
+        _kind = kind;
+    }
+
+    /** 得到节点所属的对象 */
+    OwnerClass* get_owner() const { return _owner; }
+
+    /** 得到定时器类型 */
+    uint8_t get_kind() const { return _kind; }
+
+    /** 定时器是否已启动 */
+    bool is_armed() const { return _next != NULL; }
+
+private:
+    void unlink()
+    {
+        _prev->_next = _next;
+        _next->_prev = _prev;
+        _prev = NULL;
+        _next = NULL;
+    }
+
+private:
+    CTimerNode<OwnerClass>* _prev;
+    CTimerNode<OwnerClass>* _next;
+    OwnerClass* _owner;
+    uint8_t _kind;
+    uint64_t _expire_tick; // 到期的绝对刻度
+};
+
+/***
+  * 定时器处理器抽象接口
+  * 定时器到期时，回调它的on_timer_expired方法
+  */
+template <class OwnerClass>
+class CALLBACK_INTERFACE ITimerHandler
+{
+public:
+    /** 空虚拟析构函数，以屏蔽编译器告警 */
+    virtual ~ITimerHandler() {}
+    /***
+      * 定时器到期时被回调，回调前定时器已被停止，
+      * 因此可以在回调中再次启动同一定时器
+      */
+    virtual void on_timer_expired(OwnerClass* owner, uint8_t kind) = 0;
+};
+
+/***
+  * 分层时间轮模板类，和Linux内核定时器的实现相同
+  * 第一层256个槽，每槽一个刻度，其余三层各64个槽，每槽的跨度是下一层的整层，
+  * 最长可定时2^26个刻度，超出的按最长定时处理，1毫秒的刻度时约为18.6小时
+  * 启动、重启和停止定时器都是O(1)的，到期检测时每个刻度最多一次迁移
+  *
+  * 和CTimeoutManager不同，每个定时器可以有不同的时长，并且精度为毫秒，
+  * 同样为非线程安全类，通常一个线程一个CTimingWheel实例
+  */
+template <class OwnerClass>
+class CTimingWheel
+{
+public:
+    typedef CTimerNode<OwnerClass> TimerNode;
+
+    /***
+      * 构造一个时间轮
+      * @tick_milliseconds: 刻度毫秒数，即定时的精度，不能为0
+      */
+    CTimingWheel(uint32_t tick_milliseconds=10)
+        :_is_started(false)
+        ,_tick_milliseconds((0 == tick_milliseconds)? 1: tick_milliseconds)
+        ,_current_tick(0)
+        ,_timer_number(0)
+        ,_timer_handler(NULL)
+    {
+        for (int i=0; i<WHEEL_SLOT_NUMBER; ++i)
+        {
+            _slots[i]._prev = &_slots[i];
+            _slots[i]._next = &_slots[i];
+        }
+    }
+
+    /** 得到刻度毫秒数 */
+    uint32_t get_tick_milliseconds() const
+    {
+        return _tick_milliseconds;
+    }
+
+    /** 设置刻度毫秒数，只能在启动任何定时器之前调用 */
+    void set_tick_milliseconds(uint32_t tick_milliseconds)
+    {
+        if (0 == _timer_number)
+        {
+            _is_started = false;
+            _tick_milliseconds = (0 == tick_milliseconds)? 1: tick_milliseconds;
+        }
+    }
+
+    /** 设置定时器处理器 */
+    void set_timer_handler(ITimerHandler<OwnerClass>* timer_handler)
+    {
+        _timer_handler = timer_handler;
+    }
+
+    /** 得到已启动的定时器个数 */
+    uint32_t get_timer_number() const
+    {
+        return _timer_number;
+    }
+
+    /***
+      * 启动定时器，如果定时器已启动，则重新开始计时
+      * @timer_node: 定时器节点
+      * @timeout_milliseconds: 定时毫秒数
+      * @current_milliseconds: 当前毫秒时间，应为单调递增的时间
+      */
+    void arm(TimerNode* timer_node, uint32_t timeout_milliseconds, uint64_t current_milliseconds)
+    {
+        start(current_milliseconds);
+        if (timer_node->is_armed())
+        {
+            timer_node->unlink();
+        }
+        else
+        {
+            ++_timer_number;
+        }
+
+        // 向上取整，保证不会提前到期
+        uint64_t expire_tick = (current_milliseconds + timeout_milliseconds + _tick_milliseconds - 1) / _tick_milliseconds;
+        timer_node->_expire_tick = (expire_tick < _current_tick)? _current_tick: expire_tick;
+        add_node(timer_node);
+    }
+
+    /***
+      * 停止定时器，如果定时器未启动，则什么也不做
+      * @timer_node: 定时器节点
+      */
+    void cancel(TimerNode* timer_node)
+    {
+        if (timer_node->is_armed())
+        {
+            timer_node->unlink();
+            --_timer_number;
+        }
+    }
+
+    /***
+      * 停止并取出任意一个已启动的定时器，通常用于退出时的清理
+      * @return: 如果没有已启动的定时器，则返回NULL
+      */
+    TimerNode* pop_timer()
+    {
+        if (_timer_number > 0)
+        {
+            for (int i=0; i<WHEEL_SLOT_NUMBER; ++i)
+            {
+                if (_slots[i]._next != &_slots[i])
+                {
+                    TimerNode* timer_node = _slots[i]._next;
+                    cancel(timer_node);
+                    return timer_node;
+                }
+            }
+        }
+
+        return NULL;
+    }
+
+    /***
+      * 检测哪些定时器到期了，对到期的回调ITimerHandler的on_timer_expired方法
+      * @current_milliseconds: 当前毫秒时间，应为单调递增的时间
+      */
+    void check_timeout(uint64_t current_milliseconds)
+    {
+        start(current_milliseconds);
+
+        uint64_t target_tick = current_milliseconds / _tick_milliseconds;
+        while (_current_tick <= target_tick)
+        {
+            // 无定时器时直接跳过，避免长时间未检测后的空转
+            if (0 == _timer_number)
+            {
+                _current_tick = target_tick + 1;
+                break;
+            }
+
+            run_tick();
+        }
+    }
+
+    /***
+      * 得到距离下一次可能到期的毫秒数，可用作epoll等待的超时值
+      * 如果第一层没有定时器，则返回到下一次迁移的毫秒数，因此结果只会偏小不会偏大
+      * @current_milliseconds: 当前毫秒时间
+      * @max_milliseconds: 结果的上限
+      */
+    uint32_t get_wait_milliseconds(uint64_t current_milliseconds, uint32_t max_milliseconds) const
+    {
+        if (0 == _timer_number) return max_milliseconds;
+
+        uint32_t ticks;
+        for (ticks=0; ticks<TVR_SIZE; ++ticks)
+        {
+            uint32_t index = (uint32_t)((_current_tick + ticks) & TVR_MASK);
+            if (_slots[index]._next != &_slots[index]) break;
+        }
+        if (TVR_SIZE == ticks)
+        {
+            ticks = TVR_SIZE - (uint32_t)(_current_tick & TVR_MASK);
+        }
+
+        uint64_t expire_milliseconds = (_current_tick + ticks) * _tick_milliseconds;
+        if (expire_milliseconds <= current_milliseconds) return 0;
+        if (expire_milliseconds - current_milliseconds > max_milliseconds) return max_milliseconds;
+        return (uint32_t)(expire_milliseconds - current_milliseconds);
+    }
+
+private:
+    // 首次使用时，以当前时间对齐刻度
+    void start(uint64_t current_milliseconds)
+    {
+        if (!_is_started)
+        {
+            _is_started = true;
+            _current_tick = current_milliseconds / _tick_milliseconds;
+        }
+    }
+
+    // 根据距离到期的刻度数放入对应层的槽中
+    void add_node(TimerNode* timer_node)
+    {
+        uint64_t expire_tick = timer_node->_expire_tick;
+        uint64_t delta = expire_tick - _current_tick;
+        int index;
+
+        if (delta < TVR_SIZE)
+        {
+            index = (int)(expire_tick & TVR_MASK);
+        }
+        else if (delta < ((uint64_t)1 << (TVR_BITS+TVN_BITS)))
+        {
+            index = TVR_SIZE + (int)((expire_tick >> TVR_BITS) & TVN_MASK);
+        }
+        else if (delta < ((uint64_t)1 << (TVR_BITS+2*TVN_BITS)))
+        {
+            index = TVR_SIZE + TVN_SIZE + (int)((expire_tick >> (TVR_BITS+TVN_BITS)) & TVN_MASK);
+        }
+        else
+        {
+            // 超出最长定时的，按最长定时处理
+            if (delta >= ((uint64_t)1 << (TVR_BITS+3*TVN_BITS)))
+            {
+                expire_tick = _current_tick + ((uint64_t)1 << (TVR_BITS+3*TVN_BITS)) - 1;
+                timer_node->_expire_tick = expire_tick;
+            }
+
+            index = TVR_SIZE + 2*TVN_SIZE + (int)((expire_tick >> (TVR_BITS+2*TVN_BITS)) & TVN_MASK);
+        }
+
+        // 插入到槽链表尾
+        TimerNode* head = &_slots[index];
+        timer_node->_prev = head->_prev;
+        timer_node->_next = head;
+        head->_prev->_next = timer_node;
+        head->_prev = timer_node;
+    }
+
+    // 将一个槽的链表整体移到list_head上，原槽变为空
+    void detach_slot(int index, TimerNode* list_head)
+    {
+        TimerNode* head = &_slots[index];
+        if (head->_next == head)
+        {
+            list_head->_prev = list_head;
+            list_head->_next = list_head;
+        }
+        else
+        {
+            list_head->_next = head->_next;
+            list_head->_prev = head->_prev;
+            list_head->_next->_prev = list_head;
+            list_head->_prev->_next = list_head;
+            head->_prev = head;
+            head->_next = head;
+        }
+    }
+
+    // 将上层（level取值1~3）当前槽中的定时器迁移到下层，返回当前槽号
+    int cascade(int level)
+    {
+        int index = (int)((_current_tick >> (TVR_BITS+(level-1)*TVN_BITS)) & TVN_MASK);
+        TimerNode list_head;
+
+        detach_slot(TVR_SIZE + (level-1)*TVN_SIZE + index, &list_head);
+        while (list_head._next != &list_head)
+        {
+            TimerNode* timer_node = list_head._next;
+            timer_node->unlink();
+            add_node(timer_node);
+        }
+
+        return index;
+    }
+
+    // 处理当前刻度，并前进一个刻度
+    void run_tick()
+    {
+        int index = (int)(_current_tick & TVR_MASK);
+        if ((0 == index) && (0 == cascade(1)) && (0 == cascade(2)))
+        {
+            cascade(3);
+        }
+
+        // 先整体摘出，回调中再启动的定时器就不会在本刻度内被处理
+        TimerNode list_head;
+        detach_slot(index, &list_head);
+        ++_current_tick;
+
+        while (list_head._next != &list_head)
+        {
+            TimerNode* timer_node = list_head._next;
+            timer_node->unlink();
+            --_timer_number;
+
+            _timer_handler->on_timer_expired(timer_node->get_owner(), timer_node->get_kind());
+        }
+    }
+
+private:
+    enum
+    {
+        TVR_BITS = 8,
+        TVN_BITS = 6,
+        TVR_SIZE = 1 << TVR_BITS,
+        TVN_SIZE = 1 << TVN_BITS,
+        TVR_MASK = TVR_SIZE - 1,
+        TVN_MASK = TVN_SIZE - 1,
+        WHEEL_SLOT_NUMBER = TVR_SIZE + 3*TVN_SIZE
+    };
+
+    bool _is_started;
+    uint32_t _tick_milliseconds;
+    uint64_t _current_tick;  // 下一个待处理的刻度
+    uint32_t _timer_number;
+    ITimerHandler<OwnerClass>* _timer_handler;
+    TimerNode _slots[WHEEL_SLOT_NUMBER]; // 各层的槽依次排列，每个槽为一个双向循环链表的头
+};
+
+UTIL_NAMESPACE_END
+#endif // MOOON_UTIL_TIMING_WHEEL_H
@@ -64,6 +64,15 @@ void CEpoller::destroy()
     }  
 }
 
+void CEpoller::relocate_events()
+{
+    struct epoll_event* events = new struct epoll_event[_epoll_size];
+    memset(events, 0, sizeof(struct epoll_event) * _epoll_size); // 由本线程首次访问
+    
+    delete []_events;
+    _events = events;
+}
+
 int CEpoller::timed_wait(uint32_t milliseconds)
 {
     int retval;
@@ -111,6 +120,21 @@ void CEpoller::set_events(CEpollable* epollable, int events, bool force)
     }
 }
 
+void CEpoller::rearm_events(CEpollable* epollable)
+{
+    int fd = epollable->get_fd();
+    if (fd != -1)
+    {
+        struct epoll_event event;
+        event.data.u64 = 0;
+        event.data.ptr = epollable;
+        event.events = epollable->get_epoll_events();
+
+        if (-1 == epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &event))
+            throw sys::CSyscallException(errno, __FILE__, __LINE__);
+    }
+}
+
 void CEpoller::del_events(CEpollable* epollable)
 {
     int fd = epollable->get_fd();
@@ -20,6 +20,10 @@
 #include <sys/util.h>
 #include "net/util.h"
 #include "net/listener.h"
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15 // 旧版本的glibc头文件中没有定义，但3.9及以上版本的内核支持
+#endif // SO_REUSEPORT
 NET_NAMESPACE_BEGIN
 
 CListener::CListener()
@@ -27,7 +31,7 @@ CListener::CListener()
 {
 }
 
-void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, bool enabled_address_zero)
+void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, bool enabled_address_zero, bool reuse_port)
 {    
     // 是否允许是任意地址上监听
     if (!enabled_address_zero && ip.is_zero_address())
@@ -74,6 +78,13 @@ void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, boo
         retval = ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
         if (-1 == retval) throw sys::CSyscallException(errno, __FILE__, __LINE__, "setsockopt error");
 
+        // 端口重用，多个套接字可同时监听相同的IP和端口，由内核分配连接
+        if (reuse_port)
+        {
+            retval = ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+            if (-1 == retval) throw sys::CSyscallException(errno, __FILE__, __LINE__, "setsockopt SO_REUSEPORT error");
+        }
+
         // 防止子进程继承
         retval = ::fcntl(fd, F_SETFD, FD_CLOEXEC);
         if (-1 == retval) throw sys::CSyscallException(errno, __FILE__, __LINE__, "fcntl error");
@@ -110,25 +121,26 @@ void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, boo
     }
 }
 
-void CListener::listen(const ipv4_node_t& ip_node, bool nonblock, bool enabled_address_zero)
+void CListener::listen(const ipv4_node_t& ip_node, bool nonblock, bool enabled_address_zero, bool reuse_port)
 {
     ip_address_t ip = ip_node.ip;
-    listen(ip, ip_node.port, nonblock, enabled_address_zero);
+    listen(ip, ip_node.port, nonblock, enabled_address_zero, reuse_port);
 }
 
-void CListener::listen(const ipv6_node_t& ip_node, bool nonblock, bool enabled_address_zero)
+void CListener::listen(const ipv6_node_t& ip_node, bool nonblock, bool enabled_address_zero, bool reuse_port)
 {
     ip_address_t ip = (uint32_t*)ip_node.ip;
-    listen(ip, ip_node.port, nonblock, enabled_address_zero);
+    listen(ip, ip_node.port, nonblock, enabled_address_zero, reuse_port);
 }
 
-int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port)
+int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port, int flags)
 {
     struct sockaddr_in6 peer_addr_in6;
     struct sockaddr* peer_addr = (struct sockaddr*)&peer_addr_in6;        
     socklen_t peer_addrlen = sizeof(struct sockaddr_in6); // 使用最大的
 
-    int newfd = ::accept(CEpollable::get_fd(), peer_addr, &peer_addrlen);
+    // flags为0时，accept4等同于accept
+    int newfd = ::accept4(CEpollable::get_fd(), peer_addr, &peer_addrlen, flags);
     if (-1 == newfd) 
     {
         if (sys::Error::code() != EWOULDBLOCK)
@@ -0,0 +1,92 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <stdio.h>
+#include "sys/clock.h"
+SYS_NAMESPACE_BEGIN
+
+// 老的内核和glibc没有COARSE时钟，退回到精确时钟
+#ifdef CLOCK_MONOTONIC_COARSE
+#define MONOTONIC_CLOCK_ID CLOCK_MONOTONIC_COARSE
+#else
+#define MONOTONIC_CLOCK_ID CLOCK_MONOTONIC
+#endif // CLOCK_MONOTONIC_COARSE
+
+#ifdef CLOCK_REALTIME_COARSE
+#define REALTIME_CLOCK_ID CLOCK_REALTIME_COARSE
+#else
+#define REALTIME_CLOCK_ID CLOCK_REALTIME
+#endif // CLOCK_REALTIME_COARSE
+
+// 线程私有的日期时间缓存
+static __thread time_t cached_seconds = 0;
+static __thread char cached_datetime[sizeof("YYYY-MM-DD HH:MM:SS")];
+
+time_t CClock::get_monotonic_seconds()
+{
+    struct timespec ts;
+    clock_gettime(MONOTONIC_CLOCK_ID, &ts);
+    return ts.tv_sec;
+}
+
+uint64_t CClock::get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    clock_gettime(MONOTONIC_CLOCK_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t CClock::get_monotonic_microseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+time_t CClock::get_realtime_seconds()
+{
+    struct timespec ts;
+    clock_gettime(REALTIME_CLOCK_ID, &ts);
+    return ts.tv_sec;
+}
+
+const char* CClock::get_cached_datetime()
+{
+    struct timespec ts;
+    clock_gettime(REALTIME_CLOCK_ID, &ts);
+    return get_cached_datetime(ts.tv_sec);
+}
+
+const char* CClock::get_cached_datetime(time_t seconds)
+{
+    // 同一秒内格式化结果不变，直接返回缓存
+    if (seconds != cached_seconds)
+    {
+        struct tm result;
+        localtime_r(&seconds, &result);
+        snprintf(cached_datetime, sizeof(cached_datetime)
+            ,"%04d-%02d-%02d %02d:%02d:%02d"
+            ,result.tm_year+1900, result.tm_mon+1, result.tm_mday
+            ,result.tm_hour, result.tm_min, result.tm_sec);
+        cached_seconds = seconds;
+    }
+
+    return cached_datetime;
+}
+
+SYS_NAMESPACE_END
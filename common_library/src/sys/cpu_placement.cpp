@@ -0,0 +1,191 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sys/cpu_placement.h"
+#include "sys/util.h"
+SYS_NAMESPACE_BEGIN
+
+bool CCpuPlacement::parse_cpu_list(const char* cpu_list, std::vector<uint16_t>* cpus)
+{
+    const char* str = cpu_list;
+    
+    while (*str != '\0')
+    {
+        char* end;
+        unsigned long first = strtoul(str, &end, 10);
+        if (end == str) return false;
+
+        unsigned long last = first;
+        str = end;
+        if ('-' == *str)
+        {
+            ++str;
+            last = strtoul(str, &end, 10);
+            if ((end == str) || (last < first)) return false;
+            str = end;
+        }
+
+        // 超出cpu_set_t能表示的范围，也避免巨大的范围撑爆cpus
+        if (last >= CPU_SETSIZE) return false;
+
+        for (unsigned long cpu=first; cpu<=last; ++cpu)
+            cpus->push_back(static_cast<uint16_t>(cpu));
+
+        if (',' == *str) 
+            ++str;
+        else if ((*str != '\0') && (*str != '\n'))
+            return false;
+        else
+            break;
+    }
+
+    return !cpus->empty();
+}
+
+void CCpuPlacement::get_numa_cpus(std::vector<std::vector<uint16_t> >* node_cpus)
+{
+    // 节点号可能不连续，所以遍历目录，而不是遇到第一个不存在的节点就停止
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir != NULL)
+    {
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != NULL)
+        {
+            int node;
+            char tail;
+            if (sscanf(ent->d_name, "node%d%c", &node, &tail) != 1) continue;
+            if ((node < 0) || (node >= CPU_SETSIZE)) continue;
+
+            char filename[PATH_MAX];
+            snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%d/cpulist", node);
+            FILE* fp = fopen(filename, "r");
+            if (NULL == fp) continue;
+
+            // 只有内存没有CPU的节点，cpulist为空行
+            char line[LINE_MAX];
+            std::vector<uint16_t> cpus;
+            if ((fgets(line, sizeof(line), fp) != NULL) && parse_cpu_list(line, &cpus))
+            {
+                if (node_cpus->size() <= static_cast<size_t>(node))
+                    node_cpus->resize(node+1);
+                (*node_cpus)[node].swap(cpus);
+            }
+
+            fclose(fp);
+        }
+
+        closedir(dir);
+    }
+
+    if (node_cpus->empty())
+    {
+        std::vector<uint16_t> cpus;
+        uint16_t cpu_number = CUtil::get_cpu_number();
+        for (uint16_t cpu=0; cpu<cpu_number; ++cpu)
+            cpus.push_back(cpu);
+        
+        node_cpus->push_back(cpus);
+    }
+}
+
+CCpuPlacement::CCpuPlacement()
+{
+}
+
+bool CCpuPlacement::create(placement_policy_t policy, const char* cpu_list)
+{
+    _cpus.clear();
+    if (placement_none == policy) return true;
+    
+    if (placement_explicit == policy)
+    {
+        if ((NULL == cpu_list) || !parse_cpu_list(cpu_list, &_cpus))
+        {
+            _cpus.clear();
+            return false;
+        }
+
+        // 在这里拒绝不存在的CPU，否则要到线程启动设置亲和性时才失败
+        uint16_t cpu_number = CUtil::get_cpu_number();
+        for (std::vector<uint16_t>::size_type i=0; i<_cpus.size(); ++i)
+        {
+            if (_cpus[i] >= cpu_number)
+            {
+                _cpus.clear();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::vector<std::vector<uint16_t> > node_cpus;
+    get_numa_cpus(&node_cpus);
+
+    if (placement_compact == policy)
+    {
+        for (std::vector<std::vector<uint16_t> >::size_type node=0; node<node_cpus.size(); ++node)
+            _cpus.insert(_cpus.end(), node_cpus[node].begin(), node_cpus[node].end());
+    }
+    else if (placement_scatter == policy)
+    {
+        // 每轮从各节点各取一个CPU
+        for (std::vector<uint16_t>::size_type i=0;; ++i)
+        {
+            bool found = false;
+            for (std::vector<std::vector<uint16_t> >::size_type node=0; node<node_cpus.size(); ++node)
+            {
+                if (i < node_cpus[node].size())
+                {
+                    found = true;
+                    _cpus.push_back(node_cpus[node][i]);
+                }
+            }
+
+            if (!found) break;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+int CCpuPlacement::get_cpu(uint16_t index) const
+{
+    if (_cpus.empty()) return -1;
+    return _cpus[index % _cpus.size()];
+}
+
+bool CCpuPlacement::get_cpu_set(uint16_t index, cpu_set_t* cpu_set) const
+{
+    int cpu = get_cpu(index);
+    if (-1 == cpu) return false;
+
+    CPU_ZERO(cpu_set);
+    CPU_SET(cpu, cpu_set);
+    return true;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,74 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "sys/error.h"
+#include "sys/futex_event.h"
+#include "sys/syscall_exception.h"
+SYS_NAMESPACE_BEGIN
+
+CFutexEvent::CFutexEvent()
+    :_sequence(0)
+    ,_waiter_number(0)
+{
+}
+
+int CFutexEvent::prepare_wait()
+{
+    // __sync_fetch_and_add为全屏障，保证之后检查条件时能看到signal之前的修改
+    (void)__sync_fetch_and_add(&_waiter_number, 1);
+    return _sequence;
+}
+
+void CFutexEvent::cancel_wait()
+{
+    (void)__sync_fetch_and_sub(&_waiter_number, 1);
+}
+
+bool CFutexEvent::wait(int sequence, uint32_t milliseconds)
+{
+    struct timespec ts;
+    ts.tv_sec = milliseconds / 1000;
+    ts.tv_nsec = (milliseconds % 1000) * 1000000;
+
+    long retval = syscall(SYS_futex, &_sequence, FUTEX_WAIT_PRIVATE, sequence, &ts, NULL, 0);
+    int errcode = Error::code();
+    cancel_wait();
+
+    if (0 == retval) return true;
+    if (ETIMEDOUT == errcode) return false;
+    // EAGAIN表示序号已变化，EINTR时由调用者重新检查条件
+    if ((EAGAIN == errcode) || (EINTR == errcode)) return true;
+    throw CSyscallException(errcode, __FILE__, __LINE__, "futex wait");
+}
+
+void CFutexEvent::signal(int number)
+{
+    // 和prepare_wait的屏障配对，保证条件的修改先于读_waiter_number
+    __sync_synchronize();
+    if (_waiter_number > 0)
+    {
+        (void)__sync_fetch_and_add(&_sequence, 1);
+        if (-1 == syscall(SYS_futex, &_sequence, FUTEX_WAKE_PRIVATE, number, NULL, NULL, 0))
+            throw CSyscallException(Error::code(), __FILE__, __LINE__, "futex wake");
+    }
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,120 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include "sys/log.h"
+#include "sys/clock.h"
+
+// 被丢弃行数的摘要，用宏以便编译器检查参数
+#define LOG_SUMMARY_FORMAT "%u lines suppressed by rate limit in last %u seconds"
+SYS_NAMESPACE_BEGIN
+
+volatile uint32_t CLogLimiter::_rate = 0;
+volatile uint32_t CLogLimiter::_burst = 0;
+volatile uint32_t CLogLimiter::_sample_number = 0;
+volatile uint32_t CLogLimiter::_summary_seconds = 10;
+
+void CLogLimiter::set_limit(uint32_t rate, uint32_t burst, uint32_t sample_number, uint32_t summary_seconds)
+{
+    // 令牌以千分之一行为单位存放在int32_t中
+    _burst = (burst > 2000000)? 2000000: burst;
+    _sample_number = sample_number;
+    _summary_seconds = (0 == summary_seconds)? 1: summary_seconds;
+    _rate = (rate > 2000000)? 2000000: rate;
+}
+
+bool CLogLimiter::allow(ILogger* logger, log_level_t log_level, const char* filename, int lineno, const char* module_name)
+{
+    uint32_t rate = _rate;
+    if (0 == rate) return true;
+
+    // 丢弃期间也要周期性地输出摘要，而不是等到下一次放行
+    uint64_t now_milliseconds = CClock::get_monotonic_milliseconds();
+    if ((_suppressed_number > 0) && (now_milliseconds - _summary_milliseconds >= _summary_seconds * 1000ULL))
+        log_summary(logger, log_level, filename, lineno, module_name, now_milliseconds);
+
+    if (take_token(now_milliseconds, rate))
+        return true;
+
+    // 令牌用完后按1/N采样放行
+    uint32_t sample_number = _sample_number;
+    if ((sample_number > 0) && (0 == __sync_fetch_and_add(&_sample_counter, 1) % sample_number))
+        return true;
+
+    // 从开始丢弃时计算摘要的间隔
+    if (0 == __sync_fetch_and_add(&_suppressed_number, 1))
+    {
+        uint64_t summary_milliseconds = _summary_milliseconds;
+        if (now_milliseconds - summary_milliseconds >= _summary_seconds * 1000ULL)
+            (void)__sync_bool_compare_and_swap(&_summary_milliseconds, summary_milliseconds, now_milliseconds);
+    }
+
+    return false;
+}
+
+bool CLogLimiter::take_token(uint64_t now_milliseconds, uint32_t rate)
+{
+    int32_t capacity = static_cast<int32_t>((0 == _burst)? rate: _burst) * 1000;
+    uint64_t refill_milliseconds = _refill_milliseconds;
+
+    // 只有交换成功的线程补充这段时间的令牌，第一次调用时桶被装满
+    if ((now_milliseconds > refill_milliseconds)
+     && __sync_bool_compare_and_swap(&_refill_milliseconds, refill_milliseconds, now_milliseconds))
+    {
+        uint64_t refill = (now_milliseconds - refill_milliseconds) * rate;
+        int32_t tokens = _tokens;
+        if (tokens < capacity)
+        {
+            if (refill > static_cast<uint64_t>(capacity - tokens))
+                refill = static_cast<uint64_t>(capacity - tokens);
+            (void)__sync_fetch_and_add(&_tokens, static_cast<int32_t>(refill));
+        }
+    }
+
+    if (__sync_sub_and_fetch(&_tokens, 1000) >= 0)
+        return true;
+
+    (void)__sync_fetch_and_add(&_tokens, 1000);
+    return false;
+}
+
+void CLogLimiter::log_summary(ILogger* logger, log_level_t log_level, const char* filename, int lineno, const char* module_name, uint64_t now_milliseconds)
+{
+    // 只有一个线程输出摘要
+    uint64_t summary_milliseconds = _summary_milliseconds;
+    if (!__sync_bool_compare_and_swap(&_summary_milliseconds, summary_milliseconds, now_milliseconds))
+        return;
+
+    uint32_t suppressed_number = __sync_fetch_and_and(&_suppressed_number, 0);
+    if (0 == suppressed_number)
+        return;
+
+    uint32_t seconds = static_cast<uint32_t>((now_milliseconds - summary_milliseconds) / 1000);
+    switch (log_level)
+    {
+    case LOG_LEVEL_DETAIL: logger->log_detail(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds); break;
+    case LOG_LEVEL_DEBUG:  logger->log_debug(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);  break;
+    case LOG_LEVEL_INFO:   logger->log_info(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);   break;
+    case LOG_LEVEL_WARN:   logger->log_warn(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);   break;
+    case LOG_LEVEL_ERROR:  logger->log_error(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);  break;
+    case LOG_LEVEL_FATAL:  logger->log_fatal(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);  break;
+    case LOG_LEVEL_STATE:  logger->log_state(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);  break;
+    default:               logger->log_trace(filename, lineno, module_name, LOG_SUMMARY_FORMAT, suppressed_number, seconds);  break;
+    }
+}
+
+SYS_NAMESPACE_END
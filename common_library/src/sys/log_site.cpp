@@ -0,0 +1,560 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/clock.h>
+#include <sys/error.h>
+#include <sys/log_site.h>
+#include <sys/syscall_exception.h>
+
+// log_decoder一次读入的字节数，须大于最大的记录
+#define DECODE_BUFFER_SIZE (1024 * 1024)
+SYS_NAMESPACE_BEGIN
+
+/** snprintf类函数的返回值转换成实际写入的字节数，不包括结尾符 */
+static uint32_t get_written_length(int expected, uint32_t size)
+{
+    if (expected < 0) return 0;
+    return (static_cast<uint32_t>(expected) < size)? static_cast<uint32_t>(expected): size-1;
+}
+
+/***
+  * 由转换符和长度修饰得到参数类型：
+  * 'i'为int，'l'为long，'q'为long long，'d'为double，'s'为字符串，'p'为指针，
+  * 返回0表示不支持延迟格式化
+  */
+static char get_arg_type(char conversion, const std::string& length_modifier)
+{
+    switch (conversion)
+    {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        if (length_modifier.empty() || ("h" == length_modifier) || ("hh" == length_modifier)) return 'i';
+        if (("l" == length_modifier) || ("z" == length_modifier) || ("t" == length_modifier)) return 'l';
+        if (("ll" == length_modifier) || ("q" == length_modifier) || ("j" == length_modifier)) return 'q';
+        return 0;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        return (length_modifier.empty() || ("l" == length_modifier))? 'd': 0;
+    case 'c':
+        return length_modifier.empty()? 'i': 0;
+    case 's':
+        return length_modifier.empty()? 's': 0;
+    case 'p':
+        return length_modifier.empty()? 'p': 0;
+    default: // %n和%m等
+        return 0;
+    }
+}
+
+static bool put_value(char*& position, const char* end, const void* value, uint32_t size)
+{
+    if (static_cast<uint32_t>(end - position) < size) return false;
+    memcpy(position, value, size);
+    position += size;
+    return true;
+}
+
+static bool get_value(const char*& position, const char* end, void* value, uint32_t size)
+{
+    if (static_cast<uint32_t>(end - position) < size) return false;
+    memcpy(value, position, size);
+    position += size;
+    return true;
+}
+
+template <typename ValueType>
+static uint32_t format_segment(char* buffer, uint32_t size, const char* format, uint8_t star_number, const int* stars, ValueType value)
+{
+    int expected;
+    if (2 == star_number)
+        expected = snprintf(buffer, size, format, stars[0], stars[1], value);
+    else if (1 == star_number)
+        expected = snprintf(buffer, size, format, stars[0], value);
+    else
+        expected = snprintf(buffer, size, format, value);
+
+    return get_written_length(expected, size);
+}
+
+static void write_text(int text_fd, const char* text, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t retval = write(text_fd, text, size);
+        if (-1 == retval)
+        {
+            if (EINTR == Error::code()) continue;
+            throw CSyscallException(Error::code(), __FILE__, __LINE__, "write text log");
+        }
+
+        text += retval;
+        size -= static_cast<size_t>(retval);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CLogSite
+CLogSite::CLogSite(uint32_t site_id, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format)
+    :_site_id(site_id)
+    ,_log_level(log_level)
+    ,_lineno(lineno)
+    ,_deferrable(true)
+    ,_filename(filename)
+    ,_module_name((NULL == module_name)? "": module_name)
+    ,_format(format)
+    ,_filename_address(filename)
+    ,_format_address(format)
+{
+    parse_format();
+
+    // 调用点记录的长度须能用uint16_t表示
+    if (sizeof(log_record_t) + sizeof(uint32_t) + 1 + _module_name.size() + _filename.size() + _format.size() + 3 > 0xFFFF)
+        _deferrable = false;
+}
+
+void CLogSite::parse_format()
+{
+    const std::string::size_type size = _format.size();
+    std::string::size_type start = 0;
+    std::string::size_type i = 0;
+
+    while (i < size)
+    {
+        if (_format[i] != '%')
+        {
+            ++i;
+            continue;
+        }
+        if ((i+1 < size) && ('%' == _format[i+1]))
+        {
+            i += 2;
+            continue;
+        }
+
+        Segment segment;
+        segment.star_number = 0;
+
+        // 标志
+        ++i;
+        while ((i < size) && (strchr("-+ #0'I", _format[i]) != NULL))
+            ++i;
+
+        // 宽度
+        if ((i < size) && ('*' == _format[i]))
+        {
+            ++segment.star_number;
+            ++i;
+        }
+        else
+        {
+            while ((i < size) && (_format[i] >= '0') && (_format[i] <= '9'))
+                ++i;
+        }
+
+        // 不支持%1$s这样指定位置的参数
+        if ((i < size) && ('$' == _format[i]))
+        {
+            _deferrable = false;
+            return;
+        }
+
+        // 精度
+        if ((i < size) && ('.' == _format[i]))
+        {
+            ++i;
+            if ((i < size) && ('*' == _format[i]))
+            {
+                ++segment.star_number;
+                ++i;
+            }
+            else
+            {
+                while ((i < size) && (_format[i] >= '0') && (_format[i] <= '9'))
+                    ++i;
+            }
+        }
+
+        // 长度修饰
+        std::string length_modifier;
+        while ((i < size) && (strchr("hlLqjzt", _format[i]) != NULL))
+            length_modifier += _format[i++];
+
+        segment.arg_type = (i < size)? get_arg_type(_format[i++], length_modifier): 0;
+        if (0 == segment.arg_type)
+        {
+            _deferrable = false;
+            return;
+        }
+
+        segment.format = _format.substr(start, i-start);
+        _segments.push_back(segment);
+        start = i;
+    }
+
+    // 最后一段不含转换的文本，直接复制即可
+    if (start < size)
+    {
+        Segment segment;
+        segment.star_number = 0;
+        segment.arg_type = 0;
+
+        for (i=start; i<size; ++i)
+        {
+            segment.format += _format[i];
+            if (('%' == _format[i]) && (i+1 < size) && ('%' == _format[i+1]))
+                ++i;
+        }
+
+        _segments.push_back(segment);
+    }
+}
+
+int CLogSite::encode_args(char* buffer, uint32_t buffer_size, va_list& args) const
+{
+    char* position = buffer;
+    const char* end = buffer + buffer_size;
+
+    for (std::vector<Segment>::size_type i=0; i<_segments.size(); ++i)
+    {
+        const Segment& segment = _segments[i];
+        for (uint8_t j=0; j<segment.star_number; ++j)
+        {
+            int star = va_arg(args, int);
+            if (!put_value(position, end, &star, sizeof(star))) return -1;
+        }
+
+        bool put = true;
+        switch (segment.arg_type)
+        {
+        case 'i':
+            {
+                int value = va_arg(args, int);
+                put = put_value(position, end, &value, sizeof(value));
+            }
+            break;
+        case 'l':
+            {
+                int64_t value = va_arg(args, long);
+                put = put_value(position, end, &value, sizeof(value));
+            }
+            break;
+        case 'q':
+            {
+                int64_t value = va_arg(args, long long);
+                put = put_value(position, end, &value, sizeof(value));
+            }
+            break;
+        case 'd':
+            {
+                double value = va_arg(args, double);
+                put = put_value(position, end, &value, sizeof(value));
+            }
+            break;
+        case 'p':
+            {
+                uint64_t value = reinterpret_cast<uintptr_t>(va_arg(args, void*));
+                put = put_value(position, end, &value, sizeof(value));
+            }
+            break;
+        case 's':
+            {
+                // 字符串为长度加内容，长度0xFFFF表示NULL
+                const char* value = va_arg(args, const char*);
+                uint16_t length = 0xFFFF;
+                if (value != NULL)
+                {
+                    size_t value_length = strlen(value);
+                    uint32_t space = (end - position > 2)? static_cast<uint32_t>(end - position - 2): 0;
+                    if (value_length > space) value_length = space;
+                    if (value_length > 0xFFFE) value_length = 0xFFFE;
+                    length = static_cast<uint16_t>(value_length);
+                }
+
+                put = put_value(position, end, &length, sizeof(length));
+                if (put && (length != 0xFFFF))
+                    put = put_value(position, end, value, length);
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (!put) return -1;
+    }
+
+    return static_cast<int>(position - buffer);
+}
+
+uint32_t CLogSite::format(char* line, uint32_t line_size, const log_record_t& record, const char* args, uint32_t args_size) const
+{
+    uint32_t length = get_written_length(snprintf(line, line_size, "[%s][0x%08x][%s]"
+        , CClock::get_cached_datetime(record.seconds), record.thread_id, get_log_level_name(_log_level)), line_size);
+    if (!_module_name.empty())
+    {
+        length += get_written_length(snprintf(line+length, line_size-length, "[%s]", _module_name.c_str()), line_size-length);
+    }
+    length += get_written_length(snprintf(line+length, line_size-length, "[%s:%d]", _filename.c_str(), _lineno), line_size-length);
+
+    const char* position = args;
+    const char* end = args + args_size;
+    for (std::vector<Segment>::size_type i=0; (i<_segments.size()) && (length+1<line_size); ++i)
+    {
+        const Segment& segment = _segments[i];
+        const char* segment_format = segment.format.c_str();
+        char* buffer = line + length;
+        uint32_t size = line_size - length;
+
+        int stars[2] = { 0, 0 };
+        bool got = true;
+        for (uint8_t j=0; got && (j<segment.star_number); ++j)
+            got = get_value(position, end, &stars[j], sizeof(stars[j]));
+
+        switch (segment.arg_type)
+        {
+        case 0:
+            {
+                uint32_t segment_length = static_cast<uint32_t>(segment.format.size());
+                if (segment_length > size-1) segment_length = size-1;
+                memcpy(buffer, segment_format, segment_length);
+                length += segment_length;
+            }
+            break;
+        case 'i':
+            {
+                int value;
+                got = got && get_value(position, end, &value, sizeof(value));
+                if (got) length += format_segment(buffer, size, segment_format, segment.star_number, stars, value);
+            }
+            break;
+        case 'l':
+            {
+                int64_t value;
+                got = got && get_value(position, end, &value, sizeof(value));
+                if (got) length += format_segment(buffer, size, segment_format, segment.star_number, stars, static_cast<long>(value));
+            }
+            break;
+        case 'q':
+            {
+                int64_t value;
+                got = got && get_value(position, end, &value, sizeof(value));
+                if (got) length += format_segment(buffer, size, segment_format, segment.star_number, stars, static_cast<long long>(value));
+            }
+            break;
+        case 'd':
+            {
+                double value;
+                got = got && get_value(position, end, &value, sizeof(value));
+                if (got) length += format_segment(buffer, size, segment_format, segment.star_number, stars, value);
+            }
+            break;
+        case 'p':
+            {
+                uint64_t value;
+                got = got && get_value(position, end, &value, sizeof(value));
+                if (got) length += format_segment(buffer, size, segment_format, segment.star_number, stars, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+            }
+            break;
+        case 's':
+            {
+                uint16_t value_length;
+                got = got && get_value(position, end, &value_length, sizeof(value_length));
+                if (!got) break;
+
+                if (0xFFFF == value_length)
+                {
+                    length += format_segment(buffer, size, segment_format, segment.star_number, stars, static_cast<const char*>(NULL));
+                }
+                else if (static_cast<uint32_t>(end - position) < value_length)
+                {
+                    got = false;
+                }
+                else
+                {
+                    std::string value(position, value_length);
+                    position += value_length;
+                    length += format_segment(buffer, size, segment_format, segment.star_number, stars, value.c_str());
+                }
+            }
+            break;
+        default:
+            break;
+        }
+
+        // 参数不完整，只可能是文件损坏，输出已格式化的部分
+        if (!got) break;
+    }
+
+    // 自动添加结尾点号
+    if ((record.flags & LOG_RECORD_FLAG_ADDDOT) && (length > 0)
+     && (line[length-1] != '.')
+     && (line[length-1] != '\n'))
+    {
+        line[length++] = '.';
+    }
+
+    // 自动添加换行符
+    if ((record.flags & LOG_RECORD_FLAG_NEWLINE) && (length > 0) && (line[length-1] != '\n'))
+    {
+        line[length++] = '\n';
+    }
+
+    return length;
+}
+
+void CLogSite::encode_site(std::string* site_record) const
+{
+    log_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.length = static_cast<uint16_t>(sizeof(record) + sizeof(uint32_t) + 1 + _module_name.size() + _filename.size() + _format.size() + 3);
+    record.type = log_record_site;
+    record.site_id = _site_id;
+
+    uint32_t lineno = static_cast<uint32_t>(_lineno);
+    uint8_t log_level = static_cast<uint8_t>(_log_level);
+    site_record->append(reinterpret_cast<const char*>(&record), sizeof(record));
+    site_record->append(reinterpret_cast<const char*>(&lineno), sizeof(lineno));
+    site_record->append(reinterpret_cast<const char*>(&log_level), sizeof(log_level));
+    site_record->append(_module_name.c_str(), _module_name.size()+1);
+    site_record->append(_filename.c_str(), _filename.size()+1);
+    site_record->append(_format.c_str(), _format.size()+1);
+}
+
+CLogSite* CLogSite::decode_site(const log_record_t& record, const char* payload, uint32_t payload_size)
+{
+    uint32_t lineno;
+    uint8_t log_level;
+    const char* position = payload;
+    const char* end = payload + payload_size;
+    if (!get_value(position, end, &lineno, sizeof(lineno))) return NULL;
+    if (!get_value(position, end, &log_level, sizeof(log_level))) return NULL;
+    if (log_level > LOG_LEVEL_TRACE) return NULL;
+
+    // 模块名、文件名和格式串依次以'\0'结尾
+    const char* strings[3];
+    for (int i=0; i<3; ++i)
+    {
+        const char* terminator = static_cast<const char*>(memchr(position, '\0', end-position));
+        if (NULL == terminator) return NULL;
+
+        strings[i] = position;
+        position = terminator + 1;
+    }
+
+    return new CLogSite(record.site_id, static_cast<log_level_t>(log_level), strings[1], static_cast<int>(lineno)
+                      , ('\0' == strings[0][0])? NULL: strings[0], strings[2]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+uint64_t decode_binary_log(int binary_fd, int text_fd)
+{
+    uint64_t line_number = 0;
+    uint32_t data_size = 0; // buffer中尚未处理的字节数
+    std::vector<char> buffer(DECODE_BUFFER_SIZE);
+    std::vector<char> line(LOG_LINE_SIZE_MAX+2);
+    std::vector<CLogSite*> site_array;
+    std::string text;
+
+    try
+    {
+        for (;;)
+        {
+            ssize_t retval = read(binary_fd, &buffer[data_size], buffer.size()-data_size);
+            if (-1 == retval)
+            {
+                if (EINTR == Error::code()) continue;
+                throw CSyscallException(Error::code(), __FILE__, __LINE__, "read binary log");
+            }
+            if (0 == retval)
+            {
+                break;
+            }
+
+            uint32_t offset = 0;
+            data_size += static_cast<uint32_t>(retval);
+            while (data_size - offset >= sizeof(log_record_t))
+            {
+                log_record_t record;
+                memcpy(&record, &buffer[offset], sizeof(record));
+                if (record.length < sizeof(record))
+                    throw CSyscallException(EINVAL, __FILE__, __LINE__, "invalid binary log record");
+                if (record.length > data_size - offset)
+                    break; // 记录不完整，读入更多数据
+
+                const char* payload = &buffer[offset+sizeof(record)];
+                uint32_t payload_size = record.length - sizeof(record);
+                if (log_record_site == record.type)
+                {
+                    CLogSite* site = CLogSite::decode_site(record, payload, payload_size);
+                    if (NULL == site)
+                        throw CSyscallException(EINVAL, __FILE__, __LINE__, "invalid binary log site");
+
+                    // 日志滚动后的新文件会重新写入调用点
+                    if (record.site_id >= site_array.size())
+                        site_array.resize(record.site_id+1, NULL);
+                    delete site_array[record.site_id];
+                    site_array[record.site_id] = site;
+                }
+                else if (log_record_binary == record.type)
+                {
+                    if ((record.site_id >= site_array.size()) || (NULL == site_array[record.site_id]))
+                        throw CSyscallException(EINVAL, __FILE__, __LINE__, "undefined binary log site");
+
+                    uint32_t length = site_array[record.site_id]->format(&line[0], LOG_LINE_SIZE_MAX, record, payload, payload_size);
+                    text.append(&line[0], length);
+                    ++line_number;
+                }
+                else if (log_record_text == record.type)
+                {
+                    text.append(payload, payload_size);
+                    ++line_number;
+                }
+                else
+                {
+                    throw CSyscallException(EINVAL, __FILE__, __LINE__, "unknown binary log record");
+                }
+
+                offset += record.length;
+                if (text.size() >= DECODE_BUFFER_SIZE)
+                {
+                    write_text(text_fd, text.data(), text.size());
+                    text.clear();
+                }
+            }
+
+            data_size -= offset;
+            memmove(&buffer[0], &buffer[offset], data_size);
+        }
+
+        write_text(text_fd, text.data(), text.size());
+        if (data_size > 0)
+            throw CSyscallException(EINVAL, __FILE__, __LINE__, "truncated binary log record");
+    }
+    catch (CSyscallException& ex)
+    {
+        for (std::vector<CLogSite*>::size_type i=0; i<site_array.size(); ++i)
+            delete site_array[i];
+        throw;
+    }
+
+    for (std::vector<CLogSite*>::size_type i=0; i<site_array.size(); ++i)
+        delete site_array[i];
+    return line_number;
+}
+
+SYS_NAMESPACE_END
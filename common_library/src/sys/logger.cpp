@@ -18,11 +18,17 @@
  */
 #include <stdarg.h>
 #include <stdio.h>
+#include <sched.h>
 #include <unistd.h>
+#include <zlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <util/string_util.h>
 #include <sys/util.h>
 #include <sys/logger.h>
+#include <sys/clock.h>
 #include <sys/datetime_util.h>
+#include <sys/cpu_placement.h>
 
 #if HAVE_UIO_H==1 // 需要使用sys_config.h中定义的HAVE_UIO_H宏
 #include <sys/uio.h>
@@ -59,6 +65,112 @@ const char* get_log_level_name(log_level_t log_level)
     return log_level_name_array[log_level];
 }
 
+/** snprintf类函数的返回值转换成实际写入的字节数，不包括结尾符 */
+static uint32_t get_written_length(int expected, uint32_t size)
+{
+    if (expected < 0) return 0;
+    return (static_cast<uint32_t>(expected) < size)? static_cast<uint32_t>(expected): size-1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CLogRing
+CLogRing::CLogRing(uint32_t ring_size)
+    :_ring_size(ring_size)
+    ,_head(0)
+    ,_tail(0)
+    ,_wrap_end(0)
+    ,_wrap_pending(false)
+    ,_closed(false)
+{
+    _buffer = new char[ring_size];
+}
+
+CLogRing::~CLogRing()
+{
+    delete []_buffer;
+}
+
+char* CLogRing::reserve(uint32_t size)
+{
+    uint32_t head = _head;
+    uint32_t tail = _tail;
+    __sync_synchronize(); // 读到head后，才能使用head之前的空间
+
+    // 尾部总是至少留一个字节，这样_head等于_tail只表示空
+    if (tail >= head)
+    {
+        if (_ring_size - tail > size) return _buffer + tail;
+        if (head > size)
+        {
+            _wrap_pending = true;
+            return _buffer;
+        }
+    }
+    else if (head - tail > size)
+    {
+        return _buffer + tail;
+    }
+
+    return NULL;
+}
+
+void CLogRing::commit(char* position, uint32_t length)
+{
+    uint32_t tail = static_cast<uint32_t>(position - _buffer) + length;
+    if (_wrap_pending)
+    {
+        _wrap_pending = false;
+        _wrap_end = _tail;
+    }
+
+    // 数据和_wrap_end须先于_tail对消费者可见
+    __sync_synchronize();
+    _tail = tail;
+}
+
+uint32_t CLogRing::peek(struct iovec* iov, int& iovcnt) const
+{
+    uint32_t head = _head;
+    uint32_t tail = _tail;
+    __sync_synchronize();
+
+    iovcnt = 0;
+    if (tail >= head)
+    {
+        if (tail > head)
+        {
+            iov[0].iov_base = _buffer + head;
+            iov[0].iov_len = tail - head;
+            iovcnt = 1;
+        }
+    }
+    else
+    {
+        // 生产者已从头开始，先写尾部剩余的，再写头部的
+        if (_wrap_end > head)
+        {
+            iov[iovcnt].iov_base = _buffer + head;
+            iov[iovcnt].iov_len = _wrap_end - head;
+            ++iovcnt;
+        }
+        if (tail > 0)
+        {
+            iov[iovcnt].iov_base = _buffer;
+            iov[iovcnt].iov_len = tail;
+            ++iovcnt;
+        }
+    }
+
+    return tail;
+}
+
+void CLogRing::release(uint32_t head)
+{
+    // 数据已被写出后，空间才可被生产者重用
+    __sync_synchronize();
+    _head = head;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // CLogProber
 CLogProber::CLogProber()
@@ -111,6 +223,8 @@ void CLogProber::read_signal(int signal_number)
 //////////////////////////////////////////////////////////////////////////
 CLock CLogger::_thread_lock;
 CLogThread* CLogger::_log_thread = NULL;
+bool CLogger::_has_thread_cpu_set = false;
+cpu_set_t CLogger::_thread_cpu_set;
 
 CLogger::CLogger(uint16_t log_line_size)
     :_log_fd(-1)
@@ -121,16 +235,32 @@ CLogger::CLogger(uint16_t log_line_size)
     ,_registered(false)
     ,_destroying(false)
     ,_screen_enabled(false)    
+    ,_compress_enabled(false)
+    ,_rotate_time(0)
+    ,_rotate_sequence(0)
     ,_current_bytes(0)
     ,_log_queue(NULL)
     ,_waiter_number(0)
+    ,_ring_size(0)
+    ,_log_format(log_format_text)
+    ,_site_table(NULL)
+    ,_site_array(NULL)
+    ,_site_number(0)
+    ,_format_buffer(NULL)
 {    
+    atomic_set(&_ring_signaled, 0);
     atomic_set(&_max_bytes, DEFAULT_LOG_FILE_SIZE);
     atomic_set(&_log_level, LOG_LEVEL_INFO);
     atomic_set(&_backup_number, DEFAULT_LOG_FILE_BACKUP_NUMBER);
+    atomic_set(&_rotate_seconds, 0);
 
-    // 保证日志行最大长度不小于指定值
-    _log_line_size = (log_line_size < LOG_LINE_SIZE_MIN)? LOG_LINE_SIZE_MIN: log_line_size;
+    // 保证日志行最大长度在指定范围内，记录中的长度为uint16_t，不能超过LOG_LINE_SIZE_MAX
+    if (log_line_size < LOG_LINE_SIZE_MIN)
+        _log_line_size = LOG_LINE_SIZE_MIN;
+    else if (log_line_size > LOG_LINE_SIZE_MAX)
+        _log_line_size = LOG_LINE_SIZE_MAX;
+    else
+        _log_line_size = log_line_size;
 }
 
 CLogger::~CLogger()
@@ -140,6 +270,22 @@ CLogger::~CLogger()
     delete _log_queue;
     _log_queue = NULL;
 
+    // 删除key后，线程退出时不会再回调close_thread_ring
+    if (_ring_size > 0)
+    {
+        (void)pthread_key_delete(_ring_key);
+        for (std::vector<CLogRing*>::size_type i=0; i<_ring_array.size(); ++i)
+            delete _ring_array[i];
+        _ring_array.clear();
+    }
+
+    // 调用点只在Logger销毁时删除
+    for (uint32_t i=0; i<_site_number; ++i)
+        delete _site_array[i];
+    delete []_site_table;
+    delete []_site_array;
+    delete []_format_buffer;
+
     if (_log_fd != -1)
     {
         close(_log_fd);
@@ -149,6 +295,13 @@ CLogger::~CLogger()
 
 void CLogger::destroy()
 {       
+    if (_ring_size > 0)
+    {
+        // 日志线程写完所有环形缓冲区后，看到_destroying即停止Logger
+        _destroying = true;
+        wakeup_log_thread();
+    }
+    else
     { // _queue_lock
         LockHelper<CLock> lh(_queue_lock);
 
@@ -176,17 +329,42 @@ void CLogger::destroy()
     } // CLogger::_thread_lock
 }
 
-void CLogger::create(const char* log_path, const char* log_filename, uint32_t log_queue_size)
+void CLogger::create(const char* log_path, const char* log_filename, uint32_t log_queue_size, uint32_t ring_size)
 {
     // 日志文件路径和文件名
     snprintf(_log_path, sizeof(_log_path), "%s", log_path);
     snprintf(_log_filename, sizeof(_log_filename), "%s", log_filename);    
 
-    // 创建日志队列
-    uint32_t log_queue_size_ = log_queue_size;
-    if (0 == log_queue_size_)
-        log_queue_size_ = 1;
-    _log_queue = new util::CArrayQueue<log_message_t*>(log_queue_size_);
+    if (ring_size > 0)
+    {
+        // 每个线程的环形缓冲区在该线程第一次写日志时创建
+        int errcode = pthread_key_create(&_ring_key, close_thread_ring);
+        if (errcode != 0)
+            throw CSyscallException(errcode, __FILE__, __LINE__, "logger pthread_key_create");
+
+        // 环形缓冲区至少能容纳几条最长的日志，否则空的缓冲区也可能因回绕放不下一条，写日志的线程将一直等待
+        uint32_t ring_size_min = 4 * static_cast<uint32_t>(sizeof(log_record_t) + _log_line_size + 2);
+        if (ring_size_min < LOG_RING_SIZE_MIN)
+            ring_size_min = LOG_RING_SIZE_MIN;
+        _ring_size = (ring_size < ring_size_min)? ring_size_min: ring_size;
+        if (_log_format != log_format_text)
+        {
+            _site_table = new CLogSite*[LOG_SITE_NUMBER_MAX*2];
+            _site_array = new CLogSite*[LOG_SITE_NUMBER_MAX];
+            memset(const_cast<CLogSite**>(_site_table), 0, sizeof(CLogSite*)*LOG_SITE_NUMBER_MAX*2);
+            memset(const_cast<CLogSite**>(_site_array), 0, sizeof(CLogSite*)*LOG_SITE_NUMBER_MAX);
+            _site_written.assign(LOG_SITE_NUMBER_MAX, false);
+            _format_buffer = new char[LOG_FORMAT_BUFFER_SIZE+_log_line_size+2];
+        }
+    }
+    else
+    {
+        // 创建日志队列
+        uint32_t log_queue_size_ = log_queue_size;
+        if (0 == log_queue_size_)
+            log_queue_size_ = 1;
+        _log_queue = new util::CArrayQueue<log_message_t*>(log_queue_size_);
+    }
     
     // 创建和启动日志线程
     create_thread();          
@@ -196,6 +374,21 @@ void CLogger::create(const char* log_path, const char* log_filename, uint32_t lo
     create_logfile(false);
 }
 
+bool CLogger::set_thread_cpus(const char* cpu_list)
+{
+    std::vector<uint16_t> cpus;
+    if (!CCpuPlacement::parse_cpu_list(cpu_list, &cpus))
+        return false;
+
+    LockHelper<CLock> lh(CLogger::_thread_lock);
+    CPU_ZERO(&CLogger::_thread_cpu_set);
+    for (std::vector<uint16_t>::size_type i=0; i<cpus.size(); ++i)
+        CPU_SET(cpus[i], &CLogger::_thread_cpu_set);
+
+    CLogger::_has_thread_cpu_set = true;
+    return true;
+}
+
 void CLogger::create_thread()
 {
     LockHelper<CLock> lh(CLogger::_thread_lock);
@@ -203,6 +396,8 @@ void CLogger::create_thread()
     {
         CLogger::_log_thread = new CLogThread;
         CLogger::_log_thread->inc_refcount();
+        if (CLogger::_has_thread_cpu_set)
+            CLogger::_log_thread->set_cpu_set(CLogger::_thread_cpu_set);
 
         try
         {
@@ -232,6 +427,10 @@ bool CLogger::execute()
         {
             return false;
         }
+        if (_ring_size > 0)
+        {
+            return ring_write();
+        }
         if (_log_fd != -1)
         {
 #if HAVE_UIO_H==1
@@ -259,7 +458,6 @@ bool CLogger::prewrite()
     }
     else if (need_rotate_file())
     {
-        close_logfile();
         rotate_file();
     }
 
@@ -405,6 +603,186 @@ bool CLogger::batch_write()
     return !to_destroy_logger;
 }
 
+bool CLogger::ring_write()
+{
+    // 先清除通知标志再写出，之后写入的日志会再次通知
+    read_signal(1);
+    CLogger::_log_thread->dec_log_number(1);
+    atomic_set(&_ring_signaled, 0);
+    __sync_synchronize();
+    bool to_destroy_logger = _destroying;
+
+    int iovcnt = 0;
+    int ring_number = 0;
+    struct iovec iov_array[LOG_RING_IOV_NUMBER];
+    uint32_t head_array[LOG_RING_IOV_NUMBER/2];
+    CLogRing* ring_array[LOG_RING_IOV_NUMBER/2];
+    LockHelper<CLock> lh(_ring_lock);
+
+    std::vector<CLogRing*>::size_type i = 0;
+    while (i < _ring_array.size())
+    {
+        CLogRing* ring = _ring_array[i];
+
+        // 线程已退出，且日志都已写出
+        if (ring->is_closed() && ring->is_empty())
+        {
+            delete ring;
+            _ring_array[i] = _ring_array.back();
+            _ring_array.pop_back();
+            continue;
+        }
+
+        int ring_iovcnt;
+        uint32_t head = ring->peek(iov_array+iovcnt, ring_iovcnt);
+        if (ring_iovcnt > 0)
+        {
+            iovcnt += ring_iovcnt;
+            head_array[ring_number] = head;
+            ring_array[ring_number] = ring;
+            ++ring_number;
+        }
+
+        // 所有线程的日志合并成一次writev
+        ++i;
+        if ((ring_number == LOG_RING_IOV_NUMBER/2) || ((i == _ring_array.size()) && (ring_number > 0)))
+        {
+            int errcode = (_log_fd != -1)? write_ring_data(iov_array, iovcnt): 0;
+
+            // 出错时也要释放，否则写日志的线程会一直等待
+            for (int j=0; j<ring_number; ++j)
+                ring_array[j]->release(head_array[j]);
+            if (errcode != 0)
+                throw CSyscallException(errcode, __FILE__, __LINE__, "logger ring write");
+
+            iovcnt = 0;
+            ring_number = 0;
+        }
+    }
+
+    return !to_destroy_logger;
+}
+
+int CLogger::write_ring_data(const struct iovec* iov_array, int iovcnt)
+{
+    if (log_format_deferred == _log_format)
+        return write_deferred_data(iov_array, iovcnt);
+    if (log_format_binary == _log_format)
+        return write_binary_data(iov_array, iovcnt);
+
+    return write_iov(iov_array, iovcnt);
+}
+
+int CLogger::write_iov(const struct iovec* iov_array, int iovcnt)
+{
+    for (;;)
+    {
+        ssize_t retval = writev(_log_fd, iov_array, iovcnt);
+        if (-1 == retval)
+        {
+            if (EINTR == Error::code()) continue;
+            return Error::code();
+        }
+
+        _current_bytes += static_cast<uint32_t>(retval);
+        return 0;
+    }
+}
+
+int CLogger::write_data(const char* data, uint32_t size)
+{
+    while (size > 0)
+    {
+        ssize_t retval = write(_log_fd, data, size);
+        if (-1 == retval)
+        {
+            if (EINTR == Error::code()) continue;
+            return Error::code();
+        }
+
+        data += retval;
+        size -= static_cast<uint32_t>(retval);
+        _current_bytes += static_cast<uint32_t>(retval);
+    }
+
+    return 0;
+}
+
+int CLogger::write_deferred_data(const struct iovec* iov_array, int iovcnt)
+{
+    uint32_t length = 0;
+    for (int i=0; i<iovcnt; ++i)
+    {
+        // 记录不会跨越两段
+        const char* record_position = static_cast<const char*>(iov_array[i].iov_base);
+        const char* end = record_position + iov_array[i].iov_len;
+        while (record_position < end)
+        {
+            log_record_t record;
+            memcpy(&record, record_position, sizeof(record));
+            const char* payload = record_position + sizeof(record);
+            uint32_t payload_size = record.length - sizeof(record);
+
+            if (log_record_binary == record.type)
+            {
+                CLogSite* site = _site_array[record.site_id];
+                length += site->format(_format_buffer+length, _log_line_size, record, payload, payload_size);
+            }
+            else
+            {
+                memcpy(_format_buffer+length, payload, payload_size);
+                length += payload_size;
+            }
+
+            record_position += record.length;
+            if (length >= LOG_FORMAT_BUFFER_SIZE)
+            {
+                int errcode = write_data(_format_buffer, length);
+                if (errcode != 0) return errcode;
+                length = 0;
+            }
+        }
+    }
+
+    return write_data(_format_buffer, length);
+}
+
+int CLogger::write_binary_data(const struct iovec* iov_array, int iovcnt)
+{
+    // 调用点须先于使用它的记录写入文件
+    std::string site_records;
+    for (int i=0; i<iovcnt; ++i)
+    {
+        const char* record_position = static_cast<const char*>(iov_array[i].iov_base);
+        const char* end = record_position + iov_array[i].iov_len;
+        while (record_position < end)
+        {
+            log_record_t record;
+            memcpy(&record, record_position, sizeof(record));
+            if ((log_record_binary == record.type) && !_site_written[record.site_id])
+            {
+                _site_array[record.site_id]->encode_site(&site_records);
+                _site_written[record.site_id] = true;
+            }
+
+            record_position += record.length;
+        }
+    }
+
+    if (!site_records.empty())
+    {
+        int errcode = write_data(site_records.data(), static_cast<uint32_t>(site_records.size()));
+        if (errcode != 0)
+        {
+            // 不确定哪些调用点已写入，全部重写
+            _site_written.assign(_site_written.size(), false);
+            return errcode;
+        }
+    }
+
+    return write_iov(iov_array, iovcnt);
+}
+
 void CLogger::enable_screen(bool enabled)
 { 
     _screen_enabled = enabled;
@@ -446,6 +824,25 @@ void CLogger::set_backup_number(uint16_t backup_number)
     atomic_set(&_backup_number, backup_number);
 }
 
+void CLogger::set_rotate_seconds(uint32_t rotate_seconds)
+{
+    atomic_set(&_rotate_seconds, rotate_seconds);
+}
+
+void CLogger::enable_compress(bool enabled)
+{
+    _compress_enabled = enabled;
+}
+
+void CLogger::set_log_format(log_format_t log_format)
+{
+    // 调用点表在create中按格式分配，之后再切换格式会用到未分配的表
+    if ((_ring_size > 0) || (_log_queue != NULL))
+        return;
+
+    _log_format = log_format;
+}
+
 bool CLogger::enabled_bin()
 {
     return _bin_log_enabled;
@@ -495,13 +892,22 @@ bool CLogger::enabled_trace()
 
 void CLogger::do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
 {    
+    if (_ring_size > 0)
+    {
+        if (_log_format != log_format_text)
+            do_deferred_log(log_level, filename, lineno, module_name, format, args);
+        else
+            do_ring_log(log_level, filename, lineno, module_name, format, args);
+        return;
+    }
+
     va_list args_copy;
     va_copy(args_copy, args);
     util::VaListHelper vh(args_copy);
     log_message_t* log_message = (log_message_t*)malloc(_log_line_size+sizeof(log_message_t)+1);
     
-    char datetime[sizeof("2012-12-12 12:12:12")];
-    CDatetimeUtil::get_current_datetime(datetime, sizeof(datetime));
+    // 使用线程缓存的日期时间，避免每行日志都调用localtime
+    const char* datetime = CClock::get_cached_datetime();
     
     // 模块名称
     std::string module_name_field;
@@ -584,6 +990,181 @@ void CLogger::do_log(log_level_t log_level, const char* filename, int lineno, co
     }
 }
 
+void CLogger::do_ring_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
+{
+    if (_destroying) return;
+
+    // 可能自动添加的点号和换行符
+    CLogRing* ring = get_thread_ring();
+    char* line = reserve_ring_space(ring, _log_line_size+2);
+    uint32_t length = format_log_line(line, log_level, filename, lineno, module_name, format, args);
+    if (_screen_enabled)
+    {
+        (void)write(STDOUT_FILENO, line, length);
+    }
+
+    ring->commit(line, length);
+    wakeup_log_thread();
+}
+
+void CLogger::do_deferred_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
+{
+    if (_destroying) return;
+
+    log_record_t record;
+    record.flags = (_auto_adddot? LOG_RECORD_FLAG_ADDDOT: 0) | (_auto_newline? LOG_RECORD_FLAG_NEWLINE: 0);
+    record.site_id = 0;
+    record.thread_id = CThread::get_current_thread_id();
+    record.seconds = static_cast<uint32_t>(CClock::get_realtime_seconds());
+
+    CLogRing* ring = get_thread_ring();
+    char* position = reserve_ring_space(ring, sizeof(record)+_log_line_size+2);
+    char* payload = position + sizeof(record);
+    int length = -1;
+
+    // 打屏时须在调用线程中格式化
+    CLogSite* site = _screen_enabled? NULL: get_log_site(log_level, filename, lineno, module_name, format);
+    if ((site != NULL) && site->is_deferrable())
+    {
+        // 编码失败时还要用args格式化
+        va_list args_copy;
+        va_copy(args_copy, args);
+        util::VaListHelper vh(args_copy);
+
+        length = site->encode_args(payload, _log_line_size+2, args_copy);
+        record.site_id = site->get_site_id();
+    }
+    if (length >= 0)
+    {
+        record.type = log_record_binary;
+    }
+    else
+    {
+        record.type = log_record_text;
+        length = static_cast<int>(format_log_line(payload, log_level, filename, lineno, module_name, format, args));
+        if (_screen_enabled)
+        {
+            (void)write(STDOUT_FILENO, payload, length);
+        }
+    }
+
+    record.length = static_cast<uint16_t>(sizeof(record) + length);
+    memcpy(position, &record, sizeof(record));
+    ring->commit(position, record.length);
+    wakeup_log_thread();
+}
+
+/** 从index开始沿探测链查找调用点，返回NULL时index为第一个空位 */
+static CLogSite* probe_log_site(CLogSite* volatile* site_table, uint32_t& index, log_level_t log_level, const char* filename, int lineno, const char* format)
+{
+    for (;;)
+    {
+        CLogSite* site = site_table[index];
+        if ((NULL == site) || site->matches(log_level, filename, lineno, format))
+            return site;
+
+        index = (index + 1) & (LOG_SITE_NUMBER_MAX*2 - 1);
+    }
+}
+
+CLogSite* CLogger::get_log_site(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format)
+{
+    uintptr_t key = reinterpret_cast<uintptr_t>(format) ^ (static_cast<uintptr_t>(lineno) * 2654435761U);
+    uint32_t index = static_cast<uint32_t>(key ^ (key >> 12)) & (LOG_SITE_NUMBER_MAX*2 - 1);
+
+    // 调用点只增不删，且表的大小是调用点上限的两倍，查找不需要加锁
+    CLogSite* site = probe_log_site(_site_table, index, log_level, filename, lineno, format);
+    if (site != NULL) return site;
+
+    // 加锁后从空位接着查找，其它线程可能已加入了同一个调用点
+    LockHelper<CLock> lh(_site_lock);
+    site = probe_log_site(_site_table, index, log_level, filename, lineno, format);
+    if (site != NULL) return site;
+    if (_site_number >= LOG_SITE_NUMBER_MAX) return NULL;
+
+    site = new CLogSite(_site_number, log_level, filename, lineno, module_name, format);
+    _site_array[_site_number] = site;
+    __sync_synchronize(); // 构造完成后才对其它线程可见
+    _site_table[index] = site;
+    ++_site_number;
+    return site;
+}
+
+uint32_t CLogger::format_log_line(char* line, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
+{
+    // line至少有_log_line_size+2个字节，最后两个字节留给点号和换行符
+    uint32_t length = get_written_length(snprintf(line, _log_line_size, "[%s][0x%08x][%s]"
+        , CClock::get_cached_datetime(), CThread::get_current_thread_id(), get_log_level_name(log_level)), _log_line_size);
+    if (module_name != NULL)
+    {
+        length += get_written_length(snprintf(line+length, _log_line_size-length, "[%s]", module_name), _log_line_size-length);
+    }
+    length += get_written_length(snprintf(line+length, _log_line_size-length, "[%s:%d]", filename, lineno), _log_line_size-length);
+    length += get_written_length(vsnprintf(line+length, _log_line_size-length, format, args), _log_line_size-length);
+
+    // 自动添加结尾点号
+    if (_auto_adddot && (length > 0)
+     && (line[length-1] != '.')
+     && (line[length-1] != '\n'))
+    {
+        line[length++] = '.';
+    }
+
+    // 自动添加换行符
+    if (_auto_newline && (length > 0) && (line[length-1] != '\n'))
+    {
+        line[length++] = '\n';
+    }
+
+    return length;
+}
+
+CLogRing* CLogger::get_thread_ring()
+{
+    CLogRing* ring = static_cast<CLogRing*>(pthread_getspecific(_ring_key));
+    if (NULL == ring)
+    {
+        // 只在线程第一次写日志时加锁
+        ring = new CLogRing(_ring_size);
+        LockHelper<CLock> lh(_ring_lock);
+        _ring_array.push_back(ring);
+        (void)pthread_setspecific(_ring_key, ring);
+    }
+
+    return ring;
+}
+
+void CLogger::wakeup_log_thread()
+{
+    // 日志线程处理前只通知一次，而不是每行日志写一次管道
+    if ((0 == atomic_read(&_ring_signaled))
+     && __sync_bool_compare_and_swap(&_ring_signaled, 0, 1))
+    {
+        CLogger::_log_thread->inc_log_number();
+        send_signal();
+    }
+}
+
+char* CLogger::reserve_ring_space(CLogRing* ring, uint32_t size)
+{
+    char* position = ring->reserve(size);
+    while (NULL == position)
+    {
+        // 环形缓冲区满了，等日志线程写出
+        wakeup_log_thread();
+        sched_yield();
+        position = ring->reserve(size);
+    }
+
+    return position;
+}
+
+void CLogger::close_thread_ring(void* ring)
+{
+    // 线程退出时回调，由日志线程写完后删除
+    static_cast<CLogRing*>(ring)->set_closed();
+}
+
 void CLogger::push_log_message(log_message_t* log_message)
 {    
     while (_log_queue->is_full())
@@ -737,27 +1318,71 @@ void CLogger::create_logfile(bool truncate)
     }       
            
     _current_bytes = st.st_size;
-    CLogger::_log_thread->register_logger(this);    
+    CLogger::_log_thread->register_logger(this);
+
+    // 新的二进制日志文件须重新写入调用点
+    _site_written.assign(_site_written.size(), false);    
+}
+
+bool CLogger::need_rotate_file()
+{
+    if (_current_bytes > (uint32_t)atomic_read(&_max_bytes)) return true;
+
+    uint32_t rotate_seconds = atomic_read(&_rotate_seconds);
+    if (0 == rotate_seconds) return false;
+
+    time_t now = CClock::get_realtime_seconds();
+    if ((0 == _rotate_time) || ((now >= _rotate_time) && (0 == _current_bytes)))
+    {
+        // 按本地时间的整点对齐，空文件不滚动
+        struct tm result;
+        localtime_r(&now, &result);
+        time_t local_seconds = now + result.tm_gmtoff;
+        _rotate_time = (local_seconds / rotate_seconds + 1) * rotate_seconds - result.tm_gmtoff;
+        return false;
+    }
+
+    return now >= _rotate_time;
 }
 
 void CLogger::rotate_file()
 {    
-    int backup_number = atomic_read(&_backup_number);
-    for (uint16_t i=backup_number; i>0; --i)
-    {
-        char old_filename[PATH_MAX+FILENAME_MAX];
-        char new_filename[PATH_MAX+FILENAME_MAX];
+    char filename[PATH_MAX+FILENAME_MAX];
+    char segment_filename[PATH_MAX+FILENAME_MAX];
+    snprintf(filename, sizeof(filename), "%s/%s", _log_path, _log_filename);
+    snprintf(segment_filename, sizeof(segment_filename), "%s.rotating.%u", filename, _rotate_sequence++);
 
-        if (1 == i)
-            (void)snprintf(old_filename, sizeof(old_filename), "%s/%s", _log_path, _log_filename);
-        else     
-            (void)snprintf(old_filename, sizeof(old_filename), "%s/%s.%d", _log_path, _log_filename, i-1);                    
-        (void)snprintf(new_filename, sizeof(new_filename), "%s/%s.%d", _log_path, _log_filename, i);
+    // 日志线程只改名和打开新文件，备份文件的改名、压缩和删除交给归档线程
+    bool renamed = (0 == rename(filename, segment_filename));
+    int log_fd = open(filename, O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+    if (-1 == log_fd)
+    {
+        throw sys::CSyscallException(Error::code(), __FILE__, __LINE__, "rotate log file");
+    }
 
-        (void)rename(old_filename, new_filename);
+    // 原子地替换_log_fd指向的文件，不需要从日志线程注销和重新注册
+    if (-1 == dup2(log_fd, _log_fd))
+    {
+        int errcode = Error::code();
+        close(log_fd);
+        throw sys::CSyscallException(errcode, __FILE__, __LINE__, "rotate log file");
     }
 
-    create_logfile(0 == backup_number);
+    close(log_fd);
+    _current_bytes = 0;
+    _rotate_time = 0;
+    // 新的二进制日志文件须重新写入调用点
+    _site_written.assign(_site_written.size(), false);
+
+    if (renamed)
+    {
+        log_archive_t log_archive;
+        log_archive.segment_filename = segment_filename;
+        log_archive.log_filename = filename;
+        log_archive.backup_number = static_cast<uint16_t>(atomic_read(&_backup_number));
+        log_archive.compress = _compress_enabled;
+        CLogger::_log_thread->archive_file(log_archive);
+    }
 }
 
 bool CLogger::need_create_file() const
@@ -771,6 +1396,7 @@ bool CLogger::need_create_file() const
 //////////////////////////////////////////////////////////////////////////
 CLogThread::CLogThread()  
     :_epoll_fd(-1)
+    ,_archive_thread(NULL)
 {
     atomic_set(&_log_number, 0);
     _epoll_events = new struct epoll_event[LOGGER_NUMBER_MAX];
@@ -784,6 +1410,10 @@ CLogThread::~CLogThread()
     }
 
     delete []_epoll_events;
+    if (_archive_thread != NULL)
+    {
+        _archive_thread->dec_refcount();
+    }
 }
 
 void CLogThread::run()
@@ -818,6 +1448,9 @@ void CLogThread::run()
         }
     }
 
+    // 等待已滚动出的日志文件归档完
+    _archive_thread->stop();
+
     // 提示
     fprintf(stderr, "[%s]Logger thread %u exited.\n", CDatetimeUtil::get_current_datetime().c_str(), get_thread_id());
     remove_object(this);
@@ -842,13 +1475,27 @@ bool CLogThread::before_start()
     try
     {
         register_object(this);
-        return true;
     }
     catch (CSyscallException& ex)
     {
         fprintf(stderr, "Register logthread error: %s.\n", Error::to_string().c_str());
         return false;
     }    
+
+    // 创建归档线程
+    try
+    {
+        // 持有一个引用计数，线程结束时只减去start加的那个，在析构中再释放
+        _archive_thread = new CLogArchiveThread;
+        _archive_thread->inc_refcount();
+        _archive_thread->start();
+        return true;
+    }
+    catch (CSyscallException& ex)
+    {
+        fprintf(stderr, "Start log archive thread error: %s.\n", ex.to_string().c_str());
+        return false;
+    }
 }
 
 bool CLogThread::execute()
@@ -889,6 +1536,11 @@ void CLogThread::register_logger(CLogger* logger)
     }
 }
 
+void CLogThread::archive_file(const log_archive_t& log_archive)
+{
+    _archive_thread->add_archive(log_archive);
+}
+
 void CLogThread::remove_object(CLogProber* log_prober)
 {
     if (-1 == epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, log_prober->get_fd(), NULL))
@@ -909,4 +1561,160 @@ void CLogThread::register_object(CLogProber* log_prober)
     }
 }
 
+//////////////////////////////////////////////////////////////////////////
+// CLogArchiveThread
+void CLogArchiveThread::add_archive(const log_archive_t& log_archive)
+{
+    { // _lock
+        LockHelper<CLock> lh(_lock);
+        _archive_list.push_back(log_archive);
+    } // _lock
+
+    wakeup();
+}
+
+void CLogArchiveThread::run()
+{
+    // 只用空闲的CPU和IO，不和业务线程及日志线程争抢
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    (void)setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+    (void)syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+#endif // SYS_ioprio_set
+
+    // 停止前须归档完已加入的文件，否则备份文件的序号会乱
+    for (;;)
+    {
+        bool found = false;
+        log_archive_t log_archive;
+
+        { // _lock
+            LockHelper<CLock> lh(_lock);
+            if (!_archive_list.empty())
+            {
+                log_archive = _archive_list.front();
+                _archive_list.pop_front();
+                found = true;
+            }
+        } // _lock
+
+        if (found)
+        {
+            archive(log_archive);
+        }
+        else if (is_stop())
+        {
+            break;
+        }
+        else
+        {
+            do_millisleep(-1);
+        }
+    }
+}
+
+void CLogArchiveThread::archive(const log_archive_t& log_archive)
+{
+    const char* log_filename = log_archive.log_filename.c_str();
+    char old_filename[PATH_MAX+FILENAME_MAX];
+    char new_filename[PATH_MAX+FILENAME_MAX];
+
+    // 删除超出个数的备份，备份个数可能被调小过，所以一直删到不存在为止
+    for (uint32_t i=(0 == log_archive.backup_number)? 1: log_archive.backup_number;; ++i)
+    {
+        (void)snprintf(old_filename, sizeof(old_filename), "%s.%u", log_filename, i);
+        (void)snprintf(new_filename, sizeof(new_filename), "%s.%u.gz", log_filename, i);
+        bool removed = (0 == unlink(old_filename));
+        if (0 == unlink(new_filename)) removed = true;
+        if (!removed) break;
+    }
+    if (0 == log_archive.backup_number)
+    {
+        (void)unlink(log_archive.segment_filename.c_str());
+        return;
+    }
+
+    // 备份文件的序号依次加1，压缩与否可能被切换过，两种都要改名
+    for (uint16_t i=log_archive.backup_number; i>1; --i)
+    {
+        (void)snprintf(old_filename, sizeof(old_filename), "%s.%d", log_filename, i-1);
+        (void)snprintf(new_filename, sizeof(new_filename), "%s.%d", log_filename, i);
+        (void)rename(old_filename, new_filename);
+
+        (void)snprintf(old_filename, sizeof(old_filename), "%s.%d.gz", log_filename, i-1);
+        (void)snprintf(new_filename, sizeof(new_filename), "%s.%d.gz", log_filename, i);
+        (void)rename(old_filename, new_filename);
+    }
+
+    if (!log_archive.compress)
+    {
+        (void)snprintf(new_filename, sizeof(new_filename), "%s.1", log_filename);
+        if (-1 == rename(log_archive.segment_filename.c_str(), new_filename))
+            fprintf(stderr, "Rename %s error: %s.\n", log_archive.segment_filename.c_str(), Error::to_string().c_str());
+        return;
+    }
+
+    try
+    {
+        // 先压缩成临时文件，完成后再改名，不留下不完整的.gz文件
+        (void)snprintf(old_filename, sizeof(old_filename), "%s.1.gz.tmp", log_filename);
+        (void)snprintf(new_filename, sizeof(new_filename), "%s.1.gz", log_filename);
+        compress_file(log_archive.segment_filename.c_str(), old_filename);
+        if (-1 == rename(old_filename, new_filename))
+            throw CSyscallException(Error::code(), __FILE__, __LINE__, "rename compressed log");
+        (void)unlink(log_archive.segment_filename.c_str());
+    }
+    catch (CSyscallException& ex)
+    {
+        // 压缩失败时保留未压缩的文件
+        fprintf(stderr, "Compress %s error: %s.\n", log_archive.segment_filename.c_str(), ex.to_string().c_str());
+        (void)unlink(old_filename);
+        (void)snprintf(new_filename, sizeof(new_filename), "%s.1", log_filename);
+        (void)rename(log_archive.segment_filename.c_str(), new_filename);
+    }
+}
+
+void CLogArchiveThread::compress_file(const char* src_filename, const char* dst_filename)
+{
+    int src_fd = open(src_filename, O_RDONLY);
+    if (-1 == src_fd)
+        throw CSyscallException(Error::code(), __FILE__, __LINE__, "open rotated log");
+
+    gzFile gz = gzopen(dst_filename, "wb");
+    if (NULL == gz)
+    {
+        int errcode = (0 == Error::code())? ENOMEM: Error::code();
+        close(src_fd);
+        throw CSyscallException(errcode, __FILE__, __LINE__, "gzopen");
+    }
+
+    char buffer[65536];
+    int errcode = 0;
+    for (;;)
+    {
+        ssize_t bytes = read(src_fd, buffer, sizeof(buffer));
+        if (-1 == bytes)
+        {
+            if (EINTR == Error::code()) continue;
+            errcode = Error::code();
+            break;
+        }
+        if (0 == bytes)
+        {
+            break;
+        }
+        if (gzwrite(gz, buffer, static_cast<unsigned>(bytes)) != bytes)
+        {
+            errcode = (0 == Error::code())? EIO: Error::code();
+            break;
+        }
+    }
+
+    close(src_fd);
+    if ((gzclose(gz) != Z_OK) && (0 == errcode))
+        errcode = (0 == Error::code())? EIO: Error::code();
+    if (errcode != 0)
+        throw CSyscallException(errcode, __FILE__, __LINE__, "compress rotated log");
+}
+
 SYS_NAMESPACE_END
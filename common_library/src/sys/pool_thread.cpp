@@ -96,6 +96,11 @@ void CPoolThread::set_stack_size(size_t stack_size)
     _pool_thread_helper->set_stack_size(stack_size);
 }
 
+void CPoolThread::set_cpu_set(const cpu_set_t& cpu_set)
+{
+    _pool_thread_helper->set_cpu_set(cpu_set);
+}
+
 size_t CPoolThread::get_stack_size() const
 {
     return _pool_thread_helper->get_stack_size();
@@ -34,6 +34,7 @@ CThread::CThread()
     ,_stop(false)    
     ,_current_state(state_sleeping)
     ,_stack_size(0)
+    ,_has_cpu_set(false)
 {
     int retval = pthread_attr_init(&_attr);
     if (retval != 0)
@@ -65,6 +66,9 @@ void CThread::start(bool detach)
     // 设置线程栈大小
     if (_stack_size > 0)
         retval = pthread_attr_setstacksize(&_attr, _stack_size);
+    // 设置线程可运行的CPU
+    if ((0 == retval) && _has_cpu_set)
+        retval = pthread_attr_setaffinity_np(&_attr, sizeof(_cpu_set), &_cpu_set);
     if (0 == retval)
         retval = pthread_attr_setdetachstate(&_attr, detach?PTHREAD_CREATE_DETACHED:PTHREAD_CREATE_JOINABLE);
        
@@ -88,6 +92,12 @@ size_t CThread::get_stack_size() const
     return stack_size;
 }
 
+void CThread::set_cpu_set(const cpu_set_t& cpu_set)
+{
+    _has_cpu_set = true;
+    memcpy(&_cpu_set, &cpu_set, sizeof(_cpu_set));
+}
+
 void CThread::join()
 {
     // 线程自己不能调用join
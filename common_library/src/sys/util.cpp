@@ -152,6 +152,8 @@ uint16_t CUtil::get_cpu_number()
 		*value++ = 0;		
 		if (0 == strncmp("processor", name, sizeof("processor")-1))
 		{
+			 // 值的前后有空白和换行，如“processor	: 0”
+			 util::CStringUtil::trim(value);
 			 if (!util::CStringUtil::string2uint16(value, cpu_number))
              {
                  return 0;
@@ -0,0 +1,71 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/log_site.h>
+#include <sys/syscall_exception.h>
+using namespace mooon::sys;
+
+// 将log_format_binary格式的日志文件转换成文本
+// 用法：log_decoder binary_log_file [text_log_file]，不指定text_log_file时输出到标准输出
+int main(int argc, char* argv[])
+{
+    if ((argc != 2) && (argc != 3))
+    {
+        fprintf(stderr, "Usage: %s binary_log_file [text_log_file]\n", argv[0]);
+        return 1;
+    }
+
+    int binary_fd = open(argv[1], O_RDONLY);
+    if (-1 == binary_fd)
+    {
+        fprintf(stderr, "Open %s error: %m.\n", argv[1]);
+        return 1;
+    }
+
+    int text_fd = STDOUT_FILENO;
+    if (3 == argc)
+    {
+        text_fd = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (-1 == text_fd)
+        {
+            fprintf(stderr, "Open %s error: %m.\n", argv[2]);
+            close(binary_fd);
+            return 1;
+        }
+    }
+
+    int exit_code = 0;
+    try
+    {
+        uint64_t line_number = decode_binary_log(binary_fd, text_fd);
+        fprintf(stderr, "%llu lines decoded.\n", static_cast<unsigned long long>(line_number));
+    }
+    catch (CSyscallException& ex)
+    {
+        fprintf(stderr, "Decode %s error: %s.\n", argv[1], ex.to_string().c_str());
+        exit_code = 1;
+    }
+
+    close(binary_fd);
+    if (text_fd != STDOUT_FILENO)
+        close(text_fd);
+    return exit_code;
+}
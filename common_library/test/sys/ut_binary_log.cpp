@@ -0,0 +1,111 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "sys/clock.h"
+#include "sys/logger.h"
+#include "sys/log_site.h"
+using namespace mooon::sys;
+
+#define LOG_PATH   "/tmp"
+#define LINE_NUMBER 200000
+
+// 比较四种方式下调用线程每行日志的耗时，并将二进制日志转换成文本后逐行核对
+static void write_log(const char* name, const char* log_filename, uint32_t ring_size, log_format_t log_format)
+{
+    char filename[PATH_MAX];
+    snprintf(filename, sizeof(filename), "%s/%s", LOG_PATH, log_filename);
+    (void)unlink(filename);
+
+    CLogger* logger = new CLogger;
+    logger->set_log_format(log_format);
+    logger->set_single_filesize(1024*1024*1024);
+    logger->create(LOG_PATH, log_filename, 1000, ring_size);
+
+    uint64_t begin = CClock::get_monotonic_microseconds();
+    for (int i=0; i<LINE_NUMBER; ++i)
+        logger->log_info(__FILE__, __LINE__, "ut", "request %d from %s cost %.3fms, id=%llx, ratio=%*d%%", i, "127.0.0.1", i/1000.0, 0x1234567890ULL+i, 4, i%100);
+    uint64_t end = CClock::get_monotonic_microseconds();
+
+    logger->destroy();
+    printf("%s: %llu ns/line\n", name, (unsigned long long)((end-begin)*1000/LINE_NUMBER));
+}
+
+static bool check_decoded_log(const char* binary_filename, const char* text_filename)
+{
+    int binary_fd = open(binary_filename, O_RDONLY);
+    int text_fd = open(text_filename, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if ((-1 == binary_fd) || (-1 == text_fd))
+    {
+        printf("open %s or %s ERROR\n", binary_filename, text_filename);
+        return false;
+    }
+
+    uint64_t line_number = decode_binary_log(binary_fd, text_fd);
+    close(binary_fd);
+    close(text_fd);
+    if (line_number != LINE_NUMBER)
+    {
+        printf("decoded %llu lines, expected %d\n", (unsigned long long)line_number, LINE_NUMBER);
+        return false;
+    }
+
+    FILE* fp = fopen(text_filename, "r");
+    char line[1024];
+    for (int i=0; fgets(line, sizeof(line), fp) != NULL; ++i)
+    {
+        char expected[256];
+        snprintf(expected, sizeof(expected), "[ut][%s:", __FILE__);
+        if (NULL == strstr(line, expected) || (strstr(line, "[INFO]") != line+sizeof("[YYYY-MM-DD HH:MM:SS][0x12345678]")-1))
+        {
+            printf("line %d header ERROR: %s", i, line);
+            fclose(fp);
+            return false;
+        }
+
+        snprintf(expected, sizeof(expected), "]request %d from %s cost %.3fms, id=%llx, ratio=%*d%%\n", i, "127.0.0.1", i/1000.0, 0x1234567890ULL+i, 4, i%100);
+        if (strcmp(line+strlen(line)-strlen(expected), expected) != 0)
+        {
+            printf("line %d body ERROR: %s", i, line);
+            fclose(fp);
+            return false;
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+int main()
+{
+    write_log("queue text", "ut_queue.log", 0, log_format_text);
+    write_log("ring text", "ut_ring.log", 1024*1024, log_format_text);
+    write_log("ring deferred", "ut_deferred.log", 1024*1024, log_format_deferred);
+    write_log("ring binary", "ut_binary.log", 1024*1024, log_format_binary);
+
+    if (check_decoded_log(LOG_PATH"/ut_binary.log", LOG_PATH"/ut_decoded.log"))
+        printf("decode binary log SUCCESS\n");
+    else
+        printf("decode binary log ERROR\n");
+
+    return 0;
+}
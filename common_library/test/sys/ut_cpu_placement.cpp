@@ -0,0 +1,104 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <stdio.h>
+#include "sys/util.h"
+#include "sys/cpu_placement.h"
+using namespace mooon::sys;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { ++failures; printf("FAILED at line %d: %s\n", __LINE__, #condition); } \
+    } while (false)
+
+static void test_parse_cpu_list()
+{
+    std::vector<uint16_t> cpus;
+    CHECK(CCpuPlacement::parse_cpu_list("0-3,8,10-11\n", &cpus));
+    CHECK(7 == cpus.size());
+    CHECK((cpus.size() > 4) && (8 == cpus[4]));
+
+    cpus.clear();
+    CHECK(!CCpuPlacement::parse_cpu_list("3-1", &cpus));
+    cpus.clear();
+    CHECK(!CCpuPlacement::parse_cpu_list("1,x", &cpus));
+    cpus.clear();
+    CHECK(!CCpuPlacement::parse_cpu_list("", &cpus));
+    cpus.clear();
+    CHECK(!CCpuPlacement::parse_cpu_list("0-4000000000", &cpus)); // 超出CPU_SETSIZE
+    CHECK(cpus.size() < CPU_SETSIZE);
+}
+
+static void test_placement(uint16_t cpu_number)
+{
+    std::vector<std::vector<uint16_t> > node_cpus;
+    CCpuPlacement::get_numa_cpus(&node_cpus);
+    CHECK(!node_cpus.empty());
+
+    // 紧凑放置为各节点CPU的顺序拼接
+    std::vector<uint16_t> compact_cpus;
+    for (std::vector<std::vector<uint16_t> >::size_type node=0; node<node_cpus.size(); ++node)
+        compact_cpus.insert(compact_cpus.end(), node_cpus[node].begin(), node_cpus[node].end());
+    CHECK(!compact_cpus.empty());
+
+    CCpuPlacement placement;
+    CHECK(placement.create(placement_none));
+    CHECK(!placement.is_enabled());
+    CHECK(-1 == placement.get_cpu(0));
+
+    CHECK(placement.create(placement_compact));
+    CHECK(placement.is_enabled());
+    for (uint16_t i=0; i<2*compact_cpus.size(); ++i)
+        CHECK(placement.get_cpu(i) == compact_cpus[i % compact_cpus.size()]);
+
+    // 分散放置的第一轮为各非空节点的第一个CPU
+    CHECK(placement.create(placement_scatter));
+    uint16_t index = 0;
+    for (std::vector<std::vector<uint16_t> >::size_type node=0; node<node_cpus.size(); ++node)
+    {
+        if (!node_cpus[node].empty())
+            CHECK(placement.get_cpu(index++) == node_cpus[node][0]);
+    }
+    for (uint16_t i=0; i<8; ++i)
+        CHECK((placement.get_cpu(i) >= 0) && (placement.get_cpu(i) < CPU_SETSIZE));
+
+    CHECK(placement.create(placement_explicit, "0"));
+    cpu_set_t cpu_set;
+    CHECK(placement.get_cpu_set(3, &cpu_set) && CPU_ISSET(0, &cpu_set) && (1 == CPU_COUNT(&cpu_set)));
+
+    // 不存在的CPU在create时就被拒绝
+    char cpu_list[32];
+    snprintf(cpu_list, sizeof(cpu_list), "0,%u", cpu_number);
+    CHECK(!placement.create(placement_explicit, cpu_list));
+    CHECK(!placement.is_enabled());
+    CHECK(!placement.create(placement_explicit, "3-1"));
+    CHECK(!placement.create(placement_explicit, NULL));
+}
+
+int main()
+{
+    uint16_t cpu_number = CUtil::get_cpu_number();
+
+    test_parse_cpu_list();
+    test_placement(cpu_number);
+
+    printf("cpu placement with %u cpus: %s\n", cpu_number, (0 == failures)? "SUCCESS": "FAILED");
+    return (0 == failures)? 0: 1;
+}
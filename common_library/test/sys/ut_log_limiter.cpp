@@ -0,0 +1,84 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "sys/log.h"
+using namespace mooon;
+using namespace mooon::sys;
+
+// 只计数不输出的日志器，用于检查限流和摘要
+class CCountLogger: public ILogger
+{
+public:
+    CCountLogger(): line_number(0), summary_number(0) {}
+
+    virtual bool enabled_error() { return true; }
+    virtual void log_error(const char* filename, int lineno, const char* module_name, const char* format, ...)
+    {
+        if (NULL == strstr(format, "suppressed"))
+        {
+            ++line_number;
+        }
+        else
+        {
+            va_list args;
+            va_start(args, format);
+            printf("summary: ");
+            vprintf(format, args);
+            printf("\n");
+            va_end(args);
+            ++summary_number;
+        }
+    }
+
+    int line_number;
+    int summary_number;
+};
+
+static void log_lines(CCountLogger* logger, int number)
+{
+    for (int i=0; i<number; ++i)
+        __MYLOG_ERROR(logger, NULL, "%s connected failed", "127.0.0.1:8000");
+}
+
+int main()
+{
+    CCountLogger* logger = new CCountLogger;
+
+    // 不限流
+    log_lines(logger, 1000);
+    printf("unlimited: %d lines %s\n", logger->line_number, (1000 == logger->line_number)? "SUCCESS": "ERROR");
+
+    // 每秒10行，突发100行，之后每1000行放行一行
+    logger->line_number = 0;
+    CLogLimiter::set_limit(10, 100, 1000, 1);
+    log_lines(logger, 100000);
+    printf("limited: %d lines %s\n", logger->line_number, (logger->line_number >= 200) && (logger->line_number <= 210)? "SUCCESS": "ERROR");
+
+    // 1秒后输出摘要
+    sleep(2);
+    log_lines(logger, 1);
+    printf("summary %s\n", (1 == logger->summary_number)? "SUCCESS": "ERROR");
+
+    CLogLimiter::set_limit(0);
+    delete logger;
+    return 0;
+}
@@ -0,0 +1,166 @@
+﻿/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/thread.h>
+#include <sys/util.h>
+#include <sys/event_queue.h>
+#include <sys/mpmc_event_queue.h>
+#include <util/array_queue.h>
+using namespace mooon;
+
+// 多个生产者和多个消费者同时操作同一队列，
+// 检查所有消息都被恰好取出一次，并比较加锁队列与无锁队列的吞吐
+#define THREAD_NUMBER  4       /** 生产者和消费者线程数各为多少 */
+#define MESSAGE_NUMBER 200000  /** 每个生产者发送多少条消息 */
+
+static uint64_t get_current_microseconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+template <class QueueType>
+class CProducer: public sys::CThread
+{
+public:
+    CProducer(QueueType* queue, int index)
+        :_queue(queue), _index(index)
+    {
+    }
+
+private:
+    virtual void run()
+    {
+        for (uint32_t i=1; i<=MESSAGE_NUMBER; ++i)
+        {
+            // 值编码了生产者编号，0留作结束标记
+            while (!_queue->push_back(_index*MESSAGE_NUMBER + i));
+        }
+    }
+
+private:
+    QueueType* _queue;
+    int _index;
+};
+
+template <class QueueType>
+class CConsumer: public sys::CThread
+{
+public:
+    CConsumer(QueueType* queue)
+        :_queue(queue), _count(0), _sum(0)
+    {
+    }
+
+    uint64_t get_count() const { return _count; }
+    uint64_t get_sum() const { return _sum; }
+
+private:
+    virtual void run()
+    {
+        for (;;)
+        {
+            uint32_t m;
+            if (!_queue->pop_front(m)) continue;
+            if (0 == m) break;
+
+            ++_count;
+            _sum += m;
+        }
+    }
+
+private:
+    QueueType* _queue;
+    uint64_t _count;
+    uint64_t _sum;
+};
+
+template <class QueueType>
+bool test_queue(const char* name, QueueType* queue)
+{
+    CProducer<QueueType>* producers[THREAD_NUMBER];
+    CConsumer<QueueType>* consumers[THREAD_NUMBER];
+    uint64_t expected_sum = 0;
+
+    for (int i=0; i<THREAD_NUMBER; ++i)
+    {
+        for (uint32_t j=1; j<=MESSAGE_NUMBER; ++j)
+            expected_sum += i*MESSAGE_NUMBER + j;
+
+        producers[i] = new CProducer<QueueType>(queue, i);
+        consumers[i] = new CConsumer<QueueType>(queue);
+        producers[i]->inc_refcount();
+        consumers[i]->inc_refcount();
+    }
+
+    uint64_t start_us = get_current_microseconds();
+    for (int i=0; i<THREAD_NUMBER; ++i)
+    {
+        consumers[i]->start();
+        producers[i]->start();
+    }
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        producers[i]->join();
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        while (!queue->push_back(0)); // 每个消费者一个结束标记
+    for (int i=0; i<THREAD_NUMBER; ++i)
+        consumers[i]->join();
+    uint64_t elapsed_us = get_current_microseconds() - start_us;
+
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    for (int i=0; i<THREAD_NUMBER; ++i)
+    {
+        count += consumers[i]->get_count();
+        sum += consumers[i]->get_sum();
+        producers[i]->dec_refcount();
+        consumers[i]->dec_refcount();
+    }
+
+    bool ok = (count == (uint64_t)THREAD_NUMBER*MESSAGE_NUMBER) && (sum == expected_sum);
+    printf("%s: %s, count=%llu, %llums, %.1f ns/message\n"
+          , name, ok? "OK": "FAILED"
+          , (unsigned long long)count, (unsigned long long)(elapsed_us / 1000)
+          , elapsed_us * 1000.0 / count);
+    return ok;
+}
+
+int main()
+{
+    try
+    {
+        sys::CEventQueue<util::CArrayQueue<uint32_t> > event_queue(1024, 1000, 1000);
+        sys::CMpmcEventQueue<uint32_t> mpmc_queue(1024, 1000, 1000);
+
+        bool ok1 = test_queue("CEventQueue", &event_queue);
+        bool ok2 = test_queue("CMpmcEventQueue", &mpmc_queue);
+        return (ok1 && ok2)? 0: 1;
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        printf("Main exception: %s at %s:%d\n"
+            , sys::CUtil::get_error_message(ex.get_errcode()).c_str()
+            , ex.get_filename()
+            , ex.get_linenumber());
+        return 1;
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ *
+ * 开放寻址哈希表的正确性测试，随机插入和删除，结果和std::map对比
+ */
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/open_hash_map.h>
+using namespace mooon::util;
+
+struct uint64_hasher
+{
+    uint64_t operator ()(uint64_t key) const { return key; }
+};
+
+struct uint64_comparer
+{
+    bool operator ()(uint64_t lhs, uint64_t rhs) const { return lhs == rhs; }
+};
+
+typedef COpenHashMap<uint64_t, uint64_t, uint64_hasher, uint64_comparer> CUint64Map;
+
+static int check_against_std_map()
+{
+    CUint64Map open_map(4);
+    std::map<uint64_t, uint64_t> std_map;
+    int error_number = 0;
+
+    // 键值集中在小范围内，使探测链较长，删除时的前移被充分执行
+    srandom(1);
+    for (int i=0; i<200000; ++i)
+    {
+        uint64_t key = random() % 3000;
+        if (random() % 3 == 0)
+        {
+            bool erased = open_map.erase(key);
+            if (erased != (std_map.erase(key) > 0))
+                ++error_number;
+        }
+        else
+        {
+            bool inserted = open_map.insert(key, key*2);
+            if (inserted != std_map.insert(std::make_pair(key, key*2)).second)
+                ++error_number;
+        }
+    }
+
+    if (open_map.size() != std_map.size())
+        ++error_number;
+    for (uint64_t key=0; key<3000; ++key)
+    {
+        uint64_t* value = open_map.find(key);
+        bool found = std_map.find(key) != std_map.end();
+        if ((value != NULL) != found || (value != NULL && *value != key*2))
+            ++error_number;
+    }
+
+    if (error_number > 0)
+        printf("ERROR %d mismatches against std::map\n", error_number);
+    return error_number;
+}
+
+int main()
+{
+    printf("\n>>>>>>>>>>TEST open_hash_map<<<<<<<<<<\n\n");
+    int error_number = check_against_std_map();
+
+    printf("%s\n", (0 == error_number)? "TEST open_hash_map OK": "TEST open_hash_map FAILED");
+    return (0 == error_number)? 0: 1;
+}
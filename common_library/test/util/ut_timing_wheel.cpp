@@ -0,0 +1,122 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/timing_wheel.h>
+using namespace mooon::util;
+
+class CTimerObject
+{
+public:
+    CTimerObject()
+        :expired_tick(0)
+        ,expire_times(0)
+    {
+        timer_node[0].set_owner(this, 0);
+        timer_node[1].set_owner(this, 1);
+    }
+
+    uint64_t expired_tick;
+    uint64_t expect_tick;
+    uint32_t expire_times;
+    CTimerNode<CTimerObject> timer_node[2];
+};
+
+class CTimerHandler: public ITimerHandler<CTimerObject>
+{
+public:
+    CTimerHandler()
+        :current_milliseconds(0)
+        ,error_number(0)
+    {
+    }
+
+    virtual void on_timer_expired(CTimerObject* owner, uint8_t kind)
+    {
+        ++owner->expire_times;
+        owner->expired_tick = current_milliseconds;
+        if (kind != 0)
+        {
+            printf("ERROR kind %d expired, it was cancelled\n", kind);
+            ++error_number;
+        }
+        if (owner->expired_tick != owner->expect_tick)
+        {
+            printf("ERROR expired at %" PRIu64 ", expect %" PRIu64 "\n", owner->expired_tick, owner->expect_tick);
+            ++error_number;
+        }
+    }
+
+    uint64_t current_milliseconds;
+    int error_number;
+};
+
+int main()
+{
+    printf("\n>>>>>>>>>>TEST timing_wheel<<<<<<<<<<\n\n");
+
+    const int object_number = 2000;
+    CTimerObject* objects = new CTimerObject[object_number];
+    CTimerHandler handler;
+    CTimingWheel<CTimerObject> timing_wheel(1);
+    timing_wheel.set_timer_handler(&handler);
+
+    // 跨越各层的随机定时，再对一半重新计时，并停止所有的1号定时器
+    srand(2013);
+    uint64_t start_milliseconds = 123456;
+    for (int i=0; i<object_number; ++i)
+    {
+        uint32_t timeout = (uint32_t)(rand() % (1 << 21));
+        objects[i].expect_tick = start_milliseconds + timeout;
+        timing_wheel.arm(&objects[i].timer_node[0], timeout, start_milliseconds);
+        timing_wheel.arm(&objects[i].timer_node[1], timeout/2, start_milliseconds);
+    }
+    for (int i=0; i<object_number; i+=2)
+    {
+        uint32_t timeout = (uint32_t)(rand() % (1 << 16));
+        objects[i].expect_tick = start_milliseconds + 100 + timeout;
+        timing_wheel.arm(&objects[i].timer_node[0], timeout, start_milliseconds + 100);
+    }
+    for (int i=0; i<object_number; ++i)
+    {
+        timing_wheel.cancel(&objects[i].timer_node[1]);
+    }
+    printf("timer number: %u\n", timing_wheel.get_timer_number());
+
+    // 逐毫秒推进，检查每个定时器恰好在到期的那一毫秒被回调
+    for (handler.current_milliseconds=start_milliseconds+1; handler.current_milliseconds<start_milliseconds+(1<<21)+10; ++handler.current_milliseconds)
+    {
+        timing_wheel.check_timeout(handler.current_milliseconds);
+    }
+
+    for (int i=0; i<object_number; ++i)
+    {
+        if (objects[i].expire_times != 1)
+        {
+            printf("ERROR object %d expired %u times\n", i, objects[i].expire_times);
+            ++handler.error_number;
+        }
+    }
+
+    printf("timer number: %u, error number: %d\n", timing_wheel.get_timer_number(), handler.error_number);
+    printf("%s\n", (0 == handler.error_number)? "SUCCESS": "FAILURE");
+
+    delete []objects;
+    return 0;
+}
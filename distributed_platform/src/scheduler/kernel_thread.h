@@ -19,6 +19,9 @@
 #ifndef MOOON_SCHEDULER_KERNEL_THREAD_H
 #define MOOON_SCHEDULER_KERNEL_THREAD_H
 #include <net/epoller.h>
+#include <net/epollable_queue.h>
+#include <net/mpmc_epollable_queue.h>
+#include <util/array_queue.h>
 #include <sys/pool_thread.h>
 #include <scheduler/scheduler.h>
 #include "message_bridge.h"
@@ -42,7 +45,11 @@ private:
 	CKernelService* _kernel_service;
 	IMessageBridge* _message_bridge;
 	net::CEpoller _epoller;
+#if ENABLE_MPMC_QUEUE==1
+	typedef net::CMpmcEpollableQueue<const TDistributedMessage*> CMessageQueue;
+#else
 	typedef net::CEpollableQueue<util::CArrayQueue<const TDistributedMessage*> > CMessageQueue;
+#endif // ENABLE_MPMC_QUEUE
 	CMessageQueue _request_queue;
 	CMessageQueue _response_queue;
 };